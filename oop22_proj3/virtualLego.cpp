@@ -11,6 +11,15 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "../sim/simScene.h"
+#include "../sim/fixedStep.h"
+#include "../sim/substepper.h"
+#include "../sim/transformBatch.h"
+#include "../sim/entityStore.h"
+#include "../sim/deferredQueue.h"
+#include "../sim/levelFile.h"
+#include "../sim/levelStream.h"
+#include "../sim/shotPreview.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
@@ -24,25 +33,15 @@ IDirect3DDevice9* Device = NULL;
 const int Width = 1024;
 const int Height = 768;
 
-// 0.42
-// There are four balls
-// initialize the position (coordinate) of each ball (ball0 ~ ball54)
-const float spherePos[54][2] = { {-0.21f,-2.0f} , {-0.63f, -2.0f} , {0.63f, -2.0f} , {0.21f, -2.0f},
-								{-1.05f, -2.0f}, {-1.47f, -2.0f}, {1.47f, -2.0f}, {1.05f, -2.0f},
-								{-1.8f, -1.7f}, {-2.1f, -1.4f}, {2.1f, -1.4f}, {1.8f, -1.7f},
-								{-2.1f, -0.98f}, {-2.1f, -0.56f}, {2.1f, -0.56f}, {2.1f, -0.98f},
-								{-2.1f, -0.14f}, {-2.1f, 0.28f}, {2.1f, 0.28f}, {2.1f, -0.14f},
-								{-2.1f, 0.7f}, {-2.1f, 1.12f}, {2.1f, 1.12f}, {2.1f, 0.7f},
-								{-2.1f, 1.54f}, {-2.1f, 1.96f}, {2.1f, 1.96f}, {2.1f, 1.54f},
-								{-2.1f, 2.38f}, {-1.8f, 2.68f}, {1.8f, 2.68f}, {2.1f, 2.38f},
-								{-1.47f, 2.98f}, {-1.05f, 2.98f}, {1.05f, 2.98f}, {1.47f, 2.98f},
-								{-0.63f, 2.87f}, {-0.21f, 2.98f}, {0.21f, 2.98f}, {0.63f, 2.98f},
-								{-0.21f, -0.56f}, {-0.63f, -0.56f}, {0.63f, -0.56f}, {0.21f, -0.56f},
-								{-0.93f, -0.26f}, {-1.23f, 0.04f}, {1.23f, 0.04f}, {0.93f, -0.26f},
-								{-0.21f, 0.28f}, {-0.21f, 0.7f}, {-0.93f, 1.54f}, {-0.93f, 1.96f},
-								{0.93f, 1.54f}, {0.93f, 1.96f} };
-
-const D3DXCOLOR sphereColor = d3d::YELLOW;
+// brick layout, read from the working directory. without any of the files the built in level is used
+const char* LEVEL_STREAM = "level.lvs";
+const char* LEVEL_BINARY = "level.lvl";
+const char* LEVEL_TEXT   = "level.txt";
+
+// a chunked level is streamed around the camera, which then follows the shot ball up the table
+const size_t LEVEL_STREAM_BUDGET = 1 << 20;
+const float  STREAM_VIEW_BEHIND  = 6.0f;
+const float  STREAM_VIEW_AHEAD   = 12.0f;
 
 // -----------------------------------------------------------------------------
 // Transform matrices
@@ -52,11 +51,42 @@ D3DXMATRIX g_mWorld;
 D3DXMATRIX g_mView;
 D3DXMATRIX g_mProj;
 
+// positions of the drawn spheres and walls, turned into world matrices once per frame
+sim::CTransformBatch g_transforms;
+
+// every ball draws the same sphere mesh, with one of a few shared materials
+sim::CMaterialTable  g_materials;
+ID3DXMesh*           g_sphereMesh = NULL;
+
+// meshes of knocked out bricks, released after Present for up to RELEASE_BUDGET seconds a
+// frame instead of mid-frame, so a big burst is worked off over the next few frames
+sim::CDeferredQueue  g_releases;
+const double         RELEASE_BUDGET = 0.2e-3;
+
+static void releaseMesh(void* mesh)
+{
+	((ID3DXMesh*)mesh)->Release();
+}
+
+// aim line of the shot ball before it is fired, drawn as an unlit line strip
+struct PreviewVertex
+{
+	float    x, y, z;
+	D3DCOLOR colour;
+};
+const DWORD PREVIEW_FVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
 #define M_RADIUS 0.21   // ball radius
 #define PI 3.14159265
 #define M_HEIGHT 0.01
 #define DECREASE_RATE 0.9982
 
+// sim::Mat4 has the D3DMATRIX layout, so transforms built by the sim math go to the device as they are
+inline const D3DMATRIX* toD3D(const sim::Mat4& m) { return reinterpret_cast<const D3DMATRIX*>(&m); }
+inline const sim::Mat4& toSim(const D3DMATRIX& m) { return reinterpret_cast<const sim::Mat4&>(m); }
+inline D3DXVECTOR3 toD3D(const sim::Vec3& v) { return D3DXVECTOR3(v.x, v.y, v.z); }
+inline const D3DMATERIAL9* toD3D(const sim::Material& m) { return reinterpret_cast<const D3DMATERIAL9*>(&m); }
+
 // -----------------------------------------------------------------------------
 // CSphere class definition
 // -----------------------------------------------------------------------------
@@ -65,17 +95,13 @@ class CSphere {
 private:
 	float					center_x, center_y, center_z;
 	float                   m_radius;
-	float					m_velocity_x;
-	float					m_velocity_z;
 
 public:
 	CSphere(void)
 	{
-		D3DXMatrixIdentity(&m_mLocal);
-		ZeroMemory(&m_mtrl, sizeof(m_mtrl));
+		m_slot = -1;
+		m_material = 0;
 		m_radius = 0;
-		m_velocity_x = 0;
-		m_velocity_z = 0;
 		m_pSphereMesh = NULL;
 	}
 	~CSphere(void) {}
@@ -86,14 +112,12 @@ public:
 		if (NULL == pDevice)
 			return false;
 
-		m_mtrl.Ambient = color;
-		m_mtrl.Diffuse = color;
-		m_mtrl.Specular = color;
-		m_mtrl.Emissive = d3d::BLACK;
-		m_mtrl.Power = 5.0f;
+		m_material = g_materials.add(sim::makeMaterial(color.r, color.g, color.b, color.a, 5.0f));
 
-		if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
+		if (g_sphereMesh == NULL && FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &g_sphereMesh, NULL)))
 			return false;
+		m_pSphereMesh = g_sphereMesh;
+		m_pSphereMesh->AddRef();
 		return true;
 	}
 
@@ -105,133 +129,35 @@ public:
 		}
 	}
 
-	void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
-	{
-		if (NULL == pDevice)
-			return;
-		pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-		pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-		pDevice->SetMaterial(&m_mtrl);
-		m_pSphereMesh->DrawSubset(0);
-	}
-
-	bool hasIntersected(CSphere& ball)
-	{
-		D3DXVECTOR3 hitPos = this->getCenter();
-		D3DXVECTOR3	shotPos = ball.getCenter();
-		float dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
-
-		if (dist < 0.42) {
-			return true;
-		}
-		return false;
-	}
-
-	void hitBy(CSphere& ball) // ball is shotPos
+	// hands the mesh reference to the caller, who releases it later
+	ID3DXMesh* detachMesh(void)
 	{
-		D3DXVECTOR3 hitPos = this->getCenter();
-		D3DXVECTOR3	shotPos = ball.getCenter();
-		double dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
-		double vx = ball.getVelocity_X(); float vz = ball.getVelocity_Z();
-		double dx = hitPos.x - shotPos.x; float dz = hitPos.z - shotPos.z;
-
-		if (dist <= 2 * M_RADIUS) {
-			double shotDegree = 0.0;
-			double collideDegree = 0.0;
-			double newDegree = 0.0;
-
-			collideDegree = floor((180 / PI) * ((int)(atan2(dx, dz) + 360) % 360));
-			shotDegree = floor((180 / PI) * ((int)(atan2(vx, vz) + 360) % 360));
-
-			if (dx >= 0 && dz >= 0) {
-				newDegree = 180 + 2 * collideDegree - shotDegree;
-			}
-			else if (dx < 0 && dz >= 0) {
-				if (collideDegree - 90 <= shotDegree && shotDegree < collideDegree) {
-					newDegree = -180 + 2 * collideDegree - shotDegree;
-				}
-				else if (collideDegree <= shotDegree && shotDegree < collideDegree + 90){
-					newDegree = 180 - 2 * collideDegree + shotDegree;
-				}
-			}
-			else if (dx >= 0 && dz < 0) {
-				if (collideDegree - 90 <= shotDegree && shotDegree < collideDegree) {
-					newDegree = -180 + 2 * collideDegree - shotDegree;
-				}
-				else{
-					newDegree = 2 * 180 - 2 * collideDegree + shotDegree;
-					
-				}
-			}
-			else {
-				if (collideDegree - 90 <= shotDegree && shotDegree < collideDegree) {
-					newDegree = -180 + 2 * collideDegree - shotDegree;
-				}
-				else{
-					newDegree = 2 * 180 - 2 * collideDegree + shotDegree;
-				}
-			}
-			ball.setPower(2 * cos(newDegree), 2 * sin(newDegree));
-			this->destroy();
-		}
-	}
-
-	void ballUpdate(float timeDiff)
-	{
-		D3DXVECTOR3 cord = this->getCenter();
-		double vx = abs(this->getVelocity_X());
-		double vz = abs(this->getVelocity_Z());
-
-		if (vx > 0.01 || vz > 0.01)
-		{
-			float tX = cord.x +  timeDiff * m_velocity_x;
-			float tZ = cord.z +  timeDiff * m_velocity_z;
-
-			// correction of position of ball
-			// Please uncomment this part because this correction of ball position is necessary when a ball collides with a wall
-			if (tX >= (3 - M_RADIUS)) {
-				tX = 3 - M_RADIUS;
-				this->setPower(-getVelocity_X(), getVelocity_Z());
-			}
-			else if (tX <=(-3 + M_RADIUS)){
-				tX = -3 + M_RADIUS;
-				this->setPower(-getVelocity_X(), getVelocity_Z());
-			}
-			else if (tZ >= (4.5 - M_RADIUS)) {
-				tZ = 4.5 - M_RADIUS;
-				this->setPower(getVelocity_X(), -getVelocity_Z());
-			}
-			this->setCenter(tX, cord.y, tZ);
-		}
-		else { this->setPower(0, 0); }
-
-		this->setPower(getVelocity_X(), getVelocity_Z());
+		ID3DXMesh* mesh = m_pSphereMesh;
+		m_pSphereMesh = NULL;
+		return mesh;
 	}
 
-	double getVelocity_X() { return this->m_velocity_x; }
-	double getVelocity_Z() { return this->m_velocity_z; }
-
-	void setPower(double vx, double vz)
+	void draw(IDirect3DDevice9* pDevice)
 	{
-		this->m_velocity_x = vx;
-		this->m_velocity_z = vz;
+		if (NULL == pDevice)
+			return;
+		pDevice->SetTransform(D3DTS_WORLD, toD3D(g_transforms.getTransform(slot())));
+		pDevice->SetMaterial(toD3D(g_materials.get(m_material)));
+		m_pSphereMesh->DrawSubset(0);
 	}
 
 	void setCenter(float x, float y, float z)
 	{
-		D3DXMATRIX m;
 		center_x = x;	center_y = y;	center_z = z;
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
+		g_transforms.setPosition(slot(), sim::vec3(x, y, z));
 	}
 
+	void setCenter(const sim::Vec3& c) { setCenter(c.x, c.y, c.z); }
 	float getRadius(void)  const { return (float)(M_RADIUS); }
-	const D3DXMATRIX& getLocalTransform(void) const { return m_mLocal; }
-	void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
 
-	D3DXVECTOR3 getCenter(void) const
+	sim::Vec3 getCenter(void) const
 	{
-		D3DXVECTOR3 org(center_x, center_y, center_z);
+		sim::Vec3 org = { center_x, center_y, center_z };
 		return org;
 	}
 
@@ -245,89 +171,13 @@ public:
 	}
 
 private:
-	D3DXMATRIX              m_mLocal;
-	D3DMATERIAL9            m_mtrl;
-	ID3DXMesh* m_pSphereMesh;
-
-};
+	// the batch slot, taken on first use
+	int slot(void) { if (m_slot < 0) m_slot = g_transforms.add(sim::vec3(0, 0, 0)); return m_slot; }
 
-class CHolderSphere : public CSphere{
-public:
-	bool hasIntersected(CSphere& ball, bool isShot) {
-		D3DXVECTOR3 hitPos = this->getCenter();
-		D3DXVECTOR3	shotPos = ball.getCenter();
-		double dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
-		float dx = hitPos.x - shotPos.x; float dz = hitPos.z - shotPos.z;
-
-		if (dist < 0.42) {
-			return true;
-		}
-		return false;
-	}
-
-	void hitBy(CSphere &ball, bool isShot) // ball은 shotPos
-	{ 
-		D3DXVECTOR3 hitPos = this->getCenter();
-		D3DXVECTOR3	shotPos = ball.getCenter();
-
-		double dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
-		float vx = ball.getVelocity_X(); float vz = ball.getVelocity_Z();
-		float dx = hitPos.x - shotPos.x; float dz = hitPos.z - shotPos.z;
-		
-		if (dist <= 0.42) {
-			ball.setPower(0, 0);
-			float shotTan = 0.0f;
-			float collideTan = 0.0f;
-			float limitTan = 0.0f;
-			float dbRadian = 0.0f;
-			
-			if (dx == 0) collideTan = pow(10, 8);
-			else collideTan = dz / dx;
-
-			limitTan = -1 / collideTan;
-
-			if (vx == 0) shotTan = pow(10, 8);
-			else shotTan = vz / vx;
-
-			if (dx >= 0 && dz >= 0) {
-				dbRadian = PI + 2 * atan2(dx, dz) - atan2(vx, vz);
-			}
-			else if (dx < 0 && dz >= 0) {
-				if (shotTan > collideTan || shotTan < limitTan) {
-					dbRadian = -PI + 2 * atan2(dx, dz) - atan2(vx, vz);
-				}
-				else if (shotTan < collideTan && shotTan > limitTan) {
-					dbRadian = PI + 2 * atan2(dx, dz) - atan2(vx, vz);
-				}
-			}
-			else if (dx >= 0 && dz < 0) {
-				if (shotTan > collideTan || shotTan < limitTan) {
-					dbRadian = -PI + 2 * atan2(dx, dz) - atan2(vx, vz);
-				}
-				else if (shotTan < collideTan && shotTan > limitTan) {
-					dbRadian = 2 * PI - 2 * atan2(dx, dz) + atan2(vx, vz);
-				}
-			}
-			else {
-				if (shotTan > collideTan || shotTan < limitTan) {
-					dbRadian = -PI + 2 * atan2(dx, dz) - atan2(vx, vz);
-				}
-				else if (shotTan < collideTan && shotTan > limitTan) {
-					dbRadian = 2 * PI - 2 * atan2(dx, dz) + atan2(vx, vz);
-				}
-			}
-
-			double dbDegree = floor((180 / PI) * dbRadian);
-			double newTan = tan(dbDegree);
-			double v = 2 / sqrt(1 + pow(newTan, 2));
-
-			if (this->hasIntersected(ball, isShot)) {
-				ball.setCenter(shotPos.x + v * 0.01, shotPos.y, shotPos.z + v * newTan * 0.01);
-			}
+	int                     m_slot;
+	int                     m_material;
+	ID3DXMesh* m_pSphereMesh;
 
-			ball.setPower(v, v * newTan);
-		}
-	}
 };
 
 // -----------------------------------------------------------------------------
@@ -347,7 +197,7 @@ private:
 public:
 	CWall(void)
 	{
-		D3DXMatrixIdentity(&m_mLocal);
+		m_slot = -1;
 		ZeroMemory(&m_mtrl, sizeof(m_mtrl));
 		m_width = 0;
 		m_depth = 0;
@@ -380,50 +230,29 @@ public:
 			m_pBoundMesh = NULL;
 		}
 	}
-	void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+	void draw(IDirect3DDevice9* pDevice)
 	{
 		if (NULL == pDevice)
 			return;
-		pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-		pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
+		pDevice->SetTransform(D3DTS_WORLD, toD3D(g_transforms.getTransform(slot())));
 		pDevice->SetMaterial(&m_mtrl);
 		m_pBoundMesh->DrawSubset(0);
 	}
 
-	bool hasIntersected(CSphere& ball) 
-	{
-
-	}
-
-	bool hitBy(CSphere& ball)
-	{
-			
-		D3DXVECTOR3	shotPos = ball.getCenter();
-		double cur_velocity_x = ball.getVelocity_X();
-		double cur_velocity_z = ball.getVelocity_Z();
-
-		if (shotPos.z <= -8.25) {
-			return true;
-		}
-		return false;
-	}
-
 	void setPosition(float x, float y, float z)
 	{
-		D3DXMATRIX m;
 		this->m_x = x;
 		this->m_z = z;
-
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
+		g_transforms.setPosition(slot(), sim::vec3(x, y, z));
 	}
 
 	float getHeight(void) const { return M_HEIGHT; }
 
 private:
-	void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
+	// the batch slot, taken on first use
+	int slot(void) { if (m_slot < 0) m_slot = g_transforms.add(sim::vec3(0, 0, 0)); return m_slot; }
 
-	D3DXMATRIX              m_mLocal;
+	int                     m_slot;
 	D3DMATERIAL9            m_mtrl;
 	ID3DXMesh* m_pBoundMesh;
 };
@@ -438,7 +267,7 @@ public:
 	{
 		static DWORD i = 0;
 		m_index = i++;
-		D3DXMatrixIdentity(&m_mLocal);
+		m_mLocal = sim::mat4Identity();
 		::ZeroMemory(&m_lit, sizeof(m_lit));
 		m_pMesh = NULL;
 		m_bound._center = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
@@ -483,10 +312,10 @@ public:
 		if (NULL == pDevice)
 			return false;
 
-		D3DXVECTOR3 pos(m_bound._center);
-		D3DXVec3TransformCoord(&pos, &pos, &m_mLocal);
-		D3DXVec3TransformCoord(&pos, &pos, &mWorld);
-		m_lit.Position = pos;
+		sim::Vec3 pos = { m_bound._center.x, m_bound._center.y, m_bound._center.z };
+		pos = sim::transformCoord(pos, m_mLocal);
+		pos = sim::transformCoord(pos, toSim(mWorld));
+		m_lit.Position = toD3D(pos);
 
 		pDevice->SetLight(m_index, &m_lit);
 		pDevice->LightEnable(m_index, TRUE);
@@ -497,18 +326,17 @@ public:
 	{
 		if (NULL == pDevice)
 			return;
-		D3DXMATRIX m;
-		D3DXMatrixTranslation(&m, m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
-		pDevice->SetTransform(D3DTS_WORLD, &m);
+		sim::Mat4 m = sim::mat4Translation(m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
+		pDevice->SetTransform(D3DTS_WORLD, toD3D(m));
 		pDevice->SetMaterial(&d3d::WHITE_MTRL);
 		m_pMesh->DrawSubset(0);
 	}
 
-	D3DXVECTOR3 getPosition(void) const { return D3DXVECTOR3(m_lit.Position); }
+	sim::Vec3 getPosition(void) const { return sim::vec3(m_lit.Position.x, m_lit.Position.y, m_lit.Position.z); }
 
 private:
 	DWORD               m_index;
-	D3DXMATRIX          m_mLocal;
+	sim::Mat4           m_mLocal;
 	D3DLIGHT9           m_lit;
 	ID3DXMesh* m_pMesh;
 	d3d::BoundingSphere m_bound;
@@ -523,11 +351,25 @@ POINT ptMouse;
 int		g_point;
 CWall	g_legoPlane;
 CWall	g_legowall[3];
-CSphere	g_sphere[54];
+std::vector<CSphere>	g_sphere;
 CSphere g_shotBall;
-CHolderSphere	g_holderBall;
+CSphere	g_holderBall;
 CLight	g_light;
-bool	isShot;
+
+// ball, brick and holder physics. the CSphere objects above only draw what the scene holds
+sim::CLegoScene	g_scene;
+sim::CFixedStepper	g_stepper;
+sim::CSubstepper	g_substepper;   // more substeps while balls are fast, counts kept per frame
+sim::CLevelStream	g_stream;
+
+// the bricks and, as the last item, the holder, for tracing the aim line. knocked out bricks
+// are removed from it, a streamed level rebuilds a slot's subtree when its chunk comes or goes
+sim::CBvh			g_bvh;
+sim::CShotPreview	g_preview;
+std::vector<sim::Vec3>	g_bvhCenters;
+PreviewVertex		g_previewLine[sim::PREVIEW_MAX_BOUNCES + 2];
+int					g_previewPoints = 0;
+bool				g_previewDirty = true;
 
 double  g_camera_pos[3] = { 0.0, 10.0, -8.0 };
 
@@ -538,46 +380,211 @@ double  g_camera_pos[3] = { 0.0, 10.0, -8.0 };
 
 void destroyAllLegoBlock(void)
 {
+	g_releases.drain();
+	for (int i = 0; i < (int)g_sphere.size(); i++)
+		g_sphere[i].destroy();
+	g_holderBall.destroy();
+	g_shotBall.destroy();
+	// the balls only borrowed the shared mesh, this drops the last reference
+	if (g_sphereMesh != NULL) {
+		g_sphereMesh->Release();
+		g_sphereMesh = NULL;
+	}
+}
+
+// one sphere per brick of the scene, in the level's colours
+bool createBricks(const float* colours, const uint8_t* brickColour)
+{
+	g_sphere.resize(g_scene.getBrickCount());
+	for (int i = 0; i < (int)g_sphere.size(); i++) {
+		const float* c = colours + 4 * brickColour[i];
+		if (false == g_sphere[i].create(Device, D3DXCOLOR(c[0], c[1], c[2], c[3]))) return false;
+		g_sphere[i].setCenter(g_scene.getBrick(i).getCenter());
+	}
+	return true;
+}
+
+bool fileExists(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file != NULL)
+		fclose(file);
+	return file != NULL;
+}
+
+// the chunked level only sets up empty slots here, streamLevel fills them. the binary level is
+// read straight from the mapping, the text one is parsed. a level that does not load is
+// reported and the next one is tried, the built in one last
+bool setupLevel(void)
+{
+	if (fileExists(LEVEL_STREAM)) {
+		if (g_stream.open(LEVEL_STREAM, LEVEL_STREAM_BUDGET)) {
+			g_scene.setTable(g_stream.getTable());
+			g_scene.setupSlots(g_stream.getSlotCount(), g_stream.getSlotCapacity());
+			g_sphere.resize(g_scene.getBrickCount());
+			return true;
+		}
+		::MessageBox(0, g_stream.getError().c_str(), LEVEL_STREAM, 0);
+	}
+
+	sim::CLevelFile file;
+	if (file.open(LEVEL_BINARY)) {
+		g_scene.setTable(file.getTable());
+		g_scene.setup(file.getBrickPos(), file.getBrickCount());
+		return createBricks(file.getColour(0), file.getBrickColours());
+	}
+	if (fileExists(LEVEL_BINARY))
+		::MessageBox(0, file.getError().c_str(), LEVEL_BINARY, 0);
+
+	std::string error;
+	sim::LevelData level;
+	if (!fileExists(LEVEL_TEXT)) {
+		sim::makeDefaultLevel(level);
+	}
+	else if (!sim::readLevelText(LEVEL_TEXT, level, error) ||
+		!sim::checkLevel(level.getBrickPos(), level.getBrickCount(), level.table, error)) {
+		::MessageBox(0, error.c_str(), LEVEL_TEXT, 0);
+		sim::makeDefaultLevel(level);
+	}
+	g_scene.setTable(level.table);
+	g_scene.setup(level.getBrickPos(), level.getBrickCount());
+	return createBricks(&level.colours[0], level.colour.empty() ? NULL : &level.colour[0]);
+}
+
+// every brick slot, then the holder, once in Setup. a streamed level gets a subtree per slot,
+// all empty until streamLevel fills them, and the holder is a group of its own after them
+void buildBvh(void)
+{
+	int holder = g_scene.getBrickCount();
+	g_bvhCenters.resize(holder + 1);
+	for (int i = 0; i < holder; i++)
+		g_bvhCenters[i] = g_scene.getBrick(i).getCenter();
+	g_bvhCenters[holder] = g_scene.getHolderBall().getCenter();
+	if (g_stream.isOpen()) {
+		g_bvh.buildGroups(&g_bvhCenters[0], holder + 1, sim::BALL_RADIUS, g_scene.getSlotCapacity());
+		for (int slot = 0; slot < g_stream.getSlotCount(); slot++)
+			g_bvh.rebuildGroup(slot, NULL, 0);
+	}
+	else {
+		g_bvh.build(&g_bvhCenters[0], holder + 1, sim::BALL_RADIUS);
+		for (int i = 0; i < holder; i++)
+			if (!g_scene.isBrickAlive(i))
+				g_bvh.remove(i);
+	}
+	g_preview.setTable(g_scene.getTable(), g_scene.getWalls(), g_scene.getWallCount());
+	g_previewDirty = true;
+}
+
+// chunks around the camera come in and the ones left behind go, the spheres follow the slots.
+// the shared sphere mesh exists by now, so creating a sphere only takes a reference to it. a
+// slot's subtree is built again for the bricks it gets, a few hundred at most
+void streamLevel(float cameraZ)
+{
+	int capacity = g_scene.getSlotCapacity();
+	g_stream.update(cameraZ - STREAM_VIEW_BEHIND, cameraZ + STREAM_VIEW_AHEAD);
+
+	const std::vector<int>& evicted = g_stream.getEvicted();
+	for (int k = 0; k < (int)evicted.size(); k++) {
+		for (int i = evicted[k] * capacity; i < (evicted[k] + 1) * capacity; i++) {
+			ID3DXMesh* mesh = g_sphere[i].detachMesh();
+			if (mesh != NULL) g_releases.push(releaseMesh, mesh);
+		}
+		g_bvh.rebuildGroup(evicted[k], NULL, 0);
+		g_scene.clearSlot(evicted[k]);
+	}
+
+	const std::vector<int>& loaded = g_stream.getLoaded();
+	for (int k = 0; k < (int)loaded.size(); k++) {
+		int slot = loaded[k];
+		const uint8_t* colour = g_stream.getSlotBrickColours(slot);
+		g_scene.loadSlot(slot, g_stream.getSlotBrickPos(slot), g_stream.getSlotBrickCount(slot));
+		for (int i = 0; i < g_stream.getSlotBrickCount(slot); i++) {
+			const float* c = g_stream.getColour(colour[i]);
+			int brick = slot * capacity + i;
+			g_sphere[brick].create(Device, D3DXCOLOR(c[0], c[1], c[2], c[3]));
+			g_sphere[brick].setCenter(g_scene.getBrick(brick).getCenter());
+			g_bvhCenters[brick] = g_scene.getBrick(brick).getCenter();
+		}
+		g_bvh.rebuildGroup(slot, &g_bvhCenters[slot * capacity], g_stream.getSlotBrickCount(slot));
+	}
+	if (!evicted.empty() || !loaded.empty())
+		g_previewDirty = true;
+}
+
+// the path the shot ball would take from where the holder is now. no allocation and a few
+// casts, so it keeps up with every mouse move
+void updatePreview(void)
+{
+	g_bvh.move(g_scene.getBrickCount(), g_scene.getHolderBall().getCenter());
+	int count = g_preview.trace(g_bvh, g_scene.getShotBall().getCenter(), 0, sim::LEGO_SHOT_SPEED);
+	for (int i = 0; i < count; i++) {
+		const sim::Vec3& p = g_preview.getPoint(i);
+		PreviewVertex v = { p.x, p.y, p.z, D3DCOLOR_XRGB(255, 255, 255) };
+		g_previewLine[i] = v;
+	}
+	g_previewPoints = count;
+	g_previewDirty = false;
+}
+
+void drawPreview(void)
+{
+	if (g_previewPoints < 2)
+		return;
+	Device->SetTransform(D3DTS_WORLD, &g_mWorld);
+	Device->SetRenderState(D3DRS_LIGHTING, FALSE);
+	Device->SetFVF(PREVIEW_FVF);
+	Device->DrawPrimitiveUP(D3DPT_LINESTRIP, g_previewPoints - 1, g_previewLine, sizeof(PreviewVertex));
+	Device->SetRenderState(D3DRS_LIGHTING, TRUE);
+}
+
+// camera above and behind z, looking at it
+void setCamera(float z)
+{
+	D3DXVECTOR3 pos(0.0f, 14.0f, z - 8.0f);
+	D3DXVECTOR3 target(0.0f, 0.0f, z);
+	D3DXVECTOR3 up(0.0f, 2.0f, 0.0f);
+	D3DXMatrixLookAtLH(&g_mView, &pos, &target, &up);
+	Device->SetTransform(D3DTS_VIEW, &g_mView);
 }
 
 // initialization
 bool Setup()
 {
-	int i;
-
 	D3DXMatrixIdentity(&g_mWorld);
 	D3DXMatrixIdentity(&g_mView);
 	D3DXMatrixIdentity(&g_mProj);
 
+	// create the bricks and set the position
+	if (false == setupLevel()) return false;
+
+	// the level decides the table, the default one is 6 x 9
+	const sim::TableDesc& table = g_scene.getTable();
+	float width = table.maxX - table.minX, depth = table.maxZ - table.minZ;
+	float midX = 0.5f * (table.minX + table.maxX), midZ = 0.5f * (table.minZ + table.maxZ);
+
 	// create plane and set the position
-	if (false == g_legoPlane.create(Device, -1, -1, 6, 0.03f, 9, d3d::GREEN)) return false;
-	g_legoPlane.setPosition(0.0f, -0.0006f / 5, 0.0f);// x, y, z가 바닥면의 위치
+	if (false == g_legoPlane.create(Device, -1, -1, width, 0.03f, depth, d3d::GREEN)) return false;
+	g_legoPlane.setPosition(midX, -0.0006f / 5, midZ);// x, y, z가 바닥면의 위치
 
 	// create walls and set the position. note that there are four walls
-	if (false == g_legowall[0].create(Device, -1, -1, 6, 0.3f, 0.12f, d3d::BLACK)) return false;
-	g_legowall[0].setPosition(0.0f, 0.12f, 4.56f); // up
+	if (false == g_legowall[0].create(Device, -1, -1, width, 0.3f, 0.12f, d3d::BLACK)) return false;
+	g_legowall[0].setPosition(midX, 0.12f, table.maxZ + 0.06f); // up
 	//if (false == g_legowall[1].create(Device, -1, -1, 6, 0.3f, 0.12f, d3d::BLUE)) return false;
 	//g_legowall[1].setPosition(0.0f, 0.12f, -4.56f);
-	if (false == g_legowall[1].create(Device, -1, -1, 0.12f, 0.3f, 9.24f, d3d::BLACK)) return false;
-	g_legowall[1].setPosition(3.06f, 0.12f, 0.0f); // right
-	if (false == g_legowall[2].create(Device, -1, -1, 0.12f, 0.3f, 9.24f, d3d::BLACK)) return false;
-	g_legowall[2].setPosition(-3.06f, 0.12f, 0.0f); // left
-
-	// create four balls and set the position
-	for (i = 0; i < 54; i++) {
-		if (false == g_sphere[i].create(Device, sphereColor)) return false;
-		g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS, spherePos[i][1]);
-		g_sphere[i].setPower(0, 0);
-	}
+	if (false == g_legowall[1].create(Device, -1, -1, 0.12f, 0.3f, depth + 0.24f, d3d::BLACK)) return false;
+	g_legowall[1].setPosition(table.maxX + 0.06f, 0.12f, midZ); // right
+	if (false == g_legowall[2].create(Device, -1, -1, 0.12f, 0.3f, depth + 0.24f, d3d::BLACK)) return false;
+	g_legowall[2].setPosition(table.minX - 0.06f, 0.12f, midZ); // left
 
 	// create white holder ball for set direction
 	if (false == g_holderBall.create(Device, d3d::WHITE)) return false;
-	g_holderBall.setCenter(.0f, (float)M_RADIUS, -4.3f);
+	g_holderBall.setCenter(g_scene.getHolderBall().getCenter());
 
 	
 	// create red shot ball for set direction
 	if (false == g_shotBall.create(Device, d3d::RED)) return false;
-	g_shotBall.setCenter(.0f, (float)M_RADIUS, -3.88f);
+	g_shotBall.setCenter(g_scene.getShotBall().getCenter());
+	buildBvh();
 	
 	
 	// light setting 
@@ -623,16 +630,19 @@ void Cleanup(void)
 		g_legowall[i].destroy();
 	}
 	destroyAllLegoBlock();
+	g_stream.close();
 	g_light.destroy();
 }
 
 
 // timeDelta represents the time between the current image frame and the last image frame.
-// the distance of moving balls should be "velocity * timeDelta"
+// physics runs in fixed steps, drawing blends the last two steps so motion stays smooth
 bool Display(float timeDelta)
 {
 	int i = 0;
 	int j = 0;
+	int steps = 0;
+	float alpha = 0;
 
 
 	if (Device)
@@ -640,43 +650,63 @@ bool Display(float timeDelta)
 		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
 		Device->BeginScene();
 
-		// update the position of each ball. during update, check whether each ball hit by walls.
-		for (i = 0; i < 3; i++) {
-			g_shotBall.ballUpdate(timeDelta);
-			if (g_legowall[i].hitBy(g_shotBall)) {
-				g_shotBall.setPower(0, 0);
-				g_shotBall.setCenter(g_holderBall.getCenter().x, (float)M_RADIUS, -3.88f);
-				isShot = false;
-			}
+		// move the shot ball, bounce it off walls, holder and bricks
+		steps = g_stepper.advance(timeDelta);
+		for (i = 0; i < steps; i++)
+			g_scene.step(g_stepper.getStep(), g_substepper.plan(g_scene.getMaxSpeed(), g_stepper.getStep()));
+		g_substepper.endFrame();
+		alpha = g_stepper.getAlpha();
+
+		// queue the meshes of the bricks the scene has knocked out and follow the moving balls
+		const std::vector<int>& removed = g_scene.getRemoved();
+		for (i = 0; i < (int)removed.size(); i++) {
+			ID3DXMesh* mesh = g_sphere[removed[i]].detachMesh();
+			if (mesh != NULL) g_releases.push(releaseMesh, mesh);
+			g_bvh.remove(removed[i]);
+			g_previewDirty = true;
 		}
-
-		g_holderBall.hitBy(g_shotBall, isShot);
-		g_holderBall.setPower(0, 0);
-
-		// check whether any two balls hit together and update the direction of balls
-		for (i = 0; i < 54; i++) {
-			if (!g_sphere[i].isNull()) g_sphere[i].hitBy(g_shotBall);
-			
+		g_scene.clearRemoved();
+		g_holderBall.setCenter(g_scene.getHolderBall().getCenter());
+		g_shotBall.setCenter(g_scene.getShotBallCenter(alpha));
+
+		// a streamed level scrolls with the shot ball and never waits for a chunk
+		if (g_stream.isOpen()) {
+			float cameraZ = g_scene.getShotBallCenter(alpha).z;
+			if (cameraZ < 0.0f) cameraZ = 0.0f;
+			setCamera(cameraZ);
+			streamLevel(cameraZ);
 		}
-		g_holderBall.ballUpdate(timeDelta);
-		g_shotBall.ballUpdate(timeDelta);
+
+		// matrices of whatever moved since the last frame, then one SetTransform per object
+		g_transforms.update(toSim(g_mWorld));
 
 		// draw plane, walls, and spheres
-		g_legoPlane.draw(Device, g_mWorld);
+		g_legoPlane.draw(Device);
 		for (i = 0; i < 3; i++) {
-			g_legowall[i].draw(Device, g_mWorld);
-			//if (!g_sphere[i].isNull()) g_sphere[i].draw(Device, g_mWorld);
+			g_legowall[i].draw(Device);
+			//if (!g_sphere[i].isNull()) g_sphere[i].draw(Device);
 		}
-		for (i = 0; i < 54; ++i) {
-			if (!g_sphere[i].isNull()) g_sphere[i].draw(Device, g_mWorld);
+		// standing bricks only, visited through the scene's alive bits
+		const uint64_t* alive = g_scene.getAliveMask();
+		for (j = 0; j < g_scene.getAliveMaskWords(); j++) {
+			for (uint64_t bits = alive[j]; bits; bits &= bits - 1)
+				g_sphere[j * 64 + sim::countTrailingZeros64(bits)].draw(Device);
 		}
-		g_holderBall.draw(Device, g_mWorld);
-		g_shotBall.draw(Device, g_mWorld);
+		g_holderBall.draw(Device);
+		g_shotBall.draw(Device);
 		g_light.draw(Device);
 
+		// the aim line while the ball waits in front of the holder
+		if (!g_scene.isShot()) {
+			if (g_previewDirty)
+				updatePreview();
+			drawPreview();
+		}
+
 		Device->EndScene();
 		Device->Present(0, 0, 0, 0);
 		Device->SetTexture(0, NULL);
+		g_releases.drainFor(RELEASE_BUDGET);
 	}
 	return true;
 }
@@ -710,8 +740,7 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 			}
 			break;
 		case VK_SPACE:
-			g_shotBall.setPower(0, 2);
-			isShot = true;
+			g_scene.shoot();
 			break;
 		}
 		break;
@@ -726,13 +755,11 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		dx = (old_x - new_x);// * 0.01f;
 		dy = (old_y - new_y);// * 0.01f;
 
-		D3DXVECTOR3 Coord3d = g_holderBall.getCenter();
-		if (Coord3d.x + dx * (-0.01f) <= 2.79f && Coord3d.x + dx * (-0.01f) >= -2.79f) {
-			g_holderBall.setCenter(Coord3d.x + dx * (-0.01f), Coord3d.y, Coord3d.z);
-			if (!isShot) {	
-				g_shotBall.setCenter(Coord3d.x + dx * (-0.01f), Coord3d.y, Coord3d.z + 0.42f);
-			}
-		}
+		g_scene.moveHolder(dx * (-0.01f));
+		g_holderBall.setCenter(g_scene.getHolderBall().getCenter());
+		g_shotBall.setCenter(g_scene.getShotBall().getCenter());
+		if (dx != 0 && !g_scene.isShot())
+			updatePreview();
 		old_x = new_x;
 		old_y = new_y;
 		move = WORLD_MOVE;
@@ -149,7 +149,10 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 	MSG msg;
 	::ZeroMemory(&msg, sizeof(MSG));
 
-	static double lastTime = (double)timeGetTime(); 
+	// timeDelta is handed over in seconds, the game decides how much simulation that is
+	LARGE_INTEGER freq, lastTime, currTime;
+	::QueryPerformanceFrequency(&freq);
+	::QueryPerformanceCounter(&lastTime);
 
 	while(msg.message != WM_QUIT)
 	{
@@ -160,8 +163,8 @@ int d3d::EnterMsgLoop( bool (*ptr_display)(float timeDelta) )
 		}
 		else
         {	
-			double currTime  = (double)timeGetTime();
-			double timeDelta = (currTime - lastTime)*0.0007;
+			::QueryPerformanceCounter(&currTime);
+			double timeDelta = (double)(currTime.QuadPart - lastTime.QuadPart) / (double)freq.QuadPart;
 			ptr_display((float)timeDelta);
 
 			lastTime = currTime;
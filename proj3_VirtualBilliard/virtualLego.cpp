@@ -11,6 +11,13 @@
 ////////////////////////////////////////////////////////////////////////////////
 
 #include "d3dUtility.h"
+#include "../sim/simScene.h"
+#include "../sim/fixedStep.h"
+#include "../sim/substepper.h"
+#include "../sim/transformBatch.h"
+#include "../sim/entityStore.h"
+#include "../sim/shotSearch.h"
+#include "../sim/shotPreview.h"
 #include <vector>
 #include <ctime>
 #include <cstdlib>
@@ -23,9 +30,7 @@ IDirect3DDevice9* Device = NULL;
 const int Width  = 1024;
 const int Height = 768;
 
-// There are four balls
-// initialize the position (coordinate) of each ball (ball0 ~ ball3)
-const float spherePos[4][2] = { {-2.7f,0} , {+2.4f,0} , {3.3f,0} , {-2.7f,-0.9f}}; 
+// There are four balls, their positions live in sim::billiardBallPos
 // initialize the color of each ball (ball0 ~ ball3)
 const D3DXCOLOR sphereColor[4] = {d3d::RED, d3d::RED, d3d::YELLOW, d3d::WHITE};
 
@@ -36,11 +41,24 @@ D3DXMATRIX g_mWorld;
 D3DXMATRIX g_mView;
 D3DXMATRIX g_mProj;
 
+// positions of the drawn spheres and walls, turned into world matrices once per frame
+sim::CTransformBatch g_transforms;
+
+// every ball draws the same sphere mesh, with one of a few shared materials
+sim::CMaterialTable  g_materials;
+ID3DXMesh*           g_sphereMesh = NULL;
+
 #define M_RADIUS 0.21   // ball radius
 #define PI 3.14159265
 #define M_HEIGHT 0.01
 #define DECREASE_RATE 0.9982
 
+// sim::Mat4 has the D3DMATRIX layout, so transforms built by the sim math go to the device as they are
+inline const D3DMATRIX* toD3D(const sim::Mat4& m) { return reinterpret_cast<const D3DMATRIX*>(&m); }
+inline const sim::Mat4& toSim(const D3DMATRIX& m) { return reinterpret_cast<const sim::Mat4&>(m); }
+inline D3DXVECTOR3 toD3D(const sim::Vec3& v) { return D3DXVECTOR3(v.x, v.y, v.z); }
+inline const D3DMATERIAL9* toD3D(const sim::Material& m) { return reinterpret_cast<const D3DMATERIAL9*>(&m); }
+
 // -----------------------------------------------------------------------------
 // CSphere class definition
 // -----------------------------------------------------------------------------
@@ -49,17 +67,13 @@ class CSphere {
 private :
 	float					center_x, center_y, center_z;
     float                   m_radius;
-	float					m_velocity_x;
-	float					m_velocity_z;
 
 public:
     CSphere(void)
     {
-        D3DXMatrixIdentity(&m_mLocal);
-        ZeroMemory(&m_mtrl, sizeof(m_mtrl));
+        m_slot = -1;
+        m_material = 0;
         m_radius = 0;
-		m_velocity_x = 0;
-		m_velocity_z = 0;
         m_pSphereMesh = NULL;
     }
     ~CSphere(void) {}
@@ -70,14 +84,12 @@ public:
         if (NULL == pDevice)
             return false;
 		
-        m_mtrl.Ambient  = color;
-        m_mtrl.Diffuse  = color;
-        m_mtrl.Specular = color;
-        m_mtrl.Emissive = d3d::BLACK;
-        m_mtrl.Power    = 5.0f;
+        m_material = g_materials.add(sim::makeMaterial(color.r, color.g, color.b, color.a, 5.0f));
 		
-        if (FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &m_pSphereMesh, NULL)))
+        if (g_sphereMesh == NULL && FAILED(D3DXCreateSphere(pDevice, getRadius(), 50, 50, &g_sphereMesh, NULL)))
             return false;
+        m_pSphereMesh = g_sphereMesh;
+        m_pSphereMesh->AddRef();
         return true;
     }
 	
@@ -89,89 +101,36 @@ public:
         }
     }
 
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+    void draw(IDirect3DDevice9* pDevice)
     {
         if (NULL == pDevice)
             return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
-        pDevice->SetMaterial(&m_mtrl);
+        pDevice->SetTransform(D3DTS_WORLD, toD3D(g_transforms.getTransform(slot())));
+        pDevice->SetMaterial(toD3D(g_materials.get(m_material)));
 		m_pSphereMesh->DrawSubset(0);
     }
 	
-    bool hasIntersected(CSphere& ball) 
-	{
-		// Insert your code here.
-		return false;
-	}
-	
-	void hitBy(CSphere& ball) 
-	{ 
-		// Insert your code here.
-	}
-
-	void ballUpdate(float timeDiff) 
-	{
-		const float TIME_SCALE = 3.3;
-		D3DXVECTOR3 cord = this->getCenter();
-		double vx = abs(this->getVelocity_X());
-		double vz = abs(this->getVelocity_Z());
-
-		if(vx > 0.01 || vz > 0.01)
-		{
-			float tX = cord.x + TIME_SCALE*timeDiff*m_velocity_x;
-			float tZ = cord.z + TIME_SCALE*timeDiff*m_velocity_z;
-
-			//correction of position of ball
-			/* Please uncomment this part because this correction of ball position is necessary when a ball collides with a wall
-			if(tX >= (4.5 - M_RADIUS))
-				tX = 4.5 - M_RADIUS;
-			else if(tX <=(-4.5 + M_RADIUS))
-				tX = -4.5 + M_RADIUS;
-			else if(tZ <= (-3 + M_RADIUS))
-				tZ = -3 + M_RADIUS;
-			else if(tZ >= (3 - M_RADIUS))
-				tZ = 3 - M_RADIUS;
-			*/
-			this->setCenter(tX, cord.y, tZ);
-		}
-		else { this->setPower(0,0);}
-		//this->setPower(this->getVelocity_X() * DECREASE_RATE, this->getVelocity_Z() * DECREASE_RATE);
-		double rate = 1 -  (1 - DECREASE_RATE)*timeDiff * 400;
-		if(rate < 0 )
-			rate = 0;
-		this->setPower(getVelocity_X() * rate, getVelocity_Z() * rate);
-	}
-
-	double getVelocity_X() { return this->m_velocity_x;	}
-	double getVelocity_Z() { return this->m_velocity_z; }
-
-	void setPower(double vx, double vz)
-	{
-		this->m_velocity_x = vx;
-		this->m_velocity_z = vz;
-	}
-
 	void setCenter(float x, float y, float z)
 	{
-		D3DXMATRIX m;
 		center_x=x;	center_y=y;	center_z=z;
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
+		g_transforms.setPosition(slot(), sim::vec3(x, y, z));
 	}
+
+	void setCenter(const sim::Vec3& c) { setCenter(c.x, c.y, c.z); }
 	
 	float getRadius(void)  const { return (float)(M_RADIUS);  }
-    const D3DXMATRIX& getLocalTransform(void) const { return m_mLocal; }
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
-    D3DXVECTOR3 getCenter(void) const
+    sim::Vec3 getCenter(void) const
     {
-        D3DXVECTOR3 org(center_x, center_y, center_z);
+        sim::Vec3 org = { center_x, center_y, center_z };
         return org;
     }
 	
 private:
-    D3DXMATRIX              m_mLocal;
-    D3DMATERIAL9            m_mtrl;
+    // the batch slot, taken on first use
+    int slot(void) { if (m_slot < 0) m_slot = g_transforms.add(sim::vec3(0, 0, 0)); return m_slot; }
+
+    int                     m_slot;
+    int                     m_material;
     ID3DXMesh*              m_pSphereMesh;
 	
 };
@@ -195,7 +154,7 @@ private:
 public:
     CWall(void)
     {
-        D3DXMatrixIdentity(&m_mLocal);
+        m_slot = -1;
         ZeroMemory(&m_mtrl, sizeof(m_mtrl));
         m_width = 0;
         m_depth = 0;
@@ -228,33 +187,20 @@ public:
             m_pBoundMesh = NULL;
         }
     }
-    void draw(IDirect3DDevice9* pDevice, const D3DXMATRIX& mWorld)
+    void draw(IDirect3DDevice9* pDevice)
     {
         if (NULL == pDevice)
             return;
-        pDevice->SetTransform(D3DTS_WORLD, &mWorld);
-        pDevice->MultiplyTransform(D3DTS_WORLD, &m_mLocal);
+        pDevice->SetTransform(D3DTS_WORLD, toD3D(g_transforms.getTransform(slot())));
         pDevice->SetMaterial(&m_mtrl);
 		m_pBoundMesh->DrawSubset(0);
     }
 	
-	bool hasIntersected(CSphere& ball) {
-		// Insert your code here.
-		return false;
-	}
-
-	void hitBy(CSphere& ball) {
-		// Insert your code here.
-	}    
-	
 	void setPosition(float x, float y, float z)
 	{
-		D3DXMATRIX m;
 		this->m_x = x;
 		this->m_z = z;
-
-		D3DXMatrixTranslation(&m, x, y, z);
-		setLocalTransform(m);
+		g_transforms.setPosition(slot(), sim::vec3(x, y, z));
 	}
 	
     float getHeight(void) const { return M_HEIGHT; }
@@ -262,9 +208,10 @@ public:
 	
 	
 private :
-    void setLocalTransform(const D3DXMATRIX& mLocal) { m_mLocal = mLocal; }
+    // the batch slot, taken on first use
+    int slot(void) { if (m_slot < 0) m_slot = g_transforms.add(sim::vec3(0, 0, 0)); return m_slot; }
 	
-	D3DXMATRIX              m_mLocal;
+	int                     m_slot;
     D3DMATERIAL9            m_mtrl;
     ID3DXMesh*              m_pBoundMesh;
 };
@@ -279,7 +226,7 @@ public:
     {
         static DWORD i = 0;
         m_index = i++;
-        D3DXMatrixIdentity(&m_mLocal);
+        m_mLocal = sim::mat4Identity();
         ::ZeroMemory(&m_lit, sizeof(m_lit));
         m_pMesh = NULL;
         m_bound._center = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
@@ -324,10 +271,10 @@ public:
         if (NULL == pDevice)
             return false;
 		
-        D3DXVECTOR3 pos(m_bound._center);
-        D3DXVec3TransformCoord(&pos, &pos, &m_mLocal);
-        D3DXVec3TransformCoord(&pos, &pos, &mWorld);
-        m_lit.Position = pos;
+        sim::Vec3 pos = { m_bound._center.x, m_bound._center.y, m_bound._center.z };
+        pos = sim::transformCoord(pos, m_mLocal);
+        pos = sim::transformCoord(pos, toSim(mWorld));
+        m_lit.Position = toD3D(pos);
 		
         pDevice->SetLight(m_index, &m_lit);
         pDevice->LightEnable(m_index, TRUE);
@@ -338,18 +285,17 @@ public:
     {
         if (NULL == pDevice)
             return;
-        D3DXMATRIX m;
-        D3DXMatrixTranslation(&m, m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
-        pDevice->SetTransform(D3DTS_WORLD, &m);
+        sim::Mat4 m = sim::mat4Translation(m_lit.Position.x, m_lit.Position.y, m_lit.Position.z);
+        pDevice->SetTransform(D3DTS_WORLD, toD3D(m));
         pDevice->SetMaterial(&d3d::WHITE_MTRL);
         m_pMesh->DrawSubset(0);
     }
 
-    D3DXVECTOR3 getPosition(void) const { return D3DXVECTOR3(m_lit.Position); }
+    sim::Vec3 getPosition(void) const { return sim::vec3(m_lit.Position.x, m_lit.Position.y, m_lit.Position.z); }
 
 private:
     DWORD               m_index;
-    D3DXMATRIX          m_mLocal;
+    sim::Mat4           m_mLocal;
     D3DLIGHT9           m_lit;
     ID3DXMesh*          m_pMesh;
     d3d::BoundingSphere m_bound;
@@ -365,6 +311,26 @@ CSphere	g_sphere[4];
 CSphere	g_target_blueball;
 CLight	g_light;
 
+// ball and cushion physics. g_sphere only draws what the scene holds
+sim::CBilliardScene	g_scene;
+sim::CFixedStepper	g_stepper;
+sim::CSubstepper	g_substepper;   // more substeps while balls are fast, counts kept per frame
+sim::CShotSearch	g_shotSearch;   // 'S' puts the blue target where the best shot found aims
+sim::CShotCache		g_shotCache;    // so pressing 'S' again on the same table costs lookups only
+
+// aim line of the white ball toward the blue target, traced against the other three balls
+struct PreviewVertex
+{
+	float    x, y, z;
+	D3DCOLOR colour;
+};
+const DWORD PREVIEW_FVF = D3DFVF_XYZ | D3DFVF_DIFFUSE;
+
+sim::CBvh			g_bvh;
+sim::CShotPreview	g_preview;
+PreviewVertex		g_previewLine[sim::PREVIEW_MAX_BOUNCES + 2];
+int					g_previewPoints = 0;
+
 double g_camera_pos[3] = {0.0, 5.0, -8.0};
 
 // -----------------------------------------------------------------------------
@@ -374,6 +340,43 @@ double g_camera_pos[3] = {0.0, 5.0, -8.0};
 
 void destroyAllLegoBlock(void)
 {
+	for (int i = 0; i < 4; i++)
+		g_sphere[i].destroy();
+	g_target_blueball.destroy();
+	// the balls only borrowed the shared mesh, this drops the last reference
+	if (g_sphereMesh != NULL) {
+		g_sphereMesh->Release();
+		g_sphereMesh = NULL;
+	}
+}
+
+// the path the white ball takes when it is shot at the blue target now, with the velocity
+// the space key gives it
+void updatePreview(void)
+{
+	for (int i = 0; i < 4; i++)
+		g_bvh.move(i, g_scene.getBall(i).getCenter());
+	sim::Vec3 white = g_scene.getBall(3).getCenter();
+	sim::Vec3 target = g_target_blueball.getCenter();
+	int count = g_preview.trace(g_bvh, white, target.x - white.x, target.z - white.z,
+		sim::PREVIEW_MAX_BOUNCES, sim::PREVIEW_MAX_LENGTH, 3);
+	for (int i = 0; i < count; i++) {
+		const sim::Vec3& p = g_preview.getPoint(i);
+		PreviewVertex v = { p.x, p.y, p.z, D3DCOLOR_XRGB(255, 255, 255) };
+		g_previewLine[i] = v;
+	}
+	g_previewPoints = count;
+}
+
+void drawPreview(void)
+{
+	if (g_previewPoints < 2)
+		return;
+	Device->SetTransform(D3DTS_WORLD, &g_mWorld);
+	Device->SetRenderState(D3DRS_LIGHTING, FALSE);
+	Device->SetFVF(PREVIEW_FVF);
+	Device->DrawPrimitiveUP(D3DPT_LINESTRIP, g_previewPoints - 1, g_previewLine, sizeof(PreviewVertex));
+	Device->SetRenderState(D3DRS_LIGHTING, TRUE);
 }
 
 // initialization
@@ -400,15 +403,24 @@ bool Setup()
 	g_legowall[3].setPosition(-4.56f, 0.12f, 0.0f);
 
 	// create four balls and set the position
+	g_scene.setup();
+	g_shotSearch.setCache(&g_shotCache);
 	for (i=0;i<4;i++) {
 		if (false == g_sphere[i].create(Device, sphereColor[i])) return false;
-		g_sphere[i].setCenter(spherePos[i][0], (float)M_RADIUS , spherePos[i][1]);
-		g_sphere[i].setPower(0,0);
+		g_sphere[i].setCenter(g_scene.getBall(i).getCenter());
 	}
 	
 	// create blue ball for set direction
     if (false == g_target_blueball.create(Device, d3d::BLUE)) return false;
 	g_target_blueball.setCenter(.0f, (float)M_RADIUS , .0f);
+
+	sim::Vec3 centers[4];
+	for (i = 0; i < 4; i++)
+		centers[i] = g_scene.getBall(i).getCenter();
+	g_bvh.build(centers, 4, sim::BALL_RADIUS);
+	g_preview.setTable(g_scene.getTable(), g_scene.getWalls(), g_scene.getWallCount());
+	g_preview.setRule(sim::PREVIEW_CUE);
+	updatePreview();
 	
 	// light setting 
     D3DLIGHT9 lit;
@@ -458,11 +470,14 @@ void Cleanup(void)
 
 
 // timeDelta represents the time between the current image frame and the last image frame.
-// the distance of moving balls should be "velocity * timeDelta"
+// physics runs in fixed steps, drawing blends the last two steps so motion stays smooth
 bool Display(float timeDelta)
 {
 	int i=0;
 	int j = 0;
+	int steps = 0;
+	float alpha = 0;
+	static bool wasMoving = false;
 
 
 	if( Device )
@@ -470,28 +485,34 @@ bool Display(float timeDelta)
 		Device->Clear(0, 0, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, 0x00afafaf, 1.0f, 0);
 		Device->BeginScene();
 		
-		// update the position of each ball. during update, check whether each ball hit by walls.
-		for( i = 0; i < 4; i++) {
-			g_sphere[i].ballUpdate(timeDelta);
-			for(j = 0; j < 4; j++){ g_legowall[i].hitBy(g_sphere[j]); }
-		}
-
-		// check whether any two balls hit together and update the direction of balls
-		for(i = 0 ;i < 4; i++){
-			for(j = 0 ; j < 4; j++) {
-				if(i >= j) {continue;}
-				g_sphere[i].hitBy(g_sphere[j]);
-			}
-		}
+		// move the balls, bounce them off the cushions and off each other
+		steps = g_stepper.advance(timeDelta);
+		for (i = 0; i < steps; i++)
+			g_scene.step(g_stepper.getStep(), g_substepper.plan(g_scene.getMaxSpeed(), g_stepper.getStep()));
+		g_substepper.endFrame();
+		alpha = g_stepper.getAlpha();
+		for (i = 0; i < 4; i++)
+			g_sphere[i].setCenter(g_scene.getBallCenter(i, alpha));
+
+		// the balls stand somewhere new once they come to rest, so does the aim line
+		bool moving = g_scene.isMoving();
+		if (wasMoving && !moving)
+			updatePreview();
+		wasMoving = moving;
+
+		// matrices of whatever moved since the last frame, then one SetTransform per object
+		g_transforms.update(toSim(g_mWorld));
 
 		// draw plane, walls, and spheres
-		g_legoPlane.draw(Device, g_mWorld);
+		g_legoPlane.draw(Device);
 		for (i=0;i<4;i++) 	{
-			g_legowall[i].draw(Device, g_mWorld);
-			g_sphere[i].draw(Device, g_mWorld);
+			g_legowall[i].draw(Device);
+			g_sphere[i].draw(Device);
 		}
-		g_target_blueball.draw(Device, g_mWorld);
+		g_target_blueball.draw(Device);
         g_light.draw(Device);
+		if (!moving)
+			drawPreview();
 		
 		Device->EndScene();
 		Device->Present(0, 0, 0, 0);
@@ -527,16 +548,28 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
                         (wire ? D3DFILL_WIREFRAME : D3DFILL_SOLID));
                 }
                 break;
+            case 'E':
+                // toggle between the stepped and the event driven engine
+                g_scene.setEngine(g_scene.getEngine() == sim::ENGINE_EVENT ? sim::ENGINE_STEPPED : sim::ENGINE_EVENT);
+                break;
+            case 'S':
+                if (!g_scene.isMoving()) {
+                    sim::ShotResult shot = g_shotSearch.search(g_scene, sim::ShotSearchDesc());
+                    sim::Vec3 white = g_scene.getBall(3).getCenter();
+                    g_target_blueball.setCenter(white.x + shot.vx, (float)M_RADIUS, white.z + shot.vz);
+                    updatePreview();
+                }
+                break;
             case VK_SPACE:
-					D3DXVECTOR3 targetpos = g_target_blueball.getCenter();
-					D3DXVECTOR3	whitepos = g_sphere[3].getCenter();
+					sim::Vec3 targetpos = g_target_blueball.getCenter();
+					sim::Vec3	whitepos = g_sphere[3].getCenter();
 					double theta = acos(sqrt(pow(targetpos.x - whitepos.x, 2)) / sqrt(pow(targetpos.x - whitepos.x, 2) +
 						pow(targetpos.z - whitepos.z, 2)));		// ⺻ 1 и
 					if(targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x >= 0) { theta = -theta; }	//4 и
 					if(targetpos.z - whitepos.z >= 0 && targetpos.x - whitepos.x <= 0) { theta = PI - theta; } //2 и
 					if(targetpos.z - whitepos.z <= 0 && targetpos.x - whitepos.x <= 0){ theta = PI + theta; } // 3 и
 					double distance = sqrt(pow(targetpos.x - whitepos.x, 2) + pow(targetpos.z - whitepos.z, 2));
-					g_sphere[3].setPower(distance * cos(theta) , distance * sin(theta));
+					g_scene.shoot(3, (float)(distance * cos(theta)), (float)(distance * sin(theta)));
                 break;
             }
 			break;
@@ -582,8 +615,10 @@ LRESULT CALLBACK d3d::WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 					dx = (old_x - new_x);// * 0.01f;
 					dy = (old_y - new_y);// * 0.01f;
 		
-					D3DXVECTOR3 coord3d=g_target_blueball.getCenter();
+					sim::Vec3 coord3d=g_target_blueball.getCenter();
 					g_target_blueball.setCenter(coord3d.x+dx*(-0.007f),coord3d.y,coord3d.z+dy*0.007f );
+					if (!g_scene.isMoving())
+						updatePreview();
 				}
 				old_x = new_x;
 				old_y = new_y;
@@ -0,0 +1,468 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: bvh.cpp
+//
+// Desc: SAH bounding volume hierarchy over spheres, incremental refit and casts.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const float NO_DIRECTION = 1e30f;    // inverse of a zero direction component
+
+// plain compares, fminf and fmaxf may be library calls that handle NaN
+static inline float minf(float a, float b) { return a < b ? a : b; }
+static inline float maxf(float a, float b) { return a > b ? a : b; }
+
+static float coord(const sim::Vec3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// half the surface of the box around centers from lo to hi grown by radius, enough to compare
+static float halfArea(const float lo[3], const float hi[3], float radius)
+{
+	float ex = hi[0] - lo[0] + 2 * radius, ey = hi[1] - lo[1] + 2 * radius, ez = hi[2] - lo[2] + 2 * radius;
+	return ex * ey + ey * ez + ez * ex;
+}
+
+sim::CBvh::CBvh(void)
+{
+	m_radius = 0;
+	m_depth = 0;
+	m_next = 0;
+	m_groupSize = 0;
+}
+
+void sim::CBvh::clear(void)
+{
+	m_nodes.clear();
+	m_parent.clear();
+	m_items.clear();
+	m_leafOf.clear();
+	m_slotOf.clear();
+	m_centers.clear();
+	m_groupRoot.clear();
+	m_groupDepth.clear();
+	m_groupBase.clear();
+	m_depth = 0;
+	m_next = 0;
+	m_groupSize = 0;
+}
+
+void sim::CBvh::build(const Vec3* centers, int count, float radius)
+{
+	clear();
+	m_radius = radius;
+	m_centers.assign(centers, centers + count);
+	m_leafOf.assign(count, -1);
+	m_slotOf.assign(count, -1);
+	m_items.resize(count);
+	for (int i = 0; i < count; i++)
+		m_items[i] = i;
+
+	// leaves of at least one item make at most 2 * count - 1 nodes
+	m_nodes.resize(count > 0 ? 2 * count - 1 : 1);
+	m_parent.assign(m_nodes.size(), -1);
+	m_next = 1;
+	buildNode(0, 0, count, 1);
+	m_nodes.resize(m_next);
+	m_parent.resize(m_next);
+}
+
+void sim::CBvh::buildGroups(const Vec3* centers, int count, float radius, int groupSize)
+{
+	clear();
+	m_radius = radius;
+	m_centers.assign(centers, centers + count);
+	m_leafOf.assign(count, -1);
+	m_slotOf.assign(count, -1);
+	m_items.resize(count);
+	for (int i = 0; i < count; i++)
+		m_items[i] = i;
+	if (count == 0 || groupSize <= 0) {
+		m_nodes.resize(1);
+		m_parent.assign(1, -1);
+		m_nodes[0].start = 0;
+		m_nodes[0].count = 0;
+		fitLeaf(m_nodes[0]);
+		return;
+	}
+
+	// the top takes 2 * groups - 1 nodes, each group then twice its size for its subtree
+	int groups = (count + groupSize - 1) / groupSize;
+	m_groupSize = groupSize;
+	m_groupRoot.assign(groups, -1);
+	m_groupDepth.assign(groups, 0);
+	m_groupBase.assign(groups, 0);
+	int nodes = 2 * groups - 1;
+	for (int g = 0; g < groups; g++) {
+		m_groupBase[g] = nodes;
+		nodes += 2 * std::min(groupSize, count - g * groupSize);
+	}
+	m_nodes.resize(nodes);
+	m_parent.assign(nodes, -1);
+	for (int k = 0; k < nodes; k++) {
+		m_nodes[k].start = 0;
+		m_nodes[k].count = 0;
+		fitLeaf(m_nodes[k]);
+	}
+	m_next = 1;
+	buildTop(0, 0, groups, 1);
+	for (int g = 0; g < groups; g++)
+		rebuildGroup(g, centers + g * groupSize, std::min(groupSize, count - g * groupSize));
+}
+
+// groups halved by index, down to one group per node, which becomes the root of its subtree
+void sim::CBvh::buildTop(int node, int firstGroup, int groups, int depth)
+{
+	if (depth > m_depth)
+		m_depth = depth;
+	if (groups == 1) {
+		m_groupRoot[firstGroup] = node;
+		m_groupDepth[firstGroup] = depth;
+		return;
+	}
+	int child = m_next;
+	m_next += 2;
+	m_nodes[node].start = child;
+	m_nodes[node].count = -1;
+	m_parent[child] = node;
+	m_parent[child + 1] = node;
+	buildTop(child, firstGroup, groups / 2, depth + 1);
+	buildTop(child + 1, firstGroup + groups / 2, groups - groups / 2, depth + 1);
+}
+
+void sim::CBvh::rebuildGroup(int group, const Vec3* centers, int live)
+{
+	int first = group * m_groupSize;
+	int size = std::min(m_groupSize, (int)m_centers.size() - first);
+	live = std::max(0, std::min(live, size));
+	for (int i = 0; i < size; i++)
+		m_items[first + i] = first + i;
+	for (int i = 0; i < live; i++)
+		m_centers[first + i] = centers[i];
+
+	int root = m_groupRoot[group];
+	m_next = m_groupBase[group];
+	buildNode(root, first, live, m_groupDepth[group]);
+
+	// the removed items wait after the last leaf, the one whose items end where they start
+	int leaf = root;
+	while (m_nodes[leaf].count < 0)
+		leaf = m_nodes[leaf].start + 1;
+	for (int i = live; i < size; i++) {
+		m_leafOf[first + i] = leaf;
+		m_slotOf[first + i] = first + i;
+	}
+	refitUp(root);
+}
+
+void sim::CBvh::buildNode(int node, int first, int count, int depth)
+{
+	if (depth > m_depth)
+		m_depth = depth;
+
+	// the centers' bounds, the node box is them grown by the radius
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (int k = first; k < first + count; k++) {
+		const Vec3& c = m_centers[m_items[k]];
+		for (int a = 0; a < 3; a++) {
+			lo[a] = minf(lo[a], coord(c, a));
+			hi[a] = maxf(hi[a], coord(c, a));
+		}
+	}
+	Node& n = m_nodes[node];
+	for (int a = 0; a < 3; a++) {
+		n.min[a] = lo[a] - m_radius;
+		n.max[a] = hi[a] + m_radius;
+	}
+	n.start = first;
+	n.count = count;
+
+	// a ray that reaches a node pays one box test per child and one sphere test per item
+	// below, so a split is worth it when the children's area weighted counts come to less
+	float bestCost = FLT_MAX;
+	int bestAxis = -1, bestSplit = 0;
+	if (count > BVH_LEAF_SIZE && depth < BVH_MAX_DEPTH - 1) {
+		for (int a = 0; a < 3; a++) {
+			float extent = hi[a] - lo[a];
+			if (!(extent > 0))
+				continue;
+			float scale = BVH_BINS * 0.9999f / extent;
+			int   binCount[BVH_BINS] = { 0 };
+			float binLo[BVH_BINS][3], binHi[BVH_BINS][3];
+			for (int b = 0; b < BVH_BINS; b++)
+				for (int c = 0; c < 3; c++) {
+					binLo[b][c] = FLT_MAX;
+					binHi[b][c] = -FLT_MAX;
+				}
+			for (int k = first; k < first + count; k++) {
+				const Vec3& p = m_centers[m_items[k]];
+				int b = (int)((coord(p, a) - lo[a]) * scale);
+				binCount[b]++;
+				for (int c = 0; c < 3; c++) {
+					binLo[b][c] = minf(binLo[b][c], coord(p, c));
+					binHi[b][c] = maxf(binHi[b][c], coord(p, c));
+				}
+			}
+
+			// right to left sums, then left to right against them
+			float rightArea[BVH_BINS];
+			int   rightCount[BVH_BINS];
+			float accLo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, accHi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			int   acc = 0;
+			for (int b = BVH_BINS - 1; b > 0; b--) {
+				for (int c = 0; c < 3; c++) {
+					accLo[c] = minf(accLo[c], binLo[b][c]);
+					accHi[c] = maxf(accHi[c], binHi[b][c]);
+				}
+				acc += binCount[b];
+				rightCount[b] = acc;
+				rightArea[b] = acc ? halfArea(accLo, accHi, m_radius) : 0;
+			}
+			for (int c = 0; c < 3; c++) {
+				accLo[c] = FLT_MAX;
+				accHi[c] = -FLT_MAX;
+			}
+			acc = 0;
+			for (int b = 1; b < BVH_BINS; b++) {
+				for (int c = 0; c < 3; c++) {
+					accLo[c] = minf(accLo[c], binLo[b - 1][c]);
+					accHi[c] = maxf(accHi[c], binHi[b - 1][c]);
+				}
+				acc += binCount[b - 1];
+				if (acc == 0 || rightCount[b] == 0)
+					continue;
+				float cost = halfArea(accLo, accHi, m_radius) * acc + rightArea[b] * rightCount[b];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = a;
+					bestSplit = b;
+				}
+			}
+		}
+	}
+
+	float leafCost = halfArea(lo, hi, m_radius) * count;
+	bool split = bestAxis >= 0 ? bestCost < leafCost || count > 4 * BVH_LEAF_SIZE :
+		count > BVH_LEAF_SIZE && depth < BVH_MAX_DEPTH - 1;
+	if (!split) {
+		for (int k = first; k < first + count; k++) {
+			m_leafOf[m_items[k]] = node;
+			m_slotOf[m_items[k]] = k;
+		}
+		return;
+	}
+
+	// spheres all on one center give no axis to split along, halving them still keeps the
+	// leaves small and a remove short
+	int leftCount = count / 2;
+	if (bestAxis >= 0) {
+		float scale = BVH_BINS * 0.9999f / (hi[bestAxis] - lo[bestAxis]);
+		float axisLo = lo[bestAxis];
+		const std::vector<Vec3>& centers = m_centers;
+		int* middle = std::partition(&m_items[0] + first, &m_items[0] + first + count, [&](int item) {
+			return (int)((coord(centers[item], bestAxis) - axisLo) * scale) < bestSplit;
+		});
+		leftCount = (int)(middle - &m_items[0]) - first;
+	}
+
+	int child = m_next;
+	m_next += 2;
+	m_nodes[node].start = child;
+	m_nodes[node].count = -1;
+	m_parent[child] = node;
+	m_parent[child + 1] = node;
+	buildNode(child, first, leftCount, depth + 1);
+	buildNode(child + 1, first + leftCount, count - leftCount, depth + 1);
+}
+
+void sim::CBvh::fitLeaf(Node& node)
+{
+	for (int a = 0; a < 3; a++) {
+		node.min[a] = FLT_MAX;
+		node.max[a] = -FLT_MAX;
+	}
+	for (int k = node.start; k < node.start + node.count; k++) {
+		const Vec3& c = m_centers[m_items[k]];
+		for (int a = 0; a < 3; a++) {
+			node.min[a] = minf(node.min[a], coord(c, a) - m_radius);
+			node.max[a] = maxf(node.max[a], coord(c, a) + m_radius);
+		}
+	}
+}
+
+// the parents of a leaf whose box changed, up to the first one that stays the same
+void sim::CBvh::refitUp(int node)
+{
+	for (int p = m_parent[node]; p >= 0; p = m_parent[p]) {
+		Node& n = m_nodes[p];
+		const Node& l = m_nodes[n.start];
+		const Node& r = m_nodes[n.start + 1];
+		bool same = true;
+		for (int a = 0; a < 3; a++) {
+			float lo = minf(l.min[a], r.min[a]), hi = maxf(l.max[a], r.max[a]);
+			same = same && lo == n.min[a] && hi == n.max[a];
+			n.min[a] = lo;
+			n.max[a] = hi;
+		}
+		if (same)
+			return;
+	}
+}
+
+bool sim::CBvh::contains(int item) const
+{
+	const Node& n = m_nodes[m_leafOf[item]];
+	return m_slotOf[item] < n.start + n.count;
+}
+
+// a leaf keeps its removed items after the ones it holds, so one can be swapped back in
+void sim::CBvh::remove(int item)
+{
+	if (!contains(item))
+		return;
+	int leaf = m_leafOf[item];
+	Node& n = m_nodes[leaf];
+	int k = m_slotOf[item], last = n.start + n.count - 1;
+	m_items[k] = m_items[last];
+	m_slotOf[m_items[k]] = k;
+	m_items[last] = item;
+	m_slotOf[item] = last;
+	n.count--;
+	fitLeaf(n);
+	refitUp(leaf);
+}
+
+void sim::CBvh::insert(int item, const Vec3& center)
+{
+	m_centers[item] = center;
+	int leaf = m_leafOf[item];
+	Node& n = m_nodes[leaf];
+	if (!contains(item)) {
+		int k = m_slotOf[item], first = n.start + n.count;
+		m_items[k] = m_items[first];
+		m_slotOf[m_items[k]] = k;
+		m_items[first] = item;
+		m_slotOf[item] = first;
+		n.count++;
+	}
+	fitLeaf(n);
+	refitUp(leaf);
+}
+
+void sim::CBvh::move(int item, const Vec3& center)
+{
+	m_centers[item] = center;
+	if (!contains(item))
+		return;
+	int leaf = m_leafOf[item];
+	fitLeaf(m_nodes[leaf]);
+	refitUp(leaf);
+}
+
+sim::RayHit sim::CBvh::cast(const Ray& ray, float radius, float maxT, int ignore) const
+{
+	RayHit hit;
+	hit.t = maxT;
+	hit.normal = vec3(0, 0, 0);
+	hit.item = -1;
+	if (m_nodes.empty() || m_centers.empty())
+		return hit;
+
+	const Vec3& o = ray.origin;
+	const Vec3& d = ray.direction;
+	float inv[3] = {
+		d.x != 0 ? 1 / d.x : NO_DIRECTION,
+		d.y != 0 ? 1 / d.y : NO_DIRECTION,
+		d.z != 0 ? 1 / d.z : NO_DIRECTION };
+	float org[3] = { o.x, o.y, o.z };
+	float a = dot(d, d);
+	float reach = m_radius + radius;
+	if (!(a > 0))
+		return hit;
+
+	// entry time into a node box grown by the cast radius, FLT_MAX when it is missed or
+	// entered later than the best hit so far
+	auto enter = [&](const Node& n) {
+		if (n.min[0] > n.max[0])
+			return FLT_MAX;   // emptied
+		float t0 = 0, t1 = hit.t;
+		for (int k = 0; k < 3; k++) {
+			float ta = (n.min[k] - radius - org[k]) * inv[k];
+			float tb = (n.max[k] + radius - org[k]) * inv[k];
+			t0 = maxf(t0, minf(ta, tb));
+			t1 = minf(t1, maxf(ta, tb));
+		}
+		return t0 <= t1 ? t0 : FLT_MAX;
+	};
+
+	int stack[BVH_MAX_DEPTH];
+	int top = 0;
+	if (enter(m_nodes[0]) == FLT_MAX)
+		return hit;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& n = m_nodes[stack[--top]];
+		if (n.count >= 0) {
+			for (int k = n.start; k < n.start + n.count; k++) {
+				int item = m_items[k];
+				if (item == ignore)
+					continue;
+				Vec3 oc = o - m_centers[item];
+				float b = dot(oc, d);
+				float c = dot(oc, oc) - reach * reach;
+				float t;
+				if (c < 0) {
+					if (b >= 0)
+						continue;   // inside and on the way out
+					t = 0;
+				}
+				else {
+					float disc = b * b - a * c;
+					if (disc < 0 || b >= 0)
+						continue;
+					t = (-b - sqrtf(disc)) / a;
+				}
+				if (t < hit.t) {
+					hit.t = t;
+					hit.item = item;
+				}
+			}
+			continue;
+		}
+
+		// the nearer child is searched first, the farther one may be cut off by its hit
+		int near = n.start, far = n.start + 1;
+		float tNear = enter(m_nodes[near]), tFar = enter(m_nodes[far]);
+		if (tFar < tNear) {
+			std::swap(near, far);
+			std::swap(tNear, tFar);
+		}
+		if (tFar != FLT_MAX)
+			stack[top++] = far;
+		if (tNear != FLT_MAX)
+			stack[top++] = near;
+	}
+
+	if (hit.item >= 0)
+		hit.normal = normalize(o + d * hit.t - m_centers[hit.item]);
+	return hit;
+}
+
+void sim::CBvh::castRays(const Ray* rays, int count, float maxT, RayHit* hits) const
+{
+	for (int i = 0; i < count; i++)
+		hits[i] = cast(rays[i], 0, maxT);
+}
+
+void sim::CBvh::castSpheres(const Ray* rays, int count, float radius, float maxT, RayHit* hits,
+	const int* ignore) const
+{
+	for (int i = 0; i < count; i++)
+		hits[i] = cast(rays[i], radius, maxT, ignore ? ignore[i] : -1);
+}
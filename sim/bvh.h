@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: bvh.h
+//
+// Desc: Bounding volume hierarchy over spheres (bricks and balls), for ray and sphere casts
+//       that need the first thing hit: aim lines, and lookahead that casts hundreds of rays a
+//       frame against a level of a hundred thousand bricks.
+//
+//       The tree is built top down, each node split where the surface area heuristic says a
+//       ray pays least, estimated over BVH_BINS buckets of the centers along each axis, or
+//       halved where the centers coincide. Leaves hold up to BVH_LEAF_SIZE spheres. A removed
+//       or moved sphere only refits the boxes on the way from its leaf to the root, and stops
+//       as soon as a box does not change, so knocking out bricks costs a few nodes each instead
+//       of a rebuild. A streamed level keeps a subtree per slot, built again when its chunk
+//       loads, so bricks that arrive later still get leaves as tight as a full build's.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __bvhH__
+#define __bvhH__
+
+#include "simMath.h"
+#include <vector>
+
+namespace sim
+{
+	const int BVH_LEAF_SIZE = 4;
+	const int BVH_BINS      = 12;
+	const int BVH_MAX_DEPTH = 64;     // deeper subtrees become one leaf, casts keep a fixed stack
+
+	// the same layout as d3d::Ray, so a ray made for picking can be cast as it is.
+	// direction need not be of unit length, times are in lengths of it
+	struct Ray
+	{
+		Vec3 origin;
+		Vec3 direction;
+	};
+
+	struct RayHit
+	{
+		float t;          // origin + t * direction is the center of the cast sphere at contact
+		Vec3  normal;     // unit, from the sphere hit toward the contact
+		int   item;       // -1 when nothing is hit before maxT
+	};
+
+	// -----------------------------------------------------------------------------
+	// CBvh
+	// -----------------------------------------------------------------------------
+
+	class CBvh {
+	public:
+		CBvh(void);
+
+		// item i is the sphere of the given radius around centers[i]
+		void build(const Vec3* centers, int count, float radius);
+
+		// items in groups of groupSize, the last one may be short, each group under a subtree
+		// of its own below a top that halves the groups by index. rebuildGroup builds one
+		// subtree again with the surface area heuristic, its first live items at centers and
+		// the rest removed, so a streamed slot gets tight leaves for a few hundred items
+		void buildGroups(const Vec3* centers, int count, float radius, int groupSize);
+		void rebuildGroup(int group, const Vec3* centers, int live);
+		void clear(void);
+
+		// an item removed is not hit until it is inserted again, a moved one is hit where it is
+		// now. an item goes back into the leaf it was built in, so one inserted far from where
+		// it was built grows the boxes above it, many of them want rebuildGroup instead
+		void remove(int item);
+		void insert(int item, const Vec3& center);
+		void move(int item, const Vec3& center);
+		bool contains(int item) const;
+
+		// first item a ray hits, and the first a sphere of radius moved along it touches. a cast
+		// starting inside an item hits it at t = 0 only when it moves further in, so a ball in
+		// contact can look past what it touches. ignore is an item left out, -1 for none
+		RayHit cast(const Ray& ray, float radius, float maxT, int ignore = -1) const;
+		void castRays(const Ray* rays, int count, float maxT, RayHit* hits) const;
+		void castSpheres(const Ray* rays, int count, float radius, float maxT, RayHit* hits,
+			const int* ignore = 0) const;
+
+		const Vec3& getCenter(int item) const { return m_centers[item]; }
+		int  getItemCount(void) const { return (int)m_centers.size(); }
+		int  getNodeCount(void) const { return (int)m_nodes.size(); }
+		int  getDepth(void) const { return m_depth; }
+
+	private:
+		// a leaf holds m_items[start, start + count), and its removed items right after. an inner
+		// node has count -1 and its children at start and start + 1. an emptied leaf keeps a box
+		// with min > max, which no ray meets
+		struct Node
+		{
+			float min[3];
+			int   start;
+			float max[3];
+			int   count;
+		};
+
+		void buildNode(int node, int first, int count, int depth);
+		void buildTop(int node, int firstGroup, int groups, int depth);
+		void fitLeaf(Node& node);
+		void refitUp(int node);
+
+		std::vector<Node>	m_nodes;
+		std::vector<int>	m_parent;    // of each node, -1 for the root
+		std::vector<int>	m_items;     // leaf by leaf
+		std::vector<int>	m_leafOf;    // node each item was built in, kept once it is removed
+		std::vector<int>	m_slotOf;    // index of each item in m_items, so a remove goes straight to it
+		std::vector<Vec3>	m_centers;
+		std::vector<int>	m_groupRoot;   // node each group's subtree hangs from
+		std::vector<int>	m_groupDepth;
+		std::vector<int>	m_groupBase;   // first of the nodes kept for each group's subtree
+		float				m_radius;
+		int					m_depth;
+		int					m_next;        // next free node while building
+		int					m_groupSize;   // 0 when built without groups
+	};
+}
+
+#endif // __bvhH__
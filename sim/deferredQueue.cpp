@@ -0,0 +1,115 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: deferredQueue.cpp
+//
+// Desc: Deferred release queue.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "deferredQueue.h"
+
+sim::CDeferredQueue::CDeferredQueue(void)
+	: m_head(0), m_quit(false), m_released(0)
+{
+}
+
+sim::CDeferredQueue::~CDeferredQueue(void)
+{
+	stopWorker();
+	drain();
+}
+
+void sim::CDeferredQueue::push(ReleaseFn release, void* object)
+{
+	Item item = { release, object };
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_items.push_back(item);
+	}
+	m_wake.notify_one();
+}
+
+int sim::CDeferredQueue::drain(int maxItems)
+{
+	return drainInto(m_batch, maxItems);
+}
+
+int sim::CDeferredQueue::drainFor(double seconds)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int ran = 0;
+	for (;;) {
+		int batch = drainInto(m_batch, DEFERRED_DRAIN_BATCH);
+		ran += batch;
+		if (batch < DEFERRED_DRAIN_BATCH)
+			return ran;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		if (elapsed.count() >= seconds)
+			return ran;
+	}
+}
+
+int sim::CDeferredQueue::drainInto(std::vector<Item>& batch, int maxItems)
+{
+	// take a batch under the lock, run it outside so push never waits on a release
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		size_t left = m_items.size() - m_head;
+		size_t take = maxItems < 0 || (size_t)maxItems > left ? left : (size_t)maxItems;
+		batch.assign(m_items.begin() + m_head, m_items.begin() + m_head + take);
+		m_head += take;
+		if (m_head == m_items.size()) {
+			m_items.clear();
+			m_head = 0;
+		}
+		else if (m_head * 2 > m_items.size()) {
+			// partial drains under steady pushes, keep the vector from only growing
+			m_items.erase(m_items.begin(), m_items.begin() + m_head);
+			m_head = 0;
+		}
+	}
+	for (size_t i = 0; i < batch.size(); i++)
+		batch[i].release(batch[i].object);
+	m_released += (long)batch.size();
+	return (int)batch.size();
+}
+
+void sim::CDeferredQueue::startWorker(void)
+{
+	if (m_worker.joinable())
+		return;
+	m_quit = false;
+	m_worker = std::thread(&CDeferredQueue::workerMain, this);
+}
+
+void sim::CDeferredQueue::stopWorker(void)
+{
+	if (!m_worker.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_quit = true;
+	}
+	m_wake.notify_one();
+	m_worker.join();
+}
+
+int sim::CDeferredQueue::getPending(void) const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return (int)(m_items.size() - m_head);
+}
+
+void sim::CDeferredQueue::workerMain(void)
+{
+	std::vector<Item> batch;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_wake.wait(lock, [this] { return m_quit || m_items.size() > m_head; });
+			if (m_items.size() == m_head && m_quit)
+				return;
+		}
+		drainInto(batch, -1);
+	}
+}
@@ -0,0 +1,76 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: deferredQueue.h
+//
+// Desc: Resources that are no longer used but should not be freed in the middle of a frame.
+//       push() only records the object and its release function. The releases run later:
+//       a few per frame through drain() on a thread of the caller's choosing (the render
+//       thread for device objects), or on a background worker as soon as they are queued.
+//       Either way a frame that knocks out a hundred bricks costs a hundred pushes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __deferredQueueH__
+#define __deferredQueueH__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim
+{
+	const int DEFERRED_DRAIN_BATCH = 16;   // releases drainFor runs between looks at the clock
+
+	class CDeferredQueue {
+	public:
+		typedef void (*ReleaseFn)(void* object);
+
+		CDeferredQueue(void);
+		~CDeferredQueue(void);   // stops the worker and releases whatever is left
+
+		void push(ReleaseFn release, void* object);
+
+		// runs up to maxItems releases on the calling thread, all of them for -1.
+		// returns how many ran. one thread at a time besides the worker
+		int  drain(int maxItems = -1);
+
+		// runs releases on the calling thread in batches until seconds have gone by or the queue
+		// is empty, so a backlog is worked off as fast as the budget allows. at least one batch
+		int  drainFor(double seconds);
+
+		// a thread that drains the queue whenever something is pushed. only for objects that
+		// may be released from any thread
+		void startWorker(void);
+		void stopWorker(void);
+
+		int  getPending(void) const;
+		long getReleased(void) const { return m_released.load(); }
+
+	private:
+		struct Item
+		{
+			ReleaseFn	release;
+			void*		object;
+		};
+
+		CDeferredQueue(const CDeferredQueue&);
+		CDeferredQueue& operator=(const CDeferredQueue&);
+
+		void workerMain(void);
+		int  drainInto(std::vector<Item>& batch, int maxItems);
+
+		mutable std::mutex		m_lock;
+		std::condition_variable	m_wake;
+		std::vector<Item>		m_items;
+		std::vector<Item>		m_batch;     // what drain() took out of m_items, run without the lock
+		size_t					m_head;      // m_items before this index were already run
+		std::thread				m_worker;
+		bool					m_quit;
+		std::atomic<long>		m_released;
+	};
+}
+
+#endif // __deferredQueueH__
@@ -0,0 +1,243 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: entityStore.cpp
+//
+// Desc: Hot / cold ball storage and the shared material table.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "entityStore.h"
+#include "simdSupport.h"
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+sim::Material sim::makeMaterial(float r, float g, float b, float a, float power)
+{
+	Material m;
+	float colour[4] = { r, g, b, a };
+	memcpy(m.diffuse, colour, sizeof(colour));
+	memcpy(m.ambient, colour, sizeof(colour));
+	memcpy(m.specular, colour, sizeof(colour));
+	memset(m.emissive, 0, sizeof(m.emissive));
+	m.emissive[3] = 1;
+	m.power = power;
+	return m;
+}
+
+int sim::CMaterialTable::add(const Material& material)
+{
+	// a handful of entries, a linear search beats hashing them
+	for (int i = 0; i < (int)m_materials.size(); i++)
+		if (memcmp(&m_materials[i], &material, sizeof(Material)) == 0)
+			return i;
+	m_materials.push_back(material);
+	return (int)m_materials.size() - 1;
+}
+
+// -----------------------------------------------------------------------------
+// Morton order
+// -----------------------------------------------------------------------------
+
+// the low 16 bits of v spread to the even bits
+static uint32_t spreadBits(uint32_t v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+uint32_t sim::mortonCode(float u, float v)
+{
+	u = u < 0 ? 0 : (u > 1 ? 1 : u);
+	v = v < 0 ? 0 : (v > 1 ? 1 : v);
+	return spreadBits((uint32_t)(u * 65535.0f)) | (spreadBits((uint32_t)(v * 65535.0f)) << 1);
+}
+
+// v[k] = v[order k], the order in the low half of keys
+template <typename T>
+static void gather(std::vector<T>& v, const std::vector<uint64_t>& keys, std::vector<T>& scratch)
+{
+	scratch.resize(v.size());
+	for (size_t k = 0; k < keys.size(); k++)
+		scratch[k] = v[(uint32_t)keys[k]];
+	v.swap(scratch);
+}
+
+// -----------------------------------------------------------------------------
+// CEntityStore
+// -----------------------------------------------------------------------------
+
+sim::CEntityStore::CEntityStore(void)
+{
+	m_sortInterval = MORTON_SORT_INTERVAL;
+	m_stepsSinceSort = 0;
+}
+
+int sim::CEntityStore::add(float x, float z, int material, int mesh)
+{
+	int i = (int)m_x.size();
+	m_x.push_back(x);
+	m_z.push_back(z);
+	m_vx.push_back(0);
+	m_vz.push_back(0);
+	if ((int)m_alive.size() * 64 <= i)
+		m_alive.push_back(0);
+	m_alive[i >> 6] |= (uint64_t)1 << (i & 63);
+	m_material.push_back((uint16_t)material);
+	m_mesh.push_back((uint16_t)mesh);
+	m_handle.push_back((int)m_index.size());
+	m_index.push_back(i);
+	return m_handle[i];
+}
+
+void sim::CEntityStore::clear(void)
+{
+	m_x.clear();
+	m_z.clear();
+	m_vx.clear();
+	m_vz.clear();
+	m_alive.clear();
+	m_material.clear();
+	m_mesh.clear();
+	m_materials.clear();
+	m_handle.clear();
+	m_index.clear();
+	m_stepsSinceSort = 0;
+}
+
+void sim::CEntityStore::reserve(int count)
+{
+	m_x.reserve(count);
+	m_z.reserve(count);
+	m_vx.reserve(count);
+	m_vz.reserve(count);
+	m_alive.reserve((count + 63) / 64);
+	m_material.reserve(count);
+	m_mesh.reserve(count);
+	m_handle.reserve(count);
+	m_index.reserve(count);
+}
+
+void sim::CEntityStore::kill(int i)
+{
+	m_alive[i >> 6] &= ~((uint64_t)1 << (i & 63));
+	m_vx[i] = m_vz[i] = 0;
+}
+
+int sim::CEntityStore::getAliveCount(void) const
+{
+	int count = 0;
+	for (int w = 0; w < (int)m_alive.size(); w++)
+		count += popCount64(m_alive[w]);
+	return count;
+}
+
+void sim::CEntityStore::integrate(float timeDiff, const TableDesc& table)
+{
+	// dead balls have no velocity, so one dense loop without looking at the alive bits is
+	// enough, and it leaves the compiler free to vectorize it
+	float scale = table.timeScale * timeDiff;
+	float rate = table.friction ? (float)exp(-FRICTION * timeDiff) : 1.0f;
+	float minX = table.minX + BALL_RADIUS, maxX = table.maxX - BALL_RADIUS;
+	float minZ = table.minZ + BALL_RADIUS, maxZ = table.maxZ - BALL_RADIUS;
+	int count = getCount();
+	float* x = count ? &m_x[0] : 0;
+	float* z = count ? &m_z[0] : 0;
+	float* vx = count ? &m_vx[0] : 0;
+	float* vz = count ? &m_vz[0] : 0;
+	for (int i = 0; i < count; i++) {
+		float moving = (fabsf(vx[i]) > STOP_SPEED || fabsf(vz[i]) > STOP_SPEED) ? 1.0f : 0.0f;
+		float ux = vx[i] * moving, uz = vz[i] * moving;
+		float px = x[i] + scale * ux;
+		float pz = z[i] + scale * uz;
+		float fx = (px < minX || px > maxX) ? -rate : rate;
+		float fz = (pz < minZ || pz > maxZ) ? -rate : rate;
+		x[i] = px < minX ? minX : (px > maxX ? maxX : px);
+		z[i] = pz < minZ ? minZ : (pz > maxZ ? maxZ : pz);
+		vx[i] = ux * fx;
+		vz[i] = uz * fz;
+	}
+}
+
+int sim::CEntityStore::collide(void)
+{
+	int count = getCount();
+	if (count == 0)
+		return 0;
+	const float contact = 2 * BALL_RADIUS;
+	m_grid.build(m_x, m_z, contact);
+
+	// each pair is handled from its lower index. after a sort the query cells of ball i are
+	// mostly the ones of ball i - 1, and the neighbours found sit a few indices away
+	int pairs = 0;
+	for (int i = 0; i < count; i++) {
+		if (!isAlive(i))
+			continue;
+		m_grid.queryOverlap(m_x[i], m_z[i], contact, m_candidates);
+		for (int k = 0; k < (int)m_candidates.size(); k++) {
+			int j = m_candidates[k];
+			if (j <= i || !isAlive(j))
+				continue;
+			float dx = m_x[j] - m_x[i], dz = m_z[j] - m_z[i];
+			float dist2 = dx * dx + dz * dz;
+			if (dist2 >= contact * contact)
+				continue;
+			pairs++;
+
+			// CBall::hitBy
+			float dist = sqrtf(dist2);
+			float nx = 1.0f, nz = 0.0f;
+			if (dist > 0) { nx = dx / dist; nz = dz / dist; }
+			float push = 0.5f * (contact - dist);
+			m_x[i] -= nx * push;	m_z[i] -= nz * push;
+			m_x[j] += nx * push;	m_z[j] += nz * push;
+			float approach = (m_vx[i] - m_vx[j]) * nx + (m_vz[i] - m_vz[j]) * nz;
+			if (approach <= 0)
+				continue;
+			m_vx[i] -= approach * nx;	m_vz[i] -= approach * nz;
+			m_vx[j] += approach * nx;	m_vz[j] += approach * nz;
+		}
+	}
+	return pairs;
+}
+
+int sim::CEntityStore::step(float timeDiff, const TableDesc& table)
+{
+	if (m_sortInterval > 0 && m_stepsSinceSort++ % m_sortInterval == 0)
+		sortMorton(table);
+	integrate(timeDiff, table);
+	return collide();
+}
+
+void sim::CEntityStore::sortMorton(const TableDesc& table)
+{
+	int count = getCount();
+	float scaleX = 1.0f / (table.maxX - table.minX), scaleZ = 1.0f / (table.maxZ - table.minZ);
+	m_keys.resize(count);
+	for (int i = 0; i < count; i++)
+		m_keys[i] = (uint64_t)mortonCode((m_x[i] - table.minX) * scaleX, (m_z[i] - table.minZ) * scaleZ) << 32 | (uint32_t)i;
+	std::sort(m_keys.begin(), m_keys.end());
+
+	gather(m_x, m_keys, m_scratch);
+	gather(m_z, m_keys, m_scratch);
+	gather(m_vx, m_keys, m_scratch);
+	gather(m_vz, m_keys, m_scratch);
+	gather(m_material, m_keys, m_scratchShort);
+	gather(m_mesh, m_keys, m_scratchShort);
+	gather(m_handle, m_keys, m_scratchInt);
+
+	// the alive bits by the old index, set again at the new one
+	m_scratchInt.resize(count);
+	for (int k = 0; k < count; k++)
+		m_scratchInt[k] = isAlive((uint32_t)m_keys[k]);
+	for (int w = 0; w < (int)m_alive.size(); w++)
+		m_alive[w] = 0;
+	for (int k = 0; k < count; k++) {
+		m_alive[k >> 6] |= (uint64_t)m_scratchInt[k] << (k & 63);
+		m_index[m_handle[k]] = k;
+	}
+}
@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: entityStore.h
+//
+// Desc: Ball entities split by how often they are touched. The physics pass reads only the hot
+//       arrays: x, z, vx, vz and one alive bit per ball, 16 bytes and a bit. What drawing needs
+//       (material, mesh) is kept in a cold table of two 16 bit indices per ball, and materials
+//       are stored once in a table that merges equal entries, since a level of bricks uses one
+//       or two colours.
+//
+//       Balls are kept in Z-order (Morton order) of their centers, re-sorted every few steps, so
+//       balls close on the table are close in memory and the contact pass finds a neighbour's
+//       data in a cache line it touched a moment ago. Sorting moves balls to other indices;
+//       add() hands out a handle instead, which getIndex() turns into the current index.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __entityStoreH__
+#define __entityStoreH__
+
+#include "simCore.h"
+#include "uniformGrid.h"
+#include <vector>
+#include <stdint.h>
+
+namespace sim
+{
+	// -----------------------------------------------------------------------------
+	// Material - same layout as D3DMATERIAL9 (diffuse, ambient, specular, emissive rgba, power)
+	// -----------------------------------------------------------------------------
+
+	struct Material
+	{
+		float diffuse[4];
+		float ambient[4];
+		float specular[4];
+		float emissive[4];
+		float power;
+	};
+
+	// the games' usual material: one colour for diffuse, ambient and specular, no emission
+	Material makeMaterial(float r, float g, float b, float a, float power);
+
+	class CMaterialTable {
+	public:
+		// index of an equal material when there is one, a new entry otherwise
+		int  add(const Material& material);
+		void clear(void) { m_materials.clear(); }
+
+		const Material& get(int index) const { return m_materials[index]; }
+		int  getCount(void) const { return (int)m_materials.size(); }
+
+	private:
+		std::vector<Material> m_materials;
+	};
+
+	// -----------------------------------------------------------------------------
+	// CEntityStore
+	// -----------------------------------------------------------------------------
+
+	const int MORTON_SORT_INTERVAL = 32;   // steps between re-sorts, balls drift a little per step
+
+	// 16 bits of x and of z interleaved, x in the even bits. u and v are in [0, 1]
+	uint32_t mortonCode(float u, float v);
+
+	class CEntityStore {
+	public:
+		CEntityStore(void);
+
+		// returns the handle of the ball, which stays the same while sorting moves it around.
+		// everything else takes the current index
+		int  add(float x, float z, int material, int mesh = 0);
+		void clear(void);
+		void reserve(int count);
+
+		// a dead ball stops where it is and is skipped by draws and queries
+		void kill(int i);
+		bool isAlive(int i) const { return (m_alive[i >> 6] >> (i & 63)) & 1; }
+		int  getAliveCount(void) const;
+
+		void setPower(int i, float vx, float vz) { m_vx[i] = vx; m_vz[i] = vz; }
+		void setCenter(int i, float x, float z) { m_x[i] = x; m_z[i] = z; }
+		Vec3 getCenter(int i) const { Vec3 c = { m_x[i], BALL_RADIUS, m_z[i] }; return c; }
+
+		int  getIndex(int handle) const { return m_index[handle]; }
+		int  getHandle(int i) const { return m_handle[i]; }
+
+		// CBall::ballUpdate plus the cushions for every ball, as one pass over the hot arrays
+		void integrate(float timeDiff, const TableDesc& table);
+
+		// CBall::hitBy for every pair of alive balls that touch, found through a grid over the
+		// centers. returns the number of touching pairs
+		int  collide(void);
+
+		// integrate and collide, re-sorting first every getSortInterval() steps. 0 never sorts.
+		// returns the touching pairs
+		int  step(float timeDiff, const TableDesc& table);
+		void setSortInterval(int steps) { m_sortInterval = steps; }
+		int  getSortInterval(void) const { return m_sortInterval; }
+
+		// reorders every array by the Morton code of the center on the table, handles follow
+		void sortMorton(const TableDesc& table);
+
+		int  getMaterial(int i) const { return m_material[i]; }
+		int  getMesh(int i) const { return m_mesh[i]; }
+		CMaterialTable&       getMaterials(void) { return m_materials; }
+		const CMaterialTable& getMaterials(void) const { return m_materials; }
+
+		int  getCount(void) const { return (int)m_x.size(); }
+
+		// bytes per ball the physics pass streams through, and in total with the cold table
+		static double getHotBytesPerEntity(void) { return 4 * sizeof(float) + 1.0 / 8; }
+		static double getBytesPerEntity(void) { return getHotBytesPerEntity() + 2 * sizeof(uint16_t); }
+
+		const float* getX(void) const { return m_x.empty() ? 0 : &m_x[0]; }
+		const float* getZ(void) const { return m_z.empty() ? 0 : &m_z[0]; }
+
+	private:
+		// hot
+		std::vector<float>		m_x, m_z;
+		std::vector<float>		m_vx, m_vz;
+		std::vector<uint64_t>	m_alive;
+
+		// cold
+		std::vector<uint16_t>	m_material;
+		std::vector<uint16_t>	m_mesh;
+		CMaterialTable			m_materials;
+		std::vector<int>		m_handle;    // of the ball at each index
+		std::vector<int>		m_index;     // of the ball with each handle
+
+		int						m_sortInterval;
+		int						m_stepsSinceSort;
+		CUniformGrid			m_grid;
+		std::vector<int>		m_candidates;
+		std::vector<uint64_t>	m_keys;      // scratch of sortMorton, code above index
+		std::vector<float>		m_scratch;
+		std::vector<int>		m_scratchInt;
+		std::vector<uint16_t>	m_scratchShort;
+	};
+}
+
+#endif // __entityStoreH__
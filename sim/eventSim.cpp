@@ -0,0 +1,452 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: eventSim.cpp
+//
+// Desc: Event driven billiard engine.
+//
+//       A ball that moves with velocity v at time t0 is at  p + s * v * u(t - t0)  at time t,
+//       with s the table time scale and u(tau) = (1 - exp(-k * tau)) / k the distance a unit
+//       velocity covers under friction k. Contact conditions are polynomials in u, solved
+//       exactly and turned back into a time.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "eventSim.h"
+#include "trajectory.h"
+#include "uniformGrid.h"
+#include <cmath>
+
+static const double NEVER = sim::NEVER_STOPS;
+static const long   MAX_EVENTS_PER_ADVANCE = 1000000;
+static const double CELL_DIAMETERS = 1;     // cell width in ball diameters, before the cell count cap
+static const size_t CELL_MIN_BALLS = 16;    // up to this many balls share one cell
+
+sim::CEventBilliard::CEventBilliard(void)
+{
+	m_time = 0;
+	m_seq = 0;
+	m_events = 0;
+	m_stale = 0;
+	m_crossings = 0;
+	m_minX = m_minZ = 0;
+	m_cellSize = 1;
+	m_cols = m_rows = 0;
+	setTable(BILLIARD_TABLE);
+}
+
+void sim::CEventBilliard::setTable(const TableDesc& table)
+{
+	m_table = table;
+	m_friction = table.friction ? FRICTION : 0;
+}
+
+double sim::CEventBilliard::travel(double tau) const
+{
+	return exponentialTravel(m_friction, tau);
+}
+
+double sim::CEventBilliard::timeForTravel(double u) const
+{
+	return exponentialTimeForTravel(m_friction, u);
+}
+
+void sim::CEventBilliard::rebase(int i, double t)
+{
+	Ball& b = m_balls[i];
+	double end = t < b.tStop ? t : b.tStop;
+	double u = travel(end - b.t0);
+	b.x += m_table.timeScale * b.vx * u;
+	b.z += m_table.timeScale * b.vz * u;
+	if (t < b.tStop) {
+		double decay = exp(-m_friction * (t - b.t0));
+		b.vx *= decay;
+		b.vz *= decay;
+	}
+	else {
+		b.vx = b.vz = 0;
+	}
+	b.t0 = t;
+
+	// when does it stop from here on
+	double speed = fabs(b.vx) > fabs(b.vz) ? fabs(b.vx) : fabs(b.vz);
+	if (speed <= STOP_SPEED) {
+		b.vx = b.vz = 0;
+		b.tStop = t;
+	}
+	else if (m_friction > 0) {
+		b.tStop = t + log(speed / STOP_SPEED) / m_friction;
+	}
+	else {
+		b.tStop = NEVER;
+	}
+}
+
+// position and velocity of ball i at time t, without changing its state
+void sim::CEventBilliard::sample(int i, double t, double& x, double& z, double& vx, double& vz) const
+{
+	const Ball& b = m_balls[i];
+	if (t == b.t0 || (b.vx == 0 && b.vz == 0)) {
+		// rebased at t, or at rest: most candidates are, and need no exp
+		x = b.x;
+		z = b.z;
+		vx = b.vx;
+		vz = b.vz;
+		return;
+	}
+	double end = t < b.tStop ? t : b.tStop;
+	double u = travel(end - b.t0);
+	x = b.x + m_table.timeScale * b.vx * u;
+	z = b.z + m_table.timeScale * b.vz * u;
+	if (t < b.tStop) {
+		double decay = exp(-m_friction * (t - b.t0));
+		vx = b.vx * decay;
+		vz = b.vz * decay;
+	}
+	else {
+		vx = vz = 0;
+	}
+}
+
+// cells cover the table, grown like CUniformGrid's until there are no more than
+// GRID_CELLS_PER_ITEM a ball. a few balls keep one cell: testing every pair of four balls
+// costs less than the cell events they would cross on the way
+void sim::CEventBilliard::setupCells(void)
+{
+	m_minX = m_table.minX;
+	m_minZ = m_table.minZ;
+	double width = (double)m_table.maxX - m_table.minX, depth = (double)m_table.maxZ - m_table.minZ;
+	double limit = m_balls.size() <= CELL_MIN_BALLS ? 1 : (double)m_balls.size() * GRID_CELLS_PER_ITEM;
+	limit = limit < GRID_MAX_CELLS ? limit : GRID_MAX_CELLS;
+	m_cellSize = CELL_DIAMETERS * 2 * BALL_RADIUS;
+	while ((floor(width / m_cellSize) + 1) * (floor(depth / m_cellSize) + 1) > limit)
+		m_cellSize *= 1.25;
+	m_cols = (int)floor(width / m_cellSize) + 1;
+	m_rows = (int)floor(depth / m_cellSize) + 1;
+	m_cellHead.assign((size_t)m_cols * m_rows, -1);
+}
+
+void sim::CEventBilliard::link(int i, int cellX, int cellZ)
+{
+	Ball& b = m_balls[i];
+	b.cellX = cellX < 0 ? 0 : (cellX < m_cols ? cellX : m_cols - 1);
+	b.cellZ = cellZ < 0 ? 0 : (cellZ < m_rows ? cellZ : m_rows - 1);
+	int& head = m_cellHead[b.cellZ * m_cols + b.cellX];
+	b.prev = -1;
+	b.next = head;
+	if (head >= 0)
+		m_balls[head].prev = i;
+	head = i;
+}
+
+void sim::CEventBilliard::unlink(int i)
+{
+	Ball& b = m_balls[i];
+	if (b.prev >= 0)
+		m_balls[b.prev].next = b.next;
+	else
+		m_cellHead[b.cellZ * m_cols + b.cellX] = b.next;
+	if (b.next >= 0)
+		m_balls[b.next].prev = b.prev;
+}
+
+void sim::CEventBilliard::load(const std::vector<CBall>& balls, double time)
+{
+	m_time = time;
+	m_events = 0;
+	m_stale = 0;
+	m_crossings = 0;
+	m_contacts.clear();
+	m_queue = std::priority_queue<Event>();
+
+	m_balls.resize(balls.size());
+	setupCells();
+	for (int i = 0; i < (int)balls.size(); i++) {
+		Vec3 c = balls[i].getCenter();
+		Ball& b = m_balls[i];
+		b.x = c.x;
+		b.z = c.z;
+		b.vx = balls[i].getVelocity_X();
+		b.vz = balls[i].getVelocity_Z();
+		b.t0 = time;
+		b.tStop = NEVER;
+		b.count = 0;
+		rebase(i, time);
+		link(i, (int)floor((b.x - m_minX) / m_cellSize), (int)floor((b.z - m_minZ) / m_cellSize));
+	}
+	for (int i = 0; i < (int)m_balls.size(); i++)
+		predict(i, -1);
+}
+
+void sim::CEventBilliard::push(double time, int a, int b, int wall)
+{
+	Event e;
+	e.time = time;
+	e.seq = m_seq++;
+	e.a = a;
+	e.b = b;
+	e.wall = wall;
+	e.countA = m_balls[a].count;
+	e.countB = b >= 0 ? m_balls[b].count : 0;
+	m_queue.push(e);
+}
+
+// the next side of its cell the ball leaves by, unless it stops or meets a cushion first
+void sim::CEventBilliard::pushCrossing(int i)
+{
+	const Ball& b = m_balls[i];
+	if (!(b.tStop > m_time))
+		return;
+	double x, z, vx, vz;
+	sample(i, m_time, x, z, vx, vz);
+	double s = m_table.timeScale;
+	double best = NEVER;
+	int side = -1;
+
+	// sides 0 and 1 are low and high x, 2 and 3 low and high z. the border cells have no side
+	// to the outside, the cushions keep the ball in
+	if (vx < 0 && b.cellX > 0) {
+		best = (m_minX + b.cellX * m_cellSize - x) / (s * vx);
+		side = 0;
+	}
+	else if (vx > 0 && b.cellX < m_cols - 1) {
+		best = (m_minX + (b.cellX + 1) * m_cellSize - x) / (s * vx);
+		side = 1;
+	}
+	double u = NEVER;
+	if (vz < 0 && b.cellZ > 0)
+		u = (m_minZ + b.cellZ * m_cellSize - z) / (s * vz);
+	else if (vz > 0 && b.cellZ < m_rows - 1)
+		u = (m_minZ + (b.cellZ + 1) * m_cellSize - z) / (s * vz);
+	if (u < best) {
+		best = u;
+		side = vz < 0 ? 2 : 3;
+	}
+	if (side < 0)
+		return;
+
+	double t = m_time + timeForTravel(best > 0 ? best : 0);
+	if (t < b.tStop)
+		push(t, i, CELL_EVENT, side);
+}
+
+void sim::CEventBilliard::predict(int i, int skip)
+{
+	rebase(i, m_time);
+	const Ball& a = m_balls[i];
+	bool moving = a.tStop > m_time;
+	double s = m_table.timeScale;
+	double r = BALL_RADIUS;
+
+	// a change of course can leave the ball a rounding error past the cell it was tracked in
+	unlink(i);
+	link(i, (int)floor((a.x - m_minX) / m_cellSize), (int)floor((a.z - m_minZ) / m_cellSize));
+
+	if (moving) {
+		push(a.tStop, i, STOP_EVENT, 0);
+
+		// cushions: x = minX + r, x = maxX - r, z = minZ + r, z = maxZ - r
+		double rest[4] = { m_table.minX + r, m_table.maxX - r, m_table.minZ + r, m_table.maxZ - r };
+		for (int w = 0; w < 4; w++) {
+			double p = w < 2 ? a.x : a.z;
+			double v = w < 2 ? a.vx : a.vz;
+			double normal = (w & 1) ? -1 : 1;
+			if (v * normal >= 0)
+				continue;
+			double u = (rest[w] - p) / (s * v);
+			if (u < 0) u = 0;
+			double t = m_time + timeForTravel(u);
+			if (t < a.tStop)
+				push(t, i, CUSHION_EVENT, w);
+		}
+		pushCrossing(i);
+	}
+
+	predictCells(i, skip, a.cellX - 1, a.cellX + 1, a.cellZ - 1, a.cellZ + 1);
+}
+
+void sim::CEventBilliard::predictCells(int i, int skip, int x0, int x1, int z0, int z1)
+{
+	x0 = x0 > 0 ? x0 : 0;
+	z0 = z0 > 0 ? z0 : 0;
+	x1 = x1 < m_cols - 1 ? x1 : m_cols - 1;
+	z1 = z1 < m_rows - 1 ? z1 : m_rows - 1;
+	for (int cz = z0; cz <= z1; cz++)
+		for (int cx = x0; cx <= x1; cx++)
+			for (int j = m_cellHead[cz * m_cols + cx]; j >= 0; j = m_balls[j].next)
+				if (j != i && j != skip)
+					predictPair(i, j);
+}
+
+void sim::CEventBilliard::predictPair(int i, int j)
+{
+	const Ball& a = m_balls[i];
+	const Ball& b = m_balls[j];
+	bool moving = a.tStop > m_time;
+	bool otherMoving = b.tStop > m_time;
+	if (!moving && !otherMoving)
+		return;
+	double s = m_table.timeScale;
+	double r = BALL_RADIUS;
+	double ax, az, avx, avz, bx, bz, bvx, bvz;
+	sample(i, m_time, ax, az, avx, avz);
+	sample(j, m_time, bx, bz, bvx, bvz);
+
+	// |d + s * dv * u| = 2r, take the first root while the balls approach
+	double dx = bx - ax, dz = bz - az;
+	double dvx = bvx - avx, dvz = bvz - avz;
+	double qa = s * s * (dvx * dvx + dvz * dvz);
+	double qb = 2 * s * (dx * dvx + dz * dvz);
+	double qc = dx * dx + dz * dz - 4 * r * r;
+	if (qb >= 0 || qa <= 0)
+		return;
+	double disc = qb * qb - 4 * qa * qc;
+	if (disc < 0)
+		return;
+	double u = (-qb - sqrt(disc)) / (2 * qa);
+	if (u < 0) u = 0;
+
+	// the closed form only holds until one of them stops, the stop event re-predicts
+	double horizon = NEVER;
+	if (moving) horizon = a.tStop;
+	if (otherMoving && b.tStop < horizon) horizon = b.tStop;
+	double t = m_time + timeForTravel(u);
+	if (t < horizon)
+		push(t, i, j, 0);
+}
+
+void sim::CEventBilliard::process(const Event& e)
+{
+	if (m_balls[e.a].count != e.countA || (e.b >= 0 && m_balls[e.b].count != e.countB)) {
+		m_stale++;
+		return;
+	}
+
+	// into the next cell, and against the row or column of cells that has just come next to it.
+	// the ball keeps its course, so its queued events stay good
+	if (e.b == CELL_EVENT) {
+		m_crossings++;
+		const Ball& a = m_balls[e.a];
+		int dx = e.wall == 0 ? -1 : (e.wall == 1 ? 1 : 0);
+		int dz = e.wall == 2 ? -1 : (e.wall == 3 ? 1 : 0);
+		unlink(e.a);
+		link(e.a, a.cellX + dx, a.cellZ + dz);
+		if (dx != 0)
+			predictCells(e.a, -1, a.cellX + dx, a.cellX + dx, a.cellZ - 1, a.cellZ + 1);
+		else
+			predictCells(e.a, -1, a.cellX - 1, a.cellX + 1, a.cellZ + dz, a.cellZ + dz);
+		pushCrossing(e.a);
+		return;
+	}
+	m_events++;
+
+	if (e.b == STOP_EVENT) {
+		rebase(e.a, e.time);
+		Ball& a = m_balls[e.a];
+		a.vx = a.vz = 0;
+		a.tStop = e.time;
+		a.count++;
+		predict(e.a, -1);
+		return;
+	}
+
+	if (e.b == CUSHION_EVENT) {
+		rebase(e.a, e.time);
+		Ball& a = m_balls[e.a];
+		double r = BALL_RADIUS;
+		switch (e.wall) {
+		case 0: a.x = m_table.minX + r; a.vx = fabs(a.vx);  break;
+		case 1: a.x = m_table.maxX - r; a.vx = -fabs(a.vx); break;
+		case 2: a.z = m_table.minZ + r; a.vz = fabs(a.vz);  break;
+		case 3: a.z = m_table.maxZ - r; a.vz = -fabs(a.vz); break;
+		}
+		a.count++;
+		predict(e.a, -1);
+		return;
+	}
+
+	// equal masses: swap the velocity components along the contact normal
+	rebase(e.a, e.time);
+	rebase(e.b, e.time);
+	Ball& a = m_balls[e.a];
+	Ball& b = m_balls[e.b];
+	double nx = b.x - a.x, nz = b.z - a.z;
+	double len = sqrt(nx * nx + nz * nz);
+	if (len > 0) { nx /= len; nz /= len; }
+	else { nx = 1; nz = 0; }
+	double approach = (a.vx - b.vx) * nx + (a.vz - b.vz) * nz;
+	if (approach > 0) {
+		a.vx -= approach * nx;	a.vz -= approach * nz;
+		b.vx += approach * nx;	b.vz += approach * nz;
+
+		BallContact contact;
+		contact.time = e.time;
+		contact.a = e.a < e.b ? e.a : e.b;
+		contact.b = e.a < e.b ? e.b : e.a;
+		m_contacts.push_back(contact);
+	}
+	a.tStop = b.tStop = NEVER;
+	rebase(e.a, e.time);
+	rebase(e.b, e.time);
+	a.count++;
+	b.count++;
+
+	// the pair itself is not predicted again: right after the exchange it has no normal
+	// velocity left, and rounding could otherwise make it collide again at the same time
+	// over and over. the next event that changes either ball re-predicts it
+	predict(e.a, e.b);
+	predict(e.b, e.a);
+}
+
+void sim::CEventBilliard::advance(double dt)
+{
+	double target = m_time + dt;
+	long guard = 0;
+	while (!m_queue.empty() && m_queue.top().time <= target && guard++ < MAX_EVENTS_PER_ADVANCE) {
+		Event e = m_queue.top();
+		m_queue.pop();
+		if (e.time > m_time)
+			m_time = e.time;
+		process(e);
+	}
+
+	// when the guard trips, events before target are still queued. the clock stays at the last
+	// one run, so the next advance takes them up in order instead of behind the clock
+	if (m_queue.empty() || m_queue.top().time > target)
+		m_time = target;
+}
+
+void sim::CEventBilliard::shoot(int i, float vx, float vz)
+{
+	rebase(i, m_time);
+	Ball& b = m_balls[i];
+	b.vx = vx;
+	b.vz = vz;
+	b.tStop = NEVER;
+	rebase(i, m_time);
+	b.count++;
+	predict(i, -1);
+}
+
+bool sim::CEventBilliard::isMoving(void) const
+{
+	for (int i = 0; i < (int)m_balls.size(); i++)
+		if (m_balls[i].tStop > m_time)
+			return true;
+	return false;
+}
+
+sim::Vec3 sim::CEventBilliard::getCenter(int i) const
+{
+	double x, z, vx, vz;
+	sample(i, m_time, x, z, vx, vz);
+	Vec3 c = { (float)x, BALL_RADIUS, (float)z };
+	return c;
+}
+
+void sim::CEventBilliard::getVelocity(int i, float& vx, float& vz) const
+{
+	double x, z, dvx, dvz;
+	sample(i, m_time, x, z, dvx, dvz);
+	vx = (float)dvx;
+	vz = (float)dvz;
+}
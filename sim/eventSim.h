@@ -0,0 +1,127 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: eventSim.h
+//
+// Desc: Event driven billiard engine. Between contacts every ball follows a closed form path
+//       (straight line, exponential slow down), so the next ball/ball, ball/cushion or ball-stops
+//       event can be solved for directly and the engine jumps from one event to the next.
+//       Pending events sit in a priority queue and are dropped lazily once one of their balls
+//       has changed course.
+//
+//       Balls are kept in lists per cell of a grid at least a ball diameter wide, so touching
+//       balls are always in neighbouring cells. A ball only predicts contacts against the
+//       balls around its cell, and a cell event moves it on when it crosses into the next one
+//       and predicts against the balls that have just become its neighbours. An event costs a
+//       few candidates instead of every ball on the table.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __eventSimH__
+#define __eventSimH__
+
+#include "simCore.h"
+#include <vector>
+#include <queue>
+
+namespace sim
+{
+	struct BallContact
+	{
+		double time;
+		int    a, b;      // a < b
+	};
+
+	class CEventBilliard {
+	public:
+		CEventBilliard(void);
+
+		void setTable(const TableDesc& table);
+		void load(const std::vector<CBall>& balls, double time = 0);
+
+		// run every event up to time + dt, balls are then evaluated at the new time. a step that
+		// would run more than a million events stops at the last one it ran and goes on from
+		// there the next time
+		void advance(double dt);
+
+		void shoot(int i, float vx, float vz);
+		bool isMoving(void) const;
+
+		double getTime(void) const { return m_time; }
+		int    getBallCount(void) const { return (int)m_balls.size(); }
+		Vec3   getCenter(int i) const;
+		void   getVelocity(int i, float& vx, float& vz) const;
+
+		// events that changed the table since load(), queued ones thrown away as stale, and
+		// balls moved from one cell to the next
+		long   getEventCount(void) const { return m_events; }
+		long   getStaleCount(void) const { return m_stale; }
+		long   getCrossingCount(void) const { return m_crossings; }
+		int    getCellCount(void) const { return m_cols * m_rows; }
+
+		// ball/ball contacts that changed velocities since load() or the last clearContacts(),
+		// in time order. a caller that keeps the table running drains them as it goes
+		const std::vector<BallContact>& getContacts(void) const { return m_contacts; }
+		void   clearContacts(void) { m_contacts.clear(); }
+
+	private:
+		enum { STOP_EVENT = -1, CUSHION_EVENT = -2, CELL_EVENT = -3 };   // kinds of event with a single ball
+
+		struct Ball
+		{
+			double x, z;      // state at time t0
+			double vx, vz;
+			double t0;
+			double tStop;     // time the ball comes to rest, huge when it never does
+			int    count;     // bumped on every change of course, invalidates queued events
+			int    cellX, cellZ;
+			int    next, prev;   // the other balls in its cell, -1 ends the list
+		};
+
+		struct Event
+		{
+			double time;
+			long   seq;       // keeps pops deterministic when two events share a time
+			int    a, b;      // b is another ball, or one of the single ball kinds
+			int    wall;      // cushion, or side of the cell a cell event leaves by
+			int    countA, countB;
+
+			bool operator<(const Event& e) const
+			{
+				// priority_queue pops the largest, so the earliest event must compare largest
+				if (time != e.time) return time > e.time;
+				return seq > e.seq;
+			}
+		};
+
+		void   rebase(int i, double t);
+		void   sample(int i, double t, double& x, double& z, double& vx, double& vz) const;
+		double travel(double tau) const;
+		double timeForTravel(double u) const;
+		void   setupCells(void);
+		void   link(int i, int cellX, int cellZ);
+		void   unlink(int i);
+		void   push(double time, int a, int b, int wall);
+		void   pushCrossing(int i);
+		void   predict(int i, int skip);
+		void   predictCells(int i, int skip, int x0, int x1, int z0, int z1);
+		void   predictPair(int i, int j);
+		void   process(const Event& e);
+
+		TableDesc				m_table;
+		double					m_friction;
+		std::vector<Ball>		m_balls;
+		std::vector<BallContact> m_contacts;
+		std::priority_queue<Event> m_queue;
+		std::vector<int>		m_cellHead;   // first ball in each cell, -1 when empty
+		double					m_minX, m_minZ;
+		double					m_cellSize;
+		int						m_cols, m_rows;
+		double					m_time;
+		long					m_seq;
+		long					m_events;
+		long					m_stale;
+		long					m_crossings;
+	};
+}
+
+#endif // __eventSimH__
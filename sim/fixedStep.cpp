@@ -0,0 +1,32 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: fixedStep.cpp
+//
+// Desc: Fixed timestep accumulator.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "fixedStep.h"
+
+sim::CFixedStepper::CFixedStepper(float step, float timeScale, int maxSteps)
+{
+	m_step = step;
+	m_timeScale = timeScale;
+	m_maxSteps = maxSteps;
+	m_accumulator = 0;
+}
+
+int sim::CFixedStepper::advance(float frameSeconds)
+{
+	if (frameSeconds < 0)
+		frameSeconds = 0;
+	m_accumulator += (double)frameSeconds * m_timeScale;
+
+	int steps = (int)(m_accumulator / m_step);
+	m_accumulator -= steps * (double)m_step;
+
+	// a stalled frame (window drag, breakpoint) must not snowball into ever longer frames
+	if (steps > m_maxSteps)
+		steps = m_maxSteps;
+	return steps;
+}
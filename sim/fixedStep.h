@@ -0,0 +1,40 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: fixedStep.h
+//
+// Desc: Accumulator that turns variable frame times into a whole number of fixed physics steps,
+//       plus the blend factor used to interpolate drawn positions between the last two steps.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __fixedStepH__
+#define __fixedStepH__
+
+namespace sim
+{
+	const float WALL_TIME_SCALE = 0.7f;      // simulated time per second of wall clock time
+	const float DEFAULT_STEP    = 1.0f / 120;
+	const int   DEFAULT_MAX_STEPS = 8;
+
+	class CFixedStepper {
+	public:
+		CFixedStepper(float step = DEFAULT_STEP, float timeScale = WALL_TIME_SCALE,
+			int maxSteps = DEFAULT_MAX_STEPS);
+
+		// add a frame worth of wall clock seconds, returns how many steps to run now
+		int   advance(float frameSeconds);
+
+		float getStep(void) const { return m_step; }
+		float getAlpha(void) const { return (float)(m_accumulator / m_step); }
+		void  setStep(float step) { m_step = step; m_accumulator = 0; }
+		void  reset(void) { m_accumulator = 0; }
+
+	private:
+		float  m_step;
+		float  m_timeScale;
+		int    m_maxSteps;
+		double m_accumulator;
+	};
+}
+
+#endif // __fixedStepH__
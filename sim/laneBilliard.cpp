@@ -0,0 +1,392 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: laneBilliard.cpp
+//
+// Desc: One billiard table per SIMD lane.
+//
+//       Every path evaluates the same float expressions in the same order as CBall::ballUpdate,
+//       CWall::hitBy and CBall::hitBy. Branches become masks: a lane whose balls do not touch
+//       adds a zero push and a zero velocity change.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "laneBilliard.h"
+#include "simScene.h"
+#include <cmath>
+
+namespace
+{
+	struct LaneParams
+	{
+		float move;        // timeScale * timeDelta
+		float rate;        // velocity kept over the step, 1 without friction
+		float radius;
+		float radiusSum;
+		float minX, maxX, minZ, maxZ;
+		float restMinX, restMaxX, restMinZ, restMaxZ;   // centers of balls resting on each wall
+	};
+
+	// -------------------------------------------------------------------------
+	// scalar, one lane at a time
+	// -------------------------------------------------------------------------
+
+	void moveScalar(float& x, float& z, float& vx, float& vz, const LaneParams& p)
+	{
+		if (fabsf(vx) > sim::STOP_SPEED || fabsf(vz) > sim::STOP_SPEED) {
+			x += p.move * vx;
+			z += p.move * vz;
+		}
+		else {
+			vx = vz = 0;
+		}
+		vx *= p.rate;
+		vz *= p.rate;
+
+		// walls in the scene's order: up, down, right, left
+		if (p.maxZ - z < p.radius) { z = p.restMaxZ; if (vz > 0) vz = -vz; }
+		if (z - p.minZ < p.radius) { z = p.restMinZ; if (vz < 0) vz = -vz; }
+		if (p.maxX - x < p.radius) { x = p.restMaxX; if (vx > 0) vx = -vx; }
+		if (x - p.minX < p.radius) { x = p.restMinX; if (vx < 0) vx = -vx; }
+	}
+
+	void hitScalar(float& xa, float& za, float& vxa, float& vza,
+		float& xb, float& zb, float& vxb, float& vzb, const LaneParams& p)
+	{
+		float dx = xb - xa;
+		float dz = zb - za;
+		if (!(dx * dx + dz * dz < p.radiusSum * p.radiusSum))
+			return;
+		float dist = sqrtf(dx * dx + dz * dz);
+		float nx = 1.0f, nz = 0.0f;
+		if (dist > 0) { nx = dx / dist; nz = dz / dist; }
+
+		float push = 0.5f * (p.radiusSum - dist);
+		xa -= nx * push;	za -= nz * push;
+		xb += nx * push;	zb += nz * push;
+
+		float approach = (vxa - vxb) * nx + (vza - vzb) * nz;
+		if (approach <= 0)
+			return;
+		vxa -= approach * nx;	vza -= approach * nz;
+		vxb += approach * nx;	vzb += approach * nz;
+	}
+
+	void stepPackScalar(float* x, float* z, float* vx, float* vz, const LaneParams& p)
+	{
+		for (int l = 0; l < sim::LANE_PACK; l++) {
+			for (int b = 0; b < sim::LANE_BALLS; b++) {
+				int s = b * sim::LANE_PACK + l;
+				moveScalar(x[s], z[s], vx[s], vz[s], p);
+			}
+			for (int a = 0; a < sim::LANE_BALLS; a++) {
+				for (int b = a + 1; b < sim::LANE_BALLS; b++) {
+					int sa = a * sim::LANE_PACK + l, sb = b * sim::LANE_PACK + l;
+					hitScalar(x[sa], z[sa], vx[sa], vz[sa], x[sb], z[sb], vx[sb], vz[sb], p);
+				}
+			}
+		}
+	}
+
+#if defined(SIM_X86)
+
+	// -------------------------------------------------------------------------
+	// SSE, 4 lanes per vector, two vectors per pack
+	// -------------------------------------------------------------------------
+
+	inline __m128 selectSSE(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+
+	inline __m128 negateSSE(__m128 v)
+	{
+		return _mm_xor_ps(v, _mm_set1_ps(-0.0f));
+	}
+
+	inline void moveSSE(__m128& x, __m128& z, __m128& vx, __m128& vz, const LaneParams& p)
+	{
+		__m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 stop = _mm_set1_ps(sim::STOP_SPEED);
+		__m128 moving = _mm_or_ps(_mm_cmpgt_ps(_mm_and_ps(vx, magnitude), stop),
+			_mm_cmpgt_ps(_mm_and_ps(vz, magnitude), stop));
+		__m128 move = _mm_set1_ps(p.move);
+		x = selectSSE(moving, _mm_add_ps(x, _mm_mul_ps(move, vx)), x);
+		z = selectSSE(moving, _mm_add_ps(z, _mm_mul_ps(move, vz)), z);
+		__m128 rate = _mm_set1_ps(p.rate);
+		vx = _mm_mul_ps(_mm_and_ps(moving, vx), rate);
+		vz = _mm_mul_ps(_mm_and_ps(moving, vz), rate);
+
+		__m128 radius = _mm_set1_ps(p.radius);
+		__m128 zero = _mm_setzero_ps();
+		__m128 hit;
+		hit = _mm_cmplt_ps(_mm_sub_ps(_mm_set1_ps(p.maxZ), z), radius);
+		z = selectSSE(hit, _mm_set1_ps(p.restMaxZ), z);
+		vz = selectSSE(_mm_and_ps(hit, _mm_cmpgt_ps(vz, zero)), negateSSE(vz), vz);
+		hit = _mm_cmplt_ps(_mm_sub_ps(z, _mm_set1_ps(p.minZ)), radius);
+		z = selectSSE(hit, _mm_set1_ps(p.restMinZ), z);
+		vz = selectSSE(_mm_and_ps(hit, _mm_cmplt_ps(vz, zero)), negateSSE(vz), vz);
+		hit = _mm_cmplt_ps(_mm_sub_ps(_mm_set1_ps(p.maxX), x), radius);
+		x = selectSSE(hit, _mm_set1_ps(p.restMaxX), x);
+		vx = selectSSE(_mm_and_ps(hit, _mm_cmpgt_ps(vx, zero)), negateSSE(vx), vx);
+		hit = _mm_cmplt_ps(_mm_sub_ps(x, _mm_set1_ps(p.minX)), radius);
+		x = selectSSE(hit, _mm_set1_ps(p.restMinX), x);
+		vx = selectSSE(_mm_and_ps(hit, _mm_cmplt_ps(vx, zero)), negateSSE(vx), vx);
+	}
+
+	inline void hitSSE(__m128& xa, __m128& za, __m128& vxa, __m128& vza,
+		__m128& xb, __m128& zb, __m128& vxb, __m128& vzb, const LaneParams& p)
+	{
+		__m128 dx = _mm_sub_ps(xb, xa);
+		__m128 dz = _mm_sub_ps(zb, za);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+		__m128 hit = _mm_cmplt_ps(d2, _mm_set1_ps(p.radiusSum * p.radiusSum));
+		if (_mm_movemask_ps(hit) == 0)
+			return;
+
+		__m128 zero = _mm_setzero_ps();
+		__m128 dist = _mm_sqrt_ps(d2);
+		__m128 apart = _mm_cmpgt_ps(dist, zero);
+		__m128 nx = selectSSE(apart, _mm_div_ps(dx, dist), _mm_set1_ps(1.0f));
+		__m128 nz = selectSSE(apart, _mm_div_ps(dz, dist), zero);
+
+		__m128 push = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_set1_ps(p.radiusSum), dist));
+		__m128 px = _mm_and_ps(hit, _mm_mul_ps(nx, push));
+		__m128 pz = _mm_and_ps(hit, _mm_mul_ps(nz, push));
+		xa = _mm_sub_ps(xa, px);	za = _mm_sub_ps(za, pz);
+		xb = _mm_add_ps(xb, px);	zb = _mm_add_ps(zb, pz);
+
+		__m128 approach = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vxa, vxb), nx), _mm_mul_ps(_mm_sub_ps(vza, vzb), nz));
+		__m128 change = _mm_and_ps(hit, _mm_cmpgt_ps(approach, zero));
+		__m128 ax = _mm_and_ps(change, _mm_mul_ps(approach, nx));
+		__m128 az = _mm_and_ps(change, _mm_mul_ps(approach, nz));
+		vxa = _mm_sub_ps(vxa, ax);	vza = _mm_sub_ps(vza, az);
+		vxb = _mm_add_ps(vxb, ax);	vzb = _mm_add_ps(vzb, az);
+	}
+
+	void stepPackSSE(float* x, float* z, float* vx, float* vz, const LaneParams& p)
+	{
+		for (int half = 0; half < sim::LANE_PACK; half += 4) {
+			__m128 bx[sim::LANE_BALLS], bz[sim::LANE_BALLS], bvx[sim::LANE_BALLS], bvz[sim::LANE_BALLS];
+			for (int b = 0; b < sim::LANE_BALLS; b++) {
+				int s = b * sim::LANE_PACK + half;
+				bx[b] = _mm_loadu_ps(x + s);	bz[b] = _mm_loadu_ps(z + s);
+				bvx[b] = _mm_loadu_ps(vx + s);	bvz[b] = _mm_loadu_ps(vz + s);
+				moveSSE(bx[b], bz[b], bvx[b], bvz[b], p);
+			}
+			for (int a = 0; a < sim::LANE_BALLS; a++)
+				for (int b = a + 1; b < sim::LANE_BALLS; b++)
+					hitSSE(bx[a], bz[a], bvx[a], bvz[a], bx[b], bz[b], bvx[b], bvz[b], p);
+			for (int b = 0; b < sim::LANE_BALLS; b++) {
+				int s = b * sim::LANE_PACK + half;
+				_mm_storeu_ps(x + s, bx[b]);	_mm_storeu_ps(z + s, bz[b]);
+				_mm_storeu_ps(vx + s, bvx[b]);	_mm_storeu_ps(vz + s, bvz[b]);
+			}
+		}
+	}
+
+	// -------------------------------------------------------------------------
+	// AVX2, the whole pack in one vector
+	// -------------------------------------------------------------------------
+
+	SIM_TARGET_AVX2
+	inline __m256 negateAVX2(__m256 v)
+	{
+		return _mm256_xor_ps(v, _mm256_set1_ps(-0.0f));
+	}
+
+	SIM_TARGET_AVX2
+	inline void moveAVX2(__m256& x, __m256& z, __m256& vx, __m256& vz, const LaneParams& p)
+	{
+		__m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		__m256 stop = _mm256_set1_ps(sim::STOP_SPEED);
+		__m256 moving = _mm256_or_ps(_mm256_cmp_ps(_mm256_and_ps(vx, magnitude), stop, _CMP_GT_OQ),
+			_mm256_cmp_ps(_mm256_and_ps(vz, magnitude), stop, _CMP_GT_OQ));
+		__m256 move = _mm256_set1_ps(p.move);
+		x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(move, vx)), moving);
+		z = _mm256_blendv_ps(z, _mm256_add_ps(z, _mm256_mul_ps(move, vz)), moving);
+		__m256 rate = _mm256_set1_ps(p.rate);
+		vx = _mm256_mul_ps(_mm256_and_ps(moving, vx), rate);
+		vz = _mm256_mul_ps(_mm256_and_ps(moving, vz), rate);
+
+		__m256 radius = _mm256_set1_ps(p.radius);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 hit;
+		hit = _mm256_cmp_ps(_mm256_sub_ps(_mm256_set1_ps(p.maxZ), z), radius, _CMP_LT_OQ);
+		z = _mm256_blendv_ps(z, _mm256_set1_ps(p.restMaxZ), hit);
+		vz = _mm256_blendv_ps(vz, negateAVX2(vz), _mm256_and_ps(hit, _mm256_cmp_ps(vz, zero, _CMP_GT_OQ)));
+		hit = _mm256_cmp_ps(_mm256_sub_ps(z, _mm256_set1_ps(p.minZ)), radius, _CMP_LT_OQ);
+		z = _mm256_blendv_ps(z, _mm256_set1_ps(p.restMinZ), hit);
+		vz = _mm256_blendv_ps(vz, negateAVX2(vz), _mm256_and_ps(hit, _mm256_cmp_ps(vz, zero, _CMP_LT_OQ)));
+		hit = _mm256_cmp_ps(_mm256_sub_ps(_mm256_set1_ps(p.maxX), x), radius, _CMP_LT_OQ);
+		x = _mm256_blendv_ps(x, _mm256_set1_ps(p.restMaxX), hit);
+		vx = _mm256_blendv_ps(vx, negateAVX2(vx), _mm256_and_ps(hit, _mm256_cmp_ps(vx, zero, _CMP_GT_OQ)));
+		hit = _mm256_cmp_ps(_mm256_sub_ps(x, _mm256_set1_ps(p.minX)), radius, _CMP_LT_OQ);
+		x = _mm256_blendv_ps(x, _mm256_set1_ps(p.restMinX), hit);
+		vx = _mm256_blendv_ps(vx, negateAVX2(vx), _mm256_and_ps(hit, _mm256_cmp_ps(vx, zero, _CMP_LT_OQ)));
+	}
+
+	SIM_TARGET_AVX2
+	inline void hitAVX2(__m256& xa, __m256& za, __m256& vxa, __m256& vza,
+		__m256& xb, __m256& zb, __m256& vxb, __m256& vzb, const LaneParams& p)
+	{
+		__m256 dx = _mm256_sub_ps(xb, xa);
+		__m256 dz = _mm256_sub_ps(zb, za);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+		__m256 hit = _mm256_cmp_ps(d2, _mm256_set1_ps(p.radiusSum * p.radiusSum), _CMP_LT_OQ);
+		if (_mm256_movemask_ps(hit) == 0)
+			return;
+
+		__m256 zero = _mm256_setzero_ps();
+		__m256 dist = _mm256_sqrt_ps(d2);
+		__m256 apart = _mm256_cmp_ps(dist, zero, _CMP_GT_OQ);
+		__m256 nx = _mm256_blendv_ps(_mm256_set1_ps(1.0f), _mm256_div_ps(dx, dist), apart);
+		__m256 nz = _mm256_blendv_ps(zero, _mm256_div_ps(dz, dist), apart);
+
+		__m256 push = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_sub_ps(_mm256_set1_ps(p.radiusSum), dist));
+		__m256 px = _mm256_and_ps(hit, _mm256_mul_ps(nx, push));
+		__m256 pz = _mm256_and_ps(hit, _mm256_mul_ps(nz, push));
+		xa = _mm256_sub_ps(xa, px);	za = _mm256_sub_ps(za, pz);
+		xb = _mm256_add_ps(xb, px);	zb = _mm256_add_ps(zb, pz);
+
+		__m256 approach = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(vxa, vxb), nx),
+			_mm256_mul_ps(_mm256_sub_ps(vza, vzb), nz));
+		__m256 change = _mm256_and_ps(hit, _mm256_cmp_ps(approach, zero, _CMP_GT_OQ));
+		__m256 ax = _mm256_and_ps(change, _mm256_mul_ps(approach, nx));
+		__m256 az = _mm256_and_ps(change, _mm256_mul_ps(approach, nz));
+		vxa = _mm256_sub_ps(vxa, ax);	vza = _mm256_sub_ps(vza, az);
+		vxb = _mm256_add_ps(vxb, ax);	vzb = _mm256_add_ps(vzb, az);
+	}
+
+	SIM_TARGET_AVX2
+	void stepPackAVX2(float* x, float* z, float* vx, float* vz, const LaneParams& p)
+	{
+		__m256 bx[sim::LANE_BALLS], bz[sim::LANE_BALLS], bvx[sim::LANE_BALLS], bvz[sim::LANE_BALLS];
+		for (int b = 0; b < sim::LANE_BALLS; b++) {
+			int s = b * sim::LANE_PACK;
+			bx[b] = _mm256_loadu_ps(x + s);		bz[b] = _mm256_loadu_ps(z + s);
+			bvx[b] = _mm256_loadu_ps(vx + s);	bvz[b] = _mm256_loadu_ps(vz + s);
+			moveAVX2(bx[b], bz[b], bvx[b], bvz[b], p);
+		}
+		for (int a = 0; a < sim::LANE_BALLS; a++)
+			for (int b = a + 1; b < sim::LANE_BALLS; b++)
+				hitAVX2(bx[a], bz[a], bvx[a], bvz[a], bx[b], bz[b], bvx[b], bvz[b], p);
+		for (int b = 0; b < sim::LANE_BALLS; b++) {
+			int s = b * sim::LANE_PACK;
+			_mm256_storeu_ps(x + s, bx[b]);		_mm256_storeu_ps(z + s, bz[b]);
+			_mm256_storeu_ps(vx + s, bvx[b]);	_mm256_storeu_ps(vz + s, bvz[b]);
+		}
+	}
+
+#else
+
+	void stepPackSSE(float* x, float* z, float* vx, float* vz, const LaneParams& p)
+	{
+		stepPackScalar(x, z, vx, vz, p);
+	}
+
+	void stepPackAVX2(float* x, float* z, float* vx, float* vz, const LaneParams& p)
+	{
+		stepPackScalar(x, z, vx, vz, p);
+	}
+
+#endif
+}
+
+sim::CLaneBilliard::CLaneBilliard(void)
+{
+	m_tables = 0;
+	m_packs = 0;
+	setTable(BILLIARD_TABLE);
+}
+
+void sim::CLaneBilliard::setTable(const TableDesc& table)
+{
+	m_table = table;
+}
+
+void sim::CLaneBilliard::setup(int tables)
+{
+	m_tables = tables;
+	m_packs = (tables + LANE_PACK - 1) / LANE_PACK;
+	int slots = m_packs * LANE_BALLS * LANE_PACK;
+	m_x.assign(slots, 0);
+	m_z.assign(slots, 0);
+	m_vx.assign(slots, 0);
+	m_vz.assign(slots, 0);
+
+	// the default rack in every lane, padding lanes included so they stay apart and still
+	for (int t = 0; t < m_packs * LANE_PACK; t++) {
+		for (int b = 0; b < LANE_BALLS; b++) {
+			m_x[slot(t, b)] = billiardBallPos[b][0];
+			m_z[slot(t, b)] = billiardBallPos[b][1];
+		}
+	}
+}
+
+void sim::CLaneBilliard::shoot(int table, int ball, float vx, float vz)
+{
+	m_vx[slot(table, ball)] = vx;
+	m_vz[slot(table, ball)] = vz;
+}
+
+void sim::CLaneBilliard::step(float timeDelta)
+{
+	step(timeDelta, getSimdPath());
+}
+
+void sim::CLaneBilliard::step(float timeDelta, SimdPath path)
+{
+	LaneParams p;
+	p.move = m_table.timeScale * timeDelta;
+	p.rate = m_table.friction ? (float)exp(-FRICTION * timeDelta) : 1.0f;
+	p.radius = BALL_RADIUS;
+	p.radiusSum = BALL_RADIUS + BALL_RADIUS;
+	p.minX = m_table.minX;	p.maxX = m_table.maxX;
+	p.minZ = m_table.minZ;	p.maxZ = m_table.maxZ;
+	p.restMinX = m_table.minX + BALL_RADIUS;	p.restMaxX = m_table.maxX - BALL_RADIUS;
+	p.restMinZ = m_table.minZ + BALL_RADIUS;	p.restMaxZ = m_table.maxZ - BALL_RADIUS;
+
+	for (int k = 0; k < m_packs; k++) {
+		int base = k * LANE_BALLS * LANE_PACK;
+		float* x = &m_x[base];
+		float* z = &m_z[base];
+		float* vx = &m_vx[base];
+		float* vz = &m_vz[base];
+		switch (path) {
+		case SIMD_AVX2: stepPackAVX2(x, z, vx, vz, p); break;
+		case SIMD_SSE:  stepPackSSE(x, z, vx, vz, p); break;
+		default:        stepPackScalar(x, z, vx, vz, p); break;
+		}
+	}
+}
+
+sim::Vec3 sim::CLaneBilliard::getCenter(int table, int ball) const
+{
+	Vec3 c = { m_x[slot(table, ball)], BALL_RADIUS, m_z[slot(table, ball)] };
+	return c;
+}
+
+void sim::CLaneBilliard::getVelocity(int table, int ball, float& vx, float& vz) const
+{
+	vx = m_vx[slot(table, ball)];
+	vz = m_vz[slot(table, ball)];
+}
+
+bool sim::CLaneBilliard::isMoving(int table) const
+{
+	for (int b = 0; b < LANE_BALLS; b++) {
+		int s = slot(table, b);
+		if (fabsf(m_vx[s]) > STOP_SPEED || fabsf(m_vz[s]) > STOP_SPEED)
+			return true;
+	}
+	return false;
+}
+
+int sim::CLaneBilliard::getMovingCount(void) const
+{
+	int moving = 0;
+	for (int t = 0; t < m_tables; t++)
+		if (isMoving(t))
+			moving++;
+	return moving;
+}
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: laneBilliard.h
+//
+// Desc: Many small billiard tables stepped side by side, one table per SIMD lane.
+//       A 4 ball table has too little work to fill a vector, but LANE_PACK tables next to each
+//       other do: ball b of every table in a pack sits in one row of floats, so each rule is
+//       applied to the whole pack at once and collisions only take effect in the lanes whose
+//       balls touch.
+//
+//       The rules are the discrete ones of CBall and CWall (ballUpdate, wall hitBy, ball hitBy
+//       for every pair), meant for Monte Carlo runs at small steps. Scalar, SSE and AVX2 paths
+//       give the same bits.
+//
+//       These are the rules from before continuous collision: a ball moves the whole step and
+//       is then pushed out of whatever it overlaps. CBilliardScene sweeps walls and ball pairs
+//       instead, so a lane table is not the scene's table and the two drift apart on any
+//       contact. Compare lanes with CBall and CWall stepped the same discrete way, never with
+//       the scene. Even then the speed decays in float here and in double in CBall, which leaves
+//       a gap of about a thousandth after a long run.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __laneBilliardH__
+#define __laneBilliardH__
+
+#include "simCore.h"
+#include "simdSupport.h"
+#include <vector>
+
+namespace sim
+{
+	const int LANE_BALLS = 4;    // balls per table, the default billiard layout
+	const int LANE_PACK  = 8;    // tables per pack, one AVX2 vector or two SSE ones
+
+	class CLaneBilliard {
+	public:
+		CLaneBilliard(void);
+
+		void setTable(const TableDesc& table);
+
+		// tables with the default layout, at rest. the count is rounded up to whole packs,
+		// the padding tables never move
+		void setup(int tables);
+		void shoot(int table, int ball, float vx, float vz);
+
+		// every table, on the current simd path or on the one given
+		void step(float timeDelta);
+		void step(float timeDelta, SimdPath path);
+
+		int  getTableCount(void) const { return m_tables; }
+		Vec3 getCenter(int table, int ball) const;
+		void getVelocity(int table, int ball, float& vx, float& vz) const;
+		bool isMoving(int table) const;
+		int  getMovingCount(void) const;
+
+	private:
+		int slot(int table, int ball) const
+		{
+			return ((table / LANE_PACK) * LANE_BALLS + ball) * LANE_PACK + table % LANE_PACK;
+		}
+
+		TableDesc			m_table;
+		int					m_tables;
+		int					m_packs;
+		std::vector<float>	m_x, m_z;    // ball b of table t at slot(t, b)
+		std::vector<float>	m_vx, m_vz;
+	};
+}
+
+#endif // __laneBilliardH__
@@ -0,0 +1,439 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelFile.cpp
+//
+// Desc: Lego level files, text and mapped binary.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "levelFile.h"
+#include "levelStream.h"
+#include "simScene.h"
+#include "uniformGrid.h"
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const float DEFAULT_COLOUR[4] = { 1, 1, 0, 1 };   // d3d::YELLOW
+
+void sim::makeDefaultLevel(LevelData& level)
+{
+	level.table = LEGO_TABLE;
+	level.colours.assign(DEFAULT_COLOUR, DEFAULT_COLOUR + 4);
+	level.pos.assign(&legoBrickPos[0][0], &legoBrickPos[0][0] + 2 * LEGO_BRICK_COUNT);
+	level.colour.assign(LEGO_BRICK_COUNT, 0);
+}
+
+bool sim::isLevelTextPath(const char* path)
+{
+	size_t n = strlen(path);
+	return n >= 4 && !strcmp(path + n - 4, ".txt");
+}
+
+// -----------------------------------------------------------------------------
+// Layout check
+// -----------------------------------------------------------------------------
+
+static void setError(std::string& error, const char* format, ...)
+{
+	char text[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	error = text;
+}
+
+bool sim::checkLevel(const float (*pos)[2], int count, const TableDesc& table, std::string& error)
+{
+	float r = BALL_RADIUS;
+	if (!(table.minX + r <= table.maxX - r && table.minZ + r <= table.maxZ - r)) {
+		error = "table is too small for a brick";
+		return false;
+	}
+	double cells = ((double)table.maxX - table.minX) / (2 * r) * (((double)table.maxZ - table.minZ) / (2 * r));
+	if (cells > (double)LEVEL_MAX_CELLS) {
+		error = "table is too large";
+		return false;
+	}
+
+	// written so a NaN fails the test as well
+	std::vector<float> x(count), z(count);
+	for (int i = 0; i < count; i++) {
+		x[i] = pos[i][0];
+		z[i] = pos[i][1];
+		if (!(x[i] >= table.minX + r && x[i] <= table.maxX - r && z[i] >= table.minZ + r && z[i] <= table.maxZ - r)) {
+			setError(error, "brick %d at (%g, %g) is off the table", i, x[i], z[i]);
+			return false;
+		}
+	}
+
+	// with cells one diameter wide, overlapping bricks sit in the same or in neighbouring cells
+	CUniformGrid grid;
+	grid.build(x, z, 2 * r);
+	int a, b;
+	if (grid.findOverlap(2 * r - LEVEL_OVERLAP_TOLERANCE, a, b)) {
+		setError(error, "bricks %d and %d overlap", a < b ? a : b, a < b ? b : a);
+		return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// Text form
+// -----------------------------------------------------------------------------
+
+static bool readFile(const char* path, std::vector<char>& text)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	text.resize(size > 0 ? size + 1 : 1);
+	bool ok = size >= 0 && fread(&text[0], 1, size, file) == (size_t)size;
+	text[size > 0 ? size : 0] = 0;
+	fclose(file);
+	return ok;
+}
+
+// reads up to max floats from s, returns how many
+static int readFloats(const char*& s, float* out, int max)
+{
+	int n = 0;
+	while (n < max) {
+		char* end;
+		float v = strtof(s, &end);
+		if (end == s)
+			break;
+		out[n++] = v;
+		s = end;
+	}
+	return n;
+}
+
+static bool isRestEmpty(const char* s)
+{
+	while (*s == ' ' || *s == '\t' || *s == '\r')
+		s++;
+	return *s == 0 || *s == '\n' || *s == '#';
+}
+
+bool sim::readLevelText(const char* path, LevelData& level, std::string& error)
+{
+	std::vector<char> text;
+	if (!readFile(path, text)) {
+		error = std::string("can not read ") + path;
+		return false;
+	}
+
+	level.table = LEGO_TABLE;
+	level.colours.clear();
+	level.pos.clear();
+	level.colour.clear();
+
+	// UTF-8 byte order mark of editors that add one
+	const char* s = &text[0];
+	if (!strncmp(s, "\xef\xbb\xbf", 3))
+		s += 3;
+
+	for (int line = 1; *s; line++) {
+		const char* next = strchr(s, '\n');
+		next = next ? next + 1 : s + strlen(s);
+		while (*s == ' ' || *s == '\t')
+			s++;
+
+		float v[4];
+		int n = 0;
+		bool ok = true;
+		if (isRestEmpty(s)) {
+		}
+		else if (!strncmp(s, "table", 5)) {
+			s += 5;
+			n = readFloats(s, v, 4);
+			ok = n == 4;
+			level.table.minX = v[0]; level.table.maxX = v[1];
+			level.table.minZ = v[2]; level.table.maxZ = v[3];
+		}
+		else if (!strncmp(s, "colour", 6)) {
+			s += 6;
+			n = readFloats(s, v, 4);
+			ok = n == 4 && (int)level.colours.size() < 4 * LEVEL_MAX_COLOURS;
+			level.colours.insert(level.colours.end(), v, v + 4);
+		}
+		else if (!strncmp(s, "brick", 5)) {
+			s += 5;
+			n = readFloats(s, v, 3);
+			ok = n >= 2;
+			level.pos.push_back(v[0]);
+			level.pos.push_back(v[1]);
+			// range checked before the cast, a colour such as 1e10 or nan has no uint8_t value
+			if (n == 3 && !(v[2] >= 0 && v[2] < LEVEL_MAX_COLOURS && v[2] == floorf(v[2])))
+				ok = false;
+			level.colour.push_back(n == 3 && ok ? (uint8_t)v[2] : 0);
+		}
+		else {
+			ok = false;
+		}
+
+		if (!ok || !isRestEmpty(s)) {
+			setError(error, "line %d: not a table, colour or brick record", line);
+			return false;
+		}
+		s = next;
+	}
+
+	if (level.colours.empty())
+		level.colours.assign(DEFAULT_COLOUR, DEFAULT_COLOUR + 4);
+	for (int i = 0; i < level.getBrickCount(); i++) {
+		if (4 * level.colour[i] >= (int)level.colours.size()) {
+			setError(error, "brick %d uses colour %d, only %d are defined", i, level.colour[i], (int)level.colours.size() / 4);
+			return false;
+		}
+	}
+	return true;
+}
+
+// the shortest text that reads back as the same float, 9 significant digits always do
+static void writeFloat(FILE* file, float v)
+{
+	char text[32];
+	for (int digits = 6; digits <= 9; digits++) {
+		snprintf(text, sizeof(text), "%.*g", digits, v);
+		if (strtof(text, 0) == v)
+			break;
+	}
+	fprintf(file, " %s", text);
+}
+
+static void writeRecord(FILE* file, const char* name, const float* v, int count)
+{
+	fputs(name, file);
+	for (int k = 0; k < count; k++)
+		writeFloat(file, v[k]);
+}
+
+bool sim::writeLevelText(const char* path, const LevelData& level)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	float bounds[4] = { level.table.minX, level.table.maxX, level.table.minZ, level.table.maxZ };
+	fprintf(file, "# lego level, %d bricks\n", level.getBrickCount());
+	writeRecord(file, "table", bounds, 4);
+	fputc('\n', file);
+	for (int c = 0; c < (int)level.colours.size() / 4; c++) {
+		writeRecord(file, "colour", &level.colours[4 * c], 4);
+		fputc('\n', file);
+	}
+	for (int i = 0; i < level.getBrickCount(); i++) {
+		writeRecord(file, "brick", &level.pos[2 * i], 2);
+		if (level.colour[i])
+			fprintf(file, " %d", level.colour[i]);
+		fputc('\n', file);
+	}
+	return fclose(file) == 0;
+}
+
+// -----------------------------------------------------------------------------
+// Binary form
+// -----------------------------------------------------------------------------
+
+bool sim::writeLevelBinary(const char* path, const LevelData& level)
+{
+	LevelHeader header;
+	header.magic = LEVEL_MAGIC;
+	header.version = LEVEL_VERSION;
+	header.brickCount = level.getBrickCount();
+	header.colourCount = (uint32_t)level.colours.size() / 4;
+	header.minX = level.table.minX;
+	header.maxX = level.table.maxX;
+	header.minZ = level.table.minZ;
+	header.maxZ = level.table.maxZ;
+
+	FILE* file = fopen(path, "wb");
+	if (!file)
+		return false;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (ok && header.colourCount)
+		ok = fwrite(&level.colours[0], 4 * sizeof(float), header.colourCount, file) == header.colourCount;
+	if (ok && header.brickCount) {
+		ok = fwrite(&level.pos[0], 2 * sizeof(float), header.brickCount, file) == header.brickCount &&
+			fwrite(&level.colour[0], 1, header.brickCount, file) == header.brickCount;
+	}
+	return fclose(file) == 0 && ok;
+}
+
+bool sim::convertLevel(const char* inPath, const char* outPath, std::string& error)
+{
+	LevelData level;
+	if (isLevelChunkedPath(inPath)) {
+		error = "chunked levels can not be converted back";
+		return false;
+	}
+	if (isLevelTextPath(inPath)) {
+		if (!readLevelText(inPath, level, error))
+			return false;
+		if (!checkLevel(level.getBrickPos(), level.getBrickCount(), level.table, error))
+			return false;
+	}
+	else {
+		CLevelFile file;
+		if (!file.open(inPath)) {
+			error = file.getError();
+			return false;
+		}
+		file.getLevel(level);
+	}
+
+	if (isLevelChunkedPath(outPath))
+		return writeLevelChunked(outPath, level, LEVEL_CHUNK_DEPTH, error);
+	bool ok = isLevelTextPath(outPath) ? writeLevelText(outPath, level) : writeLevelBinary(outPath, level);
+	if (!ok)
+		error = std::string("can not write ") + outPath;
+	return ok;
+}
+
+// -----------------------------------------------------------------------------
+// CLevelFile
+// -----------------------------------------------------------------------------
+
+sim::CLevelFile::CLevelFile(void)
+{
+	m_base = 0;
+	m_size = 0;
+	m_file = m_mapping = 0;
+	m_header = 0;
+	m_colours = 0;
+	m_pos = 0;
+	m_colour = 0;
+	m_table = LEGO_TABLE;
+}
+
+sim::CLevelFile::~CLevelFile(void)
+{
+	close();
+}
+
+bool sim::CLevelFile::fail(const char* what)
+{
+	m_error = what;
+	close();
+	return false;
+}
+
+bool sim::CLevelFile::open(const char* path)
+{
+	close();
+	m_error.clear();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return fail("can not open the file");
+	m_file = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(LevelHeader))
+		return fail("file is shorter than a level header");
+	m_size = (size_t)size.QuadPart;
+	m_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_mapping)
+		return fail("can not map the file");
+	m_base = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!m_base)
+		return fail("can not map the file");
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return fail("can not open the file");
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(LevelHeader)) {
+		::close(fd);
+		return fail("file is shorter than a level header");
+	}
+	m_size = (size_t)st.st_size;
+	void* base = mmap(0, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);   // the mapping keeps the file
+	if (base == MAP_FAILED)
+		return fail("can not map the file");
+	m_base = base;
+#endif
+
+	// the sections follow the header in order, each a multiple of 4 bytes long except the last
+	const LevelHeader* header = (const LevelHeader*)m_base;
+	if (header->magic != LEVEL_MAGIC)
+		return fail("not a level file");
+	if (header->version != LEVEL_VERSION)
+		return fail("level file version is not supported");
+	if (header->colourCount > (uint32_t)LEVEL_MAX_COLOURS || (header->brickCount && !header->colourCount))
+		return fail("bad colour count");
+	uint64_t expected = sizeof(LevelHeader) + 16ull * header->colourCount + 9ull * header->brickCount;
+	if (expected != m_size || header->brickCount > 0x7fffffffu)
+		return fail("file size does not match the counts in the header");
+
+	const char* p = (const char*)m_base + sizeof(LevelHeader);
+	m_header = header;
+	m_colours = (const float*)p;
+	m_pos = (const float (*)[2])(p + 16 * header->colourCount);
+	m_colour = (const uint8_t*)(p + 16 * header->colourCount + 8 * header->brickCount);
+	m_table = LEGO_TABLE;
+	m_table.minX = header->minX;
+	m_table.maxX = header->maxX;
+	m_table.minZ = header->minZ;
+	m_table.maxZ = header->maxZ;
+
+	int count = (int)header->brickCount;
+	for (int i = 0; i < count; i++)
+		if (m_colour[i] >= header->colourCount)
+			return fail("brick uses a colour that is not defined");
+	std::string error;
+	if (!checkLevel(m_pos, count, m_table, error))
+		return fail(error.c_str());
+	return true;
+}
+
+void sim::CLevelFile::close(void)
+{
+#ifdef _WIN32
+	if (m_base)
+		UnmapViewOfFile(m_base);
+	if (m_mapping)
+		CloseHandle((HANDLE)m_mapping);
+	if (m_file)
+		CloseHandle((HANDLE)m_file);
+#else
+	if (m_base)
+		munmap(m_base, m_size);
+#endif
+	m_base = 0;
+	m_size = 0;
+	m_file = m_mapping = 0;
+	m_header = 0;
+	m_colours = 0;
+	m_pos = 0;
+	m_colour = 0;
+}
+
+void sim::CLevelFile::getLevel(LevelData& level) const
+{
+	int count = getBrickCount();
+	level.table = m_table;
+	level.colours.assign(m_colours, m_colours + 4 * getColourCount());
+	level.pos.assign(count ? &m_pos[0][0] : 0, count ? &m_pos[0][0] + 2 * count : 0);
+	level.colour.assign(m_colour, m_colour + count);
+}
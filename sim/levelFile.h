@@ -0,0 +1,133 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelFile.h
+//
+// Desc: Lego levels on disk, so a new brick layout does not need a recompile.
+//
+//       The binary form is a LevelHeader followed by colourCount rgba colours, brickCount
+//       (x, z) pairs and brickCount colour indices, all little endian and 4 byte aligned.
+//       CLevelFile maps it read only and hands out pointers straight into the mapping, so
+//       opening a level parses and copies nothing. CLegoScene::setup still copies the centers
+//       it is given into its bricks and its grid.
+//
+//       The text form is meant to be edited by hand, one record per line:
+//
+//           # comment
+//           table  minX maxX minZ maxZ
+//           colour r g b a
+//           brick  x z [colour]
+//
+//       Colours are numbered in the order they appear, a brick without one uses colour 0.
+//       convertLevel turns either form into the other.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __levelFileH__
+#define __levelFileH__
+
+#include "simCore.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+	const uint32_t LEVEL_MAGIC   = 0x4c56454c;   // "LEVL" read as little endian bytes
+	const uint32_t LEVEL_VERSION = 1;
+	const int      LEVEL_MAX_COLOURS = 256;      // colour indices are one byte
+
+	// bricks closer than 2 * BALL_RADIUS by more than this overlap. the default layout has
+	// touching bricks, so the test allows for the rounding of hand typed coordinates
+	const float LEVEL_OVERLAP_TOLERANCE = 1e-3f;
+
+	// the overlap check grids the table, a level whose table needs more cells is refused
+	const long LEVEL_MAX_CELLS = 1L << 27;
+
+	struct LevelHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t brickCount;
+		uint32_t colourCount;
+		float    minX, maxX;   // table the level is laid out on, see TableDesc
+		float    minZ, maxZ;
+	};
+
+	// a level in memory, what the text reader fills and the writers take
+	struct LevelData
+	{
+		TableDesc             table;     // only the bounds are stored, the rest is LEGO_TABLE
+		std::vector<float>    colours;   // r, g, b, a of each colour
+		std::vector<float>    pos;       // x, z of each brick
+		std::vector<uint8_t>  colour;    // colour index of each brick
+
+		int getBrickCount(void) const { return (int)colour.size(); }
+		const float (*getBrickPos(void) const)[2] { return pos.empty() ? 0 : (const float (*)[2])&pos[0]; }
+	};
+
+	// the default 54 brick level in the default yellow
+	void makeDefaultLevel(LevelData& level);
+
+	bool readLevelText(const char* path, LevelData& level, std::string& error);
+	bool writeLevelText(const char* path, const LevelData& level);
+	bool writeLevelBinary(const char* path, const LevelData& level);
+
+	// reads either form and writes the other one. a path ending in .txt is the text form,
+	// one ending in .lvs a chunked level for streaming (see levelStream.h), only ever written
+	bool convertLevel(const char* inPath, const char* outPath, std::string& error);
+	bool isLevelTextPath(const char* path);
+
+	// bricks that are off the table or closer than 2 * BALL_RADIUS - LEVEL_OVERLAP_TOLERANCE
+	// to another brick. on failure error names the first offender
+	bool checkLevel(const float (*pos)[2], int count, const TableDesc& table, std::string& error);
+
+	// -----------------------------------------------------------------------------
+	// CLevelFile - a binary level mapped read only
+	// -----------------------------------------------------------------------------
+
+	class CLevelFile {
+	public:
+		CLevelFile(void);
+		~CLevelFile(void);
+
+		// maps the file and checks the header, the sizes and the layout (see checkLevel).
+		// on failure the file is closed again and getError says why
+		bool open(const char* path);
+		void close(void);
+		bool isOpen(void) const { return m_base != 0; }
+		const std::string& getError(void) const { return m_error; }
+
+		int  getBrickCount(void) const { return m_header ? (int)m_header->brickCount : 0; }
+		int  getColourCount(void) const { return m_header ? (int)m_header->colourCount : 0; }
+		const TableDesc& getTable(void) const { return m_table; }
+
+		// pointers into the mapping, valid until close
+		const float (*getBrickPos(void) const)[2] { return m_pos; }
+		const float* getColour(int c) const { return m_colours + 4 * c; }
+		int  getBrickColour(int i) const { return m_colour[i]; }
+		const uint8_t* getBrickColours(void) const { return m_colour; }
+
+		// the mapped level copied out, for the text writer
+		void getLevel(LevelData& level) const;
+
+	private:
+		CLevelFile(const CLevelFile&);
+		CLevelFile& operator=(const CLevelFile&);
+
+		bool fail(const char* what);
+
+		void*				m_base;
+		size_t				m_size;
+		void*				m_file;      // mapping handles on Windows, unused elsewhere
+		void*				m_mapping;
+		const LevelHeader*	m_header;
+		const float*		m_colours;
+		const float			(*m_pos)[2];
+		const uint8_t*		m_colour;
+		TableDesc			m_table;
+		std::string			m_error;
+	};
+}
+
+#endif // __levelFileH__
@@ -0,0 +1,346 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelGen.cpp
+//
+// Desc: Procedural lego levels.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "levelGen.h"
+#include "threadPool.h"
+#include <cmath>
+#include <functional>
+
+static const float FIELD_START_Z = -2.0f;    // first bricks, clear of the holder
+static const float FIELD_END_GAP = 1.0f;     // table left free above the last brick
+static const float FILL_DENSITY  = 0.85f;    // bricks per spacing^2 a filled tile reaches, near enough
+static const float FILL_RADIUS   = 1.001f;   // candidates this many spacings from their brick
+static const int   SLAB_ROWS     = 4;        // tile rows generated before the count is checked
+static const float EMPTY_CELL    = 1e30f;
+static const float PI_F          = 3.14159265f;
+
+sim::LevelGenDesc::LevelGenDesc(void)
+{
+	seed = 1;
+	count = 1000;
+	spacing = 2 * BALL_RADIUS + 0.02f;
+	width = 0;
+	ringChance = 0.1f;
+	wallChance = 0.1f;
+}
+
+// -----------------------------------------------------------------------------
+// Random numbers, one sequence per tile
+// -----------------------------------------------------------------------------
+
+struct TileRandom
+{
+	uint64_t state;
+
+	explicit TileRandom(uint64_t seed) : state(seed) {}
+
+	// splitmix64
+	uint64_t next(void)
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// [0, 1)
+	float uniform(void) { return (float)(next() >> 40) * (1.0f / 16777216.0f); }
+};
+
+// -----------------------------------------------------------------------------
+// Background grid over the slab being generated and the rows just below it
+// -----------------------------------------------------------------------------
+
+struct GenGrid
+{
+	float minX, startZ;
+	float cell, invCell;
+	int   cols, rows;               // rows is the ring size, global row r lives at r % rows
+	std::vector<float> x, z;        // brick in each cell, EMPTY_CELL when there is none
+
+	void setup(float gridMinX, float gridStartZ, float width, float spacing, int slabCells)
+	{
+		minX = gridMinX;
+		startZ = gridStartZ;
+		cell = spacing / sqrtf(2.0f);
+		invCell = 1.0f / cell;
+		cols = (int)(width * invCell) + 1;
+		rows = slabCells + 8;
+		x.assign((size_t)cols * rows, EMPTY_CELL);
+		z.assign((size_t)cols * rows, EMPTY_CELL);
+	}
+
+	int rowOf(float pz) const { return (int)floorf((pz - startZ) * invCell); }
+	int colOf(float px) const { return (int)floorf((px - minX) * invCell); }
+
+	void clearRows(int first, int last)
+	{
+		for (int r = first; r <= last; r++) {
+			size_t base = (size_t)(r % rows) * cols;
+			for (int c = 0; c < cols; c++)
+				x[base + c] = z[base + c] = EMPTY_CELL;
+		}
+	}
+
+	// no brick closer than spacing. a cell holds one brick at most, and the corner cells of
+	// the 5 x 5 block are a whole spacing away
+	bool fits(float px, float pz, float spacing2) const
+	{
+		int cx = colOf(px), cz = rowOf(pz);
+		if (x[(size_t)(cz % rows) * cols + cx] != EMPTY_CELL)
+			return false;   // the own cell is at most a spacing across, most candidates end here
+		int ring = (cz - 2) % rows;
+		for (int dz = -2; dz <= 2; dz++, ring = ring + 1 == rows ? 0 : ring + 1) {
+			if (cz + dz < 0)
+				continue;
+			size_t base = (size_t)ring * cols;
+			for (int dx = -2; dx <= 2; dx++) {
+				int c = cx + dx;
+				if (c < 0 || c >= cols || ((dx == 2 || dx == -2) && (dz == 2 || dz == -2)))
+					continue;
+				float ox = x[base + c] - px, oz = z[base + c] - pz;
+				if (ox * ox + oz * oz < spacing2)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void put(float px, float pz)
+	{
+		size_t i = (size_t)(rowOf(pz) % rows) * cols + colOf(px);
+		x[i] = px;
+		z[i] = pz;
+	}
+};
+
+// -----------------------------------------------------------------------------
+// One tile
+// -----------------------------------------------------------------------------
+
+struct GenTile
+{
+	float x0, x1, z0, z1;           // half open, clipped to the brick field
+	uint64_t seed;
+	std::vector<float>   pos;
+	std::vector<uint8_t> colour;
+};
+
+struct TileWork
+{
+	const sim::LevelGenDesc* desc;
+	GenGrid* grid;
+	std::vector<int> active;
+
+	bool inside(const GenTile& t, float px, float pz) const
+	{
+		return px >= t.x0 && px < t.x1 && pz >= t.z0 && pz < t.z1;
+	}
+
+	bool tryAdd(GenTile& t, float px, float pz, int colour)
+	{
+		if (!inside(t, px, pz) || !grid->fits(px, pz, desc->spacing * desc->spacing))
+			return false;
+		grid->put(px, pz);
+		active.push_back((int)t.colour.size());
+		t.pos.push_back(px);
+		t.pos.push_back(pz);
+		t.colour.push_back((uint8_t)colour);
+		return true;
+	}
+
+	// concentric rings around the tile center, every ring rotated at random
+	void addRings(GenTile& t, TileRandom& random)
+	{
+		float s = desc->spacing;
+		float cx = 0.5f * (t.x0 + t.x1), cz = 0.5f * (t.z0 + t.z1);
+		float limit = 0.5f * fminf(t.x1 - t.x0, t.z1 - t.z0) - 0.5f * s;
+		tryAdd(t, cx, cz, sim::GEN_RING);
+		for (float radius = 2 * s; radius <= limit; radius += 2 * s) {
+			// chord between neighbours on the ring at least one spacing
+			int n = (int)(PI_F / asinf(0.5f * s / radius));
+			float turn = 2 * PI_F * random.uniform();
+			for (int k = 0; k < n; k++) {
+				float a = turn + 2 * PI_F * k / n;
+				tryAdd(t, cx + radius * cosf(a), cz + radius * sinf(a), sim::GEN_RING);
+			}
+		}
+	}
+
+	// a two brick thick wall across the tile, along x or z, with a gap somewhere in it
+	void addWall(GenTile& t, TileRandom& random)
+	{
+		float s = desc->spacing;
+		bool alongX = random.uniform() < 0.5f;
+		float length = alongX ? t.x1 - t.x0 : t.z1 - t.z0;
+		float across = alongX ? t.z0 + (t.z1 - t.z0) * (0.25f + 0.5f * random.uniform())
+			: t.x0 + (t.x1 - t.x0) * (0.25f + 0.5f * random.uniform());
+		int bricks = (int)(length / s);
+		int gap = (int)(random.uniform() * bricks);
+		for (int line = 0; line < 2; line++) {
+			float offset = line * s * 0.8661f;     // staggered by half a brick, the lines just touch
+			for (int k = 0; k < bricks; k++) {
+				if (k >= gap - 1 && k <= gap + 1)
+					continue;
+				float along = (alongX ? t.x0 : t.z0) + (k + 0.5f * (line + 1)) * s;
+				if (alongX) tryAdd(t, along, across + offset, sim::GEN_WALL);
+				else        tryAdd(t, across + offset, along, sim::GEN_WALL);
+			}
+		}
+	}
+
+	// Bridson's sampling with the candidates of an active brick spread evenly round a circle
+	// just over one spacing out, from a random angle, rather than at random in the ring one
+	// to two spacings out. the level packs closer and a brick is done after LEVEL_GEN_ATTEMPTS
+	// tries instead of thirty
+	void fill(GenTile& t, TileRandom& random)
+	{
+		float s = desc->spacing;
+		float r = s * FILL_RADIUS;
+		float stepCos = cosf(2 * PI_F / sim::LEVEL_GEN_ATTEMPTS), stepSin = sinf(2 * PI_F / sim::LEVEL_GEN_ATTEMPTS);
+		for (int k = 0; k < sim::LEVEL_GEN_ATTEMPTS; k++) {
+			float px = t.x0 + (t.x1 - t.x0) * random.uniform();
+			float pz = t.z0 + (t.z1 - t.z0) * random.uniform();
+			if (tryAdd(t, px, pz, sim::GEN_FILL))
+				break;
+		}
+		while (!active.empty()) {
+			int pick = (int)(random.uniform() * active.size());
+			int i = active[pick];
+			float bx = t.pos[2 * i], bz = t.pos[2 * i + 1];
+			float a = 2 * PI_F * random.uniform();
+			float dx = r * cosf(a), dz = r * sinf(a);
+			bool added = false;
+			for (int k = 0; k < sim::LEVEL_GEN_ATTEMPTS && !added; k++) {
+				added = tryAdd(t, bx + dx, bz + dz, sim::GEN_FILL);
+				float turned = dx * stepCos - dz * stepSin;
+				dz = dx * stepSin + dz * stepCos;
+				dx = turned;
+			}
+			if (!added) {
+				active[pick] = active.back();
+				active.pop_back();
+			}
+		}
+	}
+
+	void run(GenTile& t)
+	{
+		TileRandom random(t.seed);
+		active.clear();
+		t.pos.clear();
+		t.colour.clear();
+		float pattern = random.uniform();
+		if (pattern < desc->ringChance)
+			addRings(t, random);
+		else if (pattern < desc->ringChance + desc->wallChance)
+			addWall(t, random);
+		fill(t, random);
+	}
+};
+
+// -----------------------------------------------------------------------------
+// generateLevel
+// -----------------------------------------------------------------------------
+
+bool sim::generateLevel(const LevelGenDesc& desc, LevelData& level, CThreadPool* pool)
+{
+	float s = desc.spacing;
+	if (!(s >= 2 * BALL_RADIUS && s <= 0.5f * LEVEL_GEN_TILE) || desc.count < 0)
+		return false;
+
+	float width = desc.width;
+	if (width <= 0)
+		width = sqrtf(desc.count / FILL_DENSITY) * s + 2 * BALL_RADIUS + s;
+	float fieldMinX = -0.5f * width + BALL_RADIUS;
+	float fieldWidth = width - 2 * BALL_RADIUS;
+	if (fieldWidth < 0)
+		return false;
+
+	const float colours[4 * GEN_COLOURS] = {
+		1, 1, 0, 1,        // fill, the default yellow
+		1, 0.5f, 0, 1,     // rings
+		0.6f, 0.6f, 0.6f, 1 };   // walls
+	level.colours.assign(colours, colours + 4 * GEN_COLOURS);
+	level.pos.clear();
+	level.colour.clear();
+	level.pos.reserve(2 * (size_t)desc.count);
+	level.colour.reserve(desc.count);
+
+	int tileCols = (int)ceilf(fieldWidth / LEVEL_GEN_TILE);
+	if (tileCols < 1)
+		tileCols = 1;
+	GenGrid grid;
+	grid.setup(fieldMinX, FIELD_START_Z, fieldWidth, s, (int)(SLAB_ROWS * LEVEL_GEN_TILE / (s / sqrtf(2.0f))) + 2);
+
+	std::vector<GenTile> tiles(SLAB_ROWS * tileCols);
+	std::vector<int> pass;
+	std::function<void(int, int)> runPass = [&](int begin, int end) {
+		TileWork local;
+		local.desc = &desc;
+		local.grid = &grid;
+		for (int k = begin; k < end; k++)
+			local.run(tiles[pass[k]]);
+	};
+
+	// a slab more of tile rows until the count is reached. a slab only reads the top of the
+	// one below it, which is done
+	float fieldMaxZ = FIELD_START_Z;
+	for (int slab = 0; (int)level.colour.size() < desc.count; slab++) {
+		float slabZ = FIELD_START_Z + slab * SLAB_ROWS * LEVEL_GEN_TILE;
+		// the row slabZ falls in holds bricks of the slab below already
+		grid.clearRows(grid.rowOf(slabZ) + 1, grid.rowOf(slabZ + SLAB_ROWS * LEVEL_GEN_TILE) + 2);
+		for (int row = 0; row < SLAB_ROWS; row++) {
+			for (int col = 0; col < tileCols; col++) {
+				GenTile& t = tiles[row * tileCols + col];
+				t.x0 = fieldMinX + col * LEVEL_GEN_TILE;
+				t.x1 = fminf(t.x0 + LEVEL_GEN_TILE, fieldMinX + fieldWidth);
+				if (col == tileCols - 1)
+					t.x1 = nextafterf(fieldMinX + fieldWidth, 1e30f);   // the right edge is on the field
+				t.z0 = slabZ + row * LEVEL_GEN_TILE;
+				t.z1 = t.z0 + LEVEL_GEN_TILE;
+				uint64_t tileIndex = (uint64_t)(slab * SLAB_ROWS + row) * (uint64_t)tileCols + col;
+				t.seed = desc.seed * 0xd1b54a32d192ed69ull ^ tileIndex * 0x9e3779b97f4a7c15ull;
+			}
+		}
+
+		for (int p = 0; p < 4; p++) {
+			pass.clear();
+			for (int row = p >> 1; row < SLAB_ROWS; row += 2)
+				for (int col = p & 1; col < tileCols; col += 2)
+					pass.push_back(row * tileCols + col);
+			if (pool)
+				pool->parallelFor((int)pass.size(), 1, runPass);
+			else
+				runPass(0, (int)pass.size());
+		}
+
+		int before = (int)level.colour.size();
+		for (int k = 0; k < (int)tiles.size() && (int)level.colour.size() < desc.count; k++) {
+			const GenTile& t = tiles[k];
+			int take = (int)t.colour.size();
+			if (take > desc.count - (int)level.colour.size())
+				take = desc.count - (int)level.colour.size();
+			level.pos.insert(level.pos.end(), t.pos.begin(), t.pos.begin() + 2 * take);
+			level.colour.insert(level.colour.end(), t.colour.begin(), t.colour.begin() + take);
+			for (int i = 0; i < take; i++)
+				if (t.pos[2 * i + 1] > fieldMaxZ)
+					fieldMaxZ = t.pos[2 * i + 1];
+		}
+		if ((int)level.colour.size() == before)
+			return false;   // nothing fits in the field
+	}
+
+	level.table = LEGO_TABLE;
+	level.table.minX = -0.5f * width;
+	level.table.maxX = 0.5f * width;
+	level.table.maxZ = fieldMaxZ + BALL_RADIUS + FIELD_END_GAP;
+	if (level.table.maxZ < LEGO_TABLE.maxZ)
+		level.table.maxZ = LEGO_TABLE.maxZ;
+	return true;
+}
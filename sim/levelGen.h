@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelGen.h
+//
+// Desc: Procedural lego levels for stress runs, from a thousand to tens of millions of bricks,
+//       none of them closer than the spacing to another.
+//
+//       The brick field is cut into square tiles. A tile may get a pattern first (rings around
+//       its center or a wall with a gap), and is then filled by Poisson disk sampling, which
+//       grows new bricks round the ones it already has until no more fit. A background grid
+//       of cells spacing / sqrt(2) wide holds at most one brick per cell, so a candidate is
+//       tested against the 21 cells around it only.
+//
+//       Tiles are generated on a thread pool in four passes by the parity of their row and
+//       column, so two tiles worked on at once are never neighbours. Each tile draws from its
+//       own random sequence, seeded from the level seed and the tile, and only sees tiles of
+//       earlier passes, so the level is the same whatever the number of threads.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __levelGenH__
+#define __levelGenH__
+
+#include "levelFile.h"
+
+namespace sim
+{
+	class CThreadPool;
+
+	const float LEVEL_GEN_TILE     = 8.0f;    // tile edge, at least one spacing
+	const int   LEVEL_GEN_ATTEMPTS = 16;      // candidates tried around each brick before it is done
+
+	// colour index of the bricks by where they came from
+	enum LevelGenColour { GEN_FILL, GEN_RING, GEN_WALL, GEN_COLOURS };
+
+	struct LevelGenDesc
+	{
+		uint64_t seed;
+		int      count;          // bricks in the level
+		float    spacing;        // least distance between brick centers, at least 2 * BALL_RADIUS
+		float    width;          // table width, 0 picks a square field
+		float    ringChance;     // share of tiles given a ring or a wall pattern
+		float    wallChance;
+
+		LevelGenDesc(void);
+	};
+
+	// fills level with exactly desc.count bricks, laid out from z = -2 up the table, in front
+	// of the holder. the table is made as long as they need. pool may be 0 for one thread.
+	// false when the spacing or the width can not hold a brick
+	bool generateLevel(const LevelGenDesc& desc, LevelData& level, CThreadPool* pool);
+}
+
+#endif // __levelGenH__
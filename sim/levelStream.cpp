@@ -0,0 +1,450 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelStream.cpp
+//
+// Desc: Chunked level files and the background chunk streamer.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "levelStream.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+static const int MAX_CHUNKS = 1 << 24;
+
+// brick data of one chunk entry: the (x, z) pairs and the colour bytes padded to 4
+static uint64_t chunkBytes(uint64_t count)
+{
+	return 8 * count + ((count + 3) & ~(uint64_t)3);
+}
+
+// writer and reader put a brick into the same band, rounding included
+static int chunkOf(float z, const sim::ChunkedLevelHeader& header)
+{
+	float c = floorf((z - header.minZ) / header.chunkDepth);
+	if (!(c >= 0))
+		return 0;
+	return c < header.chunkCount ? (int)c : (int)header.chunkCount - 1;
+}
+
+static bool seekTo(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+static uint64_t fileSize(FILE* file)
+{
+#ifdef _WIN32
+	_fseeki64(file, 0, SEEK_END);
+	return (uint64_t)_ftelli64(file);
+#else
+	fseeko(file, 0, SEEK_END);
+	return (uint64_t)ftello(file);
+#endif
+}
+
+bool sim::isLevelChunkedPath(const char* path)
+{
+	size_t n = strlen(path);
+	return n >= 4 && !strcmp(path + n - 4, ".lvs");
+}
+
+bool sim::writeLevelChunked(const char* path, const LevelData& level, float chunkDepth, std::string& error)
+{
+	int count = level.getBrickCount();
+	if (!checkLevel(level.getBrickPos(), count, level.table, error))
+		return false;
+	if (!(chunkDepth > 0)) {
+		error = "chunk depth must be positive";
+		return false;
+	}
+
+	ChunkedLevelHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LEVEL_CHUNKED_MAGIC;
+	header.version = LEVEL_CHUNKED_VERSION;
+	header.brickCount = count;
+	header.colourCount = (uint32_t)level.colours.size() / 4;
+	double chunks = ceil(((double)level.table.maxZ - level.table.minZ) / chunkDepth);
+	if (chunks > MAX_CHUNKS) {
+		error = "too many chunks, the chunk depth is too small for the table";
+		return false;
+	}
+	header.chunkCount = chunks < 1 ? 1 : (uint32_t)chunks;
+	header.chunkDepth = chunkDepth;
+	header.minX = level.table.minX;
+	header.maxX = level.table.maxX;
+	header.minZ = level.table.minZ;
+	header.maxZ = level.table.maxZ;
+
+	// counting sort of the bricks by band, each band keeps the order of the level
+	std::vector<int> band(count), start(header.chunkCount + 1, 0);
+	for (int i = 0; i < count; i++) {
+		band[i] = chunkOf(level.pos[2 * i + 1], header);
+		start[band[i] + 1]++;
+	}
+	for (uint32_t c = 0; c < header.chunkCount; c++) {
+		start[c + 1] += start[c];
+		if (start[c + 1] - start[c] > (int)header.maxChunkBricks)
+			header.maxChunkBricks = start[c + 1] - start[c];
+	}
+	if (header.maxChunkBricks > (uint32_t)LEVEL_MAX_CHUNK_BRICKS) {
+		error = "a chunk holds too many bricks, the chunk depth is too large";
+		return false;
+	}
+	std::vector<int> order(count), fill(start.begin(), start.end() - 1);
+	for (int i = 0; i < count; i++)
+		order[fill[band[i]]++] = i;
+
+	std::vector<ChunkEntry> entries(header.chunkCount);
+	uint64_t offset = sizeof(header) + 16ull * header.colourCount + sizeof(ChunkEntry) * (uint64_t)header.chunkCount;
+	for (uint32_t c = 0; c < header.chunkCount; c++) {
+		entries[c].offset = offset;
+		entries[c].brickCount = start[c + 1] - start[c];
+		entries[c].reserved = 0;
+		offset += chunkBytes(entries[c].brickCount);
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		error = std::string("can not write ") + path;
+		return false;
+	}
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (ok && header.colourCount)
+		ok = fwrite(&level.colours[0], 4 * sizeof(float), header.colourCount, file) == header.colourCount;
+	ok = ok && fwrite(&entries[0], sizeof(ChunkEntry), header.chunkCount, file) == header.chunkCount;
+	std::vector<float> pos;
+	std::vector<uint8_t> colour;
+	for (uint32_t c = 0; c < header.chunkCount && ok; c++) {
+		int n = entries[c].brickCount;
+		pos.resize(2 * n);
+		colour.assign((n + 3) & ~3, 0);
+		for (int k = 0; k < n; k++) {
+			int i = order[start[c] + k];
+			pos[2 * k] = level.pos[2 * i];
+			pos[2 * k + 1] = level.pos[2 * i + 1];
+			colour[k] = level.colour[i];
+		}
+		if (n)
+			ok = fwrite(&pos[0], 2 * sizeof(float), n, file) == (size_t)n &&
+				fwrite(&colour[0], 1, colour.size(), file) == colour.size();
+	}
+	if (fclose(file) != 0 || !ok) {
+		error = std::string("can not write ") + path;
+		return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// CLevelStream
+// -----------------------------------------------------------------------------
+
+sim::CLevelStream::CLevelStream(void)
+{
+	m_file = 0;
+	memset(&m_header, 0, sizeof(m_header));
+	m_table = LEGO_TABLE;
+	m_budget = 0;
+	m_peakResident = 0;
+	m_prefetch = 2 * LEVEL_CHUNK_DEPTH;
+	m_loads = m_evictions = m_late = m_bad = 0;
+	m_latencySum = m_latencyMax = 0;
+	m_stop = false;
+}
+
+sim::CLevelStream::~CLevelStream(void)
+{
+	close();
+}
+
+bool sim::CLevelStream::fail(const char* what)
+{
+	m_error = what;
+	close();
+	return false;
+}
+
+double sim::CLevelStream::now(void) const
+{
+	std::chrono::duration<double> t = std::chrono::steady_clock::now().time_since_epoch();
+	return t.count();
+}
+
+bool sim::CLevelStream::open(const char* path, size_t budget)
+{
+	close();
+	m_error.clear();
+	m_file = fopen(path, "rb");
+	if (!m_file)
+		return fail("can not open the file");
+
+	ChunkedLevelHeader& h = m_header;
+	if (fread(&h, sizeof(h), 1, m_file) != 1)
+		return fail("file is shorter than a chunked level header");
+	if (h.magic != LEVEL_CHUNKED_MAGIC)
+		return fail("not a chunked level file");
+	if (h.version != LEVEL_CHUNKED_VERSION)
+		return fail("chunked level version is not supported");
+	if (h.colourCount > (uint32_t)LEVEL_MAX_COLOURS || (h.brickCount && !h.colourCount))
+		return fail("bad colour count");
+	if (h.chunkCount < 1 || h.chunkCount > (uint32_t)MAX_CHUNKS || h.maxChunkBricks > (uint32_t)LEVEL_MAX_CHUNK_BRICKS)
+		return fail("bad chunk count");
+	if (!(h.chunkDepth > 0 && h.minX < h.maxX && h.minZ < h.maxZ && (double)h.chunkDepth * h.chunkCount >= (double)h.maxZ - h.minZ))
+		return fail("bad table or chunk depth");
+
+	m_colours.resize(4 * h.colourCount);
+	m_chunks.resize(h.chunkCount);
+	if ((h.colourCount && fread(&m_colours[0], 4 * sizeof(float), h.colourCount, m_file) != h.colourCount) ||
+		fread(&m_chunks[0], sizeof(ChunkEntry), h.chunkCount, m_file) != h.chunkCount)
+		return fail("file is shorter than its chunk table");
+
+	uint64_t size = fileSize(m_file);
+	uint64_t bricks = 0;
+	for (uint32_t c = 0; c < h.chunkCount; c++) {
+		const ChunkEntry& e = m_chunks[c];
+		if (e.brickCount > h.maxChunkBricks || e.offset > size || chunkBytes(e.brickCount) > size - e.offset)
+			return fail("chunk table does not match the file");
+		bricks += e.brickCount;
+	}
+	if (bricks != h.brickCount)
+		return fail("chunk table does not match the brick count");
+
+	m_table = LEGO_TABLE;
+	m_table.minX = h.minX;
+	m_table.maxX = h.maxX;
+	m_table.minZ = h.minZ;
+	m_table.maxZ = h.maxZ;
+
+	// the budget buys whole slots of the largest chunk, more slots than chunks are no use
+	size_t slotBytes = (size_t)chunkBytes(h.maxChunkBricks > 0 ? h.maxChunkBricks : 1);
+	size_t slots = budget / slotBytes;
+	if (slots < 1)
+		return fail("the memory budget does not hold one chunk");
+	if (slots > h.chunkCount)
+		slots = h.chunkCount;
+	m_budget = budget;
+	m_slots.resize(slots);
+	for (size_t s = 0; s < slots; s++) {
+		Slot& slot = m_slots[s];
+		slot.state = SLOT_FREE;
+		slot.chunk = -1;
+		slot.count = 0;
+		slot.pos.resize(2 * (size_t)h.maxChunkBricks + 2);
+		slot.colour.resize((((size_t)h.maxChunkBricks + 3) & ~(size_t)3) + 4);
+		slot.queued = slot.latency = 0;
+		slot.ok = false;
+		slot.fresh = false;
+	}
+	m_chunkState.assign(h.chunkCount, CHUNK_OUT);
+	m_stop = false;
+	m_worker = std::thread(&CLevelStream::workerMain, this);
+	return true;
+}
+
+void sim::CLevelStream::close(void)
+{
+	if (m_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> hold(m_lock);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		m_worker.join();
+	}
+	if (m_file)
+		fclose(m_file);
+	m_file = 0;
+	m_requests.clear();
+	m_done.clear();
+	m_slots.clear();
+	m_chunks.clear();
+	m_chunkState.clear();
+	m_evicted.clear();
+	m_loaded.clear();
+	m_peakResident = 0;
+	m_loads = m_evictions = m_late = m_bad = 0;
+	m_latencySum = m_latencyMax = 0;
+}
+
+size_t sim::CLevelStream::getResidentBytes(void) const
+{
+	size_t bytes = 0;
+	for (int s = 0; s < (int)m_slots.size(); s++)
+		if (m_slots[s].state == SLOT_READY)
+			bytes += (size_t)chunkBytes(m_slots[s].count);
+	return bytes;
+}
+
+int sim::CLevelStream::getResidentChunks(void) const
+{
+	int chunks = 0;
+	for (int s = 0; s < (int)m_slots.size(); s++)
+		chunks += m_slots[s].state == SLOT_READY;
+	return chunks;
+}
+
+float sim::CLevelStream::distanceOutside(int c, float zMin, float zMax) const
+{
+	float lo = chunkMinZ(c), hi = lo + m_header.chunkDepth;
+	if (hi < zMin) return zMin - hi;
+	if (lo > zMax) return lo - zMax;
+	return 0;
+}
+
+void sim::CLevelStream::update(float zMin, float zMax)
+{
+	for (int k = 0; k < (int)m_loaded.size(); k++)
+		m_slots[m_loaded[k]].fresh = false;
+	m_evicted.clear();
+	m_loaded.clear();
+	if (!m_file)
+		return;
+
+	{
+		std::lock_guard<std::mutex> hold(m_lock);
+		m_doneSwap.swap(m_done);
+	}
+	for (int k = 0; k < (int)m_doneSwap.size(); k++) {
+		Slot& slot = m_slots[m_doneSwap[k]];
+		if (slot.ok) {
+			slot.state = SLOT_READY;
+			slot.fresh = true;
+			m_chunkState[slot.chunk] = CHUNK_READY;
+			m_loaded.push_back(m_doneSwap[k]);
+			m_loads++;
+			m_latencySum += slot.latency;
+			if (slot.latency > m_latencyMax)
+				m_latencyMax = slot.latency;
+		}
+		else {
+			m_chunkState[slot.chunk] = CHUNK_BAD;
+			m_bad++;
+			slot.state = SLOT_FREE;
+			slot.chunk = -1;
+		}
+	}
+	m_doneSwap.clear();
+
+	// wanted chunks, the window first and then outwards
+	int c0 = chunkOf(zMin - m_prefetch, m_header);
+	int c1 = chunkOf(zMax + m_prefetch, m_header);
+	m_wanted.clear();
+	for (int c = c0; c <= c1; c++)
+		if (m_chunks[c].brickCount > 0 && m_chunkState[c] != CHUNK_BAD)
+			m_wanted.push_back(c);
+	for (int k = 1; k < (int)m_wanted.size(); k++) {
+		int c = m_wanted[k], j = k;
+		float d = distanceOutside(c, zMin, zMax);
+		for (; j > 0 && distanceOutside(m_wanted[j - 1], zMin, zMax) > d; j--)
+			m_wanted[j] = m_wanted[j - 1];
+		m_wanted[j] = c;
+	}
+
+	int queued = 0;
+	for (int k = 0; k < (int)m_wanted.size(); k++) {
+		int c = m_wanted[k];
+		float d = distanceOutside(c, zMin, zMax);
+		if (d == 0 && m_chunkState[c] != CHUNK_READY)
+			m_late++;
+		if (m_chunkState[c] != CHUNK_OUT)
+			continue;
+
+		// a free slot, or the ready chunk farthest away if it is farther than this one. a chunk
+		// that only just turned ready is in m_loaded and the scene has yet to take it, so it
+		// stays until the next update
+		int slot = -1;
+		float farthest = d;
+		for (int s = 0; s < (int)m_slots.size(); s++) {
+			if (m_slots[s].state == SLOT_FREE) {
+				slot = s;
+				break;
+			}
+			if (m_slots[s].state == SLOT_READY && !m_slots[s].fresh) {
+				float far = distanceOutside(m_slots[s].chunk, zMin, zMax);
+				if (far > farthest) {
+					farthest = far;
+					slot = s;
+				}
+			}
+		}
+		if (slot < 0)
+			continue;
+
+		Slot& s = m_slots[slot];
+		if (s.state == SLOT_READY) {
+			m_chunkState[s.chunk] = CHUNK_OUT;
+			m_evicted.push_back(slot);
+			m_evictions++;
+		}
+		s.state = SLOT_LOADING;
+		s.chunk = c;
+		s.queued = now();
+		m_chunkState[c] = CHUNK_LOADING;
+		{
+			std::lock_guard<std::mutex> hold(m_lock);
+			m_requests.push_back(slot);
+		}
+		queued++;
+	}
+	if (queued)
+		m_wake.notify_one();
+
+	size_t resident = getResidentBytes();
+	if (resident > m_peakResident)
+		m_peakResident = resident;
+}
+
+void sim::CLevelStream::workerMain(void)
+{
+	for (;;) {
+		int slot;
+		{
+			std::unique_lock<std::mutex> hold(m_lock);
+			while (!m_stop && m_requests.empty())
+				m_wake.wait(hold);
+			if (m_stop)
+				return;
+			slot = m_requests.front();
+			m_requests.pop_front();
+		}
+
+		// the slot belongs to this thread until it is handed back through m_done
+		Slot& s = m_slots[slot];
+		s.ok = readChunk(s);
+		s.latency = now() - s.queued;
+		std::lock_guard<std::mutex> hold(m_lock);
+		m_done.push_back(slot);
+	}
+}
+
+bool sim::CLevelStream::readChunk(Slot& slot)
+{
+	const ChunkEntry& e = m_chunks[slot.chunk];
+	int n = (int)e.brickCount;
+	slot.count = n;
+	if (!seekTo(m_file, e.offset) ||
+		fread(&slot.pos[0], 2 * sizeof(float), n, m_file) != (size_t)n ||
+		fread(&slot.colour[0], 1, n, m_file) != (size_t)n)
+		return false;
+
+	// the whole level was checked when it was written, a chunk is checked on its own here:
+	// every brick in its band and on the table, no overlap inside the band
+	const float (*pos)[2] = (const float (*)[2])&slot.pos[0];
+	for (int i = 0; i < n; i++) {
+		if (slot.colour[i] >= m_header.colourCount || chunkOf(pos[i][1], m_header) != slot.chunk)
+			return false;
+	}
+	std::string error;
+	return checkLevel(pos, n, m_table, error);
+}
@@ -0,0 +1,179 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: levelStream.h
+//
+// Desc: Levels too long to keep in memory, streamed in chunks around the camera.
+//
+//       A chunked level (.lvs) cuts the table into bands of chunkDepth along z. The file holds
+//       a ChunkedLevelHeader, the colours, one ChunkEntry per band and then the bricks of each
+//       band: (x, z) pairs followed by the colour indices, padded to 4 bytes.
+//
+//       CLevelStream keeps a fixed number of slots, as many chunks of the largest size as the
+//       memory budget holds. update() runs on the game thread once per frame: it takes the
+//       chunks the I/O thread has finished, evicts the ones farthest outside the window when
+//       a wanted chunk needs a slot, and queues the window and the prefetch distance around it
+//       nearest first. It never waits for the disk, a chunk that is late is simply not there
+//       yet, and is counted.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __levelStreamH__
+#define __levelStreamH__
+
+#include "levelFile.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace sim
+{
+	const uint32_t LEVEL_CHUNKED_MAGIC   = 0x4b48434c;   // "LCHK" read as little endian bytes
+	const uint32_t LEVEL_CHUNKED_VERSION = 1;
+	const float    LEVEL_CHUNK_DEPTH     = 16.0f;        // default band depth along z
+	const int      LEVEL_MAX_CHUNK_BRICKS = 1 << 20;
+
+	struct ChunkedLevelHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t brickCount;
+		uint32_t colourCount;
+		uint32_t chunkCount;
+		uint32_t maxChunkBricks;
+		float    chunkDepth;     // band c holds the bricks with minZ + c * depth <= z < minZ + (c + 1) * depth
+		uint32_t reserved;
+		float    minX, maxX;
+		float    minZ, maxZ;
+	};
+
+	struct ChunkEntry
+	{
+		uint64_t offset;         // from the start of the file
+		uint32_t brickCount;
+		uint32_t reserved;
+	};
+
+	// the whole level is checked (see checkLevel) before it is cut into chunks
+	bool writeLevelChunked(const char* path, const LevelData& level, float chunkDepth, std::string& error);
+	bool isLevelChunkedPath(const char* path);
+
+	// -----------------------------------------------------------------------------
+	// CLevelStream
+	// -----------------------------------------------------------------------------
+
+	class CLevelStream {
+	public:
+		CLevelStream(void);
+		~CLevelStream(void);
+
+		// reads the header and the chunk table and starts the I/O thread. budget is the number
+		// of bytes of brick data kept resident, at least one chunk of the largest size
+		bool open(const char* path, size_t budget);
+		void close(void);
+		bool isOpen(void) const { return m_file != 0; }
+		const std::string& getError(void) const { return m_error; }
+
+		// chunks this far outside the window are loaded too, ahead of time
+		void setPrefetch(float distance) { m_prefetch = distance; }
+
+		// game thread, once per frame with the z range that is played and drawn
+		void update(float zMin, float zMax);
+
+		// slots emptied and filled by the last update. the evicted ones should be cleared from
+		// the scene before the loaded ones are put in. a slot is never in both
+		const std::vector<int>& getEvicted(void) const { return m_evicted; }
+		const std::vector<int>& getLoaded(void) const { return m_loaded; }
+
+		int   getSlotCount(void) const { return (int)m_slots.size(); }
+		int   getSlotCapacity(void) const { return (int)m_header.maxChunkBricks; }
+		int   getSlotChunk(int slot) const { return m_slots[slot].chunk; }
+		int   getSlotBrickCount(int slot) const { return m_slots[slot].count; }
+		const float (*getSlotBrickPos(int slot) const)[2] { return (const float (*)[2])&m_slots[slot].pos[0]; }
+		const uint8_t* getSlotBrickColours(int slot) const { return &m_slots[slot].colour[0]; }
+
+		const TableDesc& getTable(void) const { return m_table; }
+		const float* getColour(int c) const { return &m_colours[4 * c]; }
+		int   getChunkCount(void) const { return (int)m_chunks.size(); }
+		float getChunkDepth(void) const { return m_header.chunkDepth; }
+
+		// resident brick data in bytes, now and at most since open, and the memory budget
+		size_t getResidentBytes(void) const;
+		size_t getPeakResidentBytes(void) const { return m_peakResident; }
+		size_t getBudget(void) const { return m_budget; }
+		int    getResidentChunks(void) const;
+
+		// time from queueing a chunk to it being ready, in seconds
+		long   getLoadCount(void) const { return m_loads; }
+		long   getEvictionCount(void) const { return m_evictions; }
+		double getMeanLatency(void) const { return m_loads ? m_latencySum / m_loads : 0; }
+		double getMaxLatency(void) const { return m_latencyMax; }
+
+		// window chunks found missing by update, summed over the calls. each is a frame a part
+		// of the level was not there yet
+		long   getLateCount(void) const { return m_late; }
+		long   getBadChunkCount(void) const { return m_bad; }
+
+	private:
+		enum SlotState { SLOT_FREE, SLOT_LOADING, SLOT_READY };
+		enum ChunkState { CHUNK_OUT, CHUNK_LOADING, CHUNK_READY, CHUNK_BAD };
+
+		struct Slot
+		{
+			SlotState				state;
+			int						chunk;
+			int						count;
+			std::vector<float>		pos;
+			std::vector<uint8_t>	colour;
+			double					queued;   // seconds, on the stream clock
+			double					latency;
+			bool					ok;
+			bool					fresh;    // turned ready by this update, not to be evicted by it
+		};
+
+		CLevelStream(const CLevelStream&);
+		CLevelStream& operator=(const CLevelStream&);
+
+		bool   fail(const char* what);
+		void   workerMain(void);
+		bool   readChunk(Slot& slot);
+		double now(void) const;
+		float  chunkMinZ(int c) const { return m_table.minZ + c * m_header.chunkDepth; }
+		float  distanceOutside(int c, float zMin, float zMax) const;
+
+		FILE*					m_file;
+		ChunkedLevelHeader		m_header;
+		TableDesc				m_table;
+		std::vector<float>		m_colours;
+		std::vector<ChunkEntry>	m_chunks;
+		std::vector<uint8_t>	m_chunkState;
+		std::vector<Slot>		m_slots;
+		size_t					m_budget;
+		size_t					m_peakResident;
+		float					m_prefetch;
+		std::string				m_error;
+
+		std::vector<int>		m_evicted;
+		std::vector<int>		m_loaded;
+		std::vector<int>		m_wanted;
+
+		long					m_loads;
+		long					m_evictions;
+		long					m_late;
+		long					m_bad;
+		double					m_latencySum;
+		double					m_latencyMax;
+
+		// slots queued for the I/O thread and slots it has finished, both under m_lock
+		std::mutex				m_lock;
+		std::condition_variable	m_wake;
+		std::deque<int>			m_requests;
+		std::vector<int>		m_done;
+		std::vector<int>		m_doneSwap;
+		bool					m_stop;
+		std::thread				m_worker;
+	};
+}
+
+#endif // __levelStreamH__
@@ -0,0 +1,118 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: overlapKernel.cpp
+//
+// Desc: Scalar, SSE (4 candidates per compare) and AVX2 (8 per compare) overlap kernels.
+//       All of them compare squared distances, no sqrt anywhere, and round the same way so
+//       every path reports the same hits.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "overlapKernel.h"
+#include "simdSupport.h"
+#include <string.h>
+
+int sim::overlapBatchScalar(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	float r2 = radiusSum * radiusSum;
+	int hits = 0;
+	for (int w = 0; w < overlapMaskWords(count); w++) {
+		uint64_t bits = 0;
+		int first = w * 64;
+		int last = first + 64 < count ? first + 64 : count;
+		for (int i = first; i < last; i++) {
+			float dx = xs[i] - x;
+			float dz = zs[i] - z;
+			bits |= (uint64_t)(dx * dx + dz * dz < r2) << (i - first);
+		}
+		mask[w] = bits;
+		hits += popCount64(bits);
+	}
+	return hits;
+}
+
+#if defined(SIM_X86)
+
+int sim::overlapBatchSSE(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	memset(mask, 0, overlapMaskWords(count) * sizeof(uint64_t));
+
+	__m128 px = _mm_set1_ps(x);
+	__m128 pz = _mm_set1_ps(z);
+	__m128 r2 = _mm_set1_ps(radiusSum * radiusSum);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), px);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(zs + i), pz);
+		__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+		uint64_t bits = (uint64_t)_mm_movemask_ps(_mm_cmplt_ps(d2, r2));
+		mask[i >> 6] |= bits << (i & 63);
+	}
+	for (; i < count; i++) {
+		float dx = xs[i] - x;
+		float dz = zs[i] - z;
+		mask[i >> 6] |= (uint64_t)(dx * dx + dz * dz < radiusSum * radiusSum) << (i & 63);
+	}
+
+	int hits = 0;
+	for (int w = 0; w < overlapMaskWords(count); w++)
+		hits += popCount64(mask[w]);
+	return hits;
+}
+
+SIM_TARGET_AVX2
+int sim::overlapBatchAVX2(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	memset(mask, 0, overlapMaskWords(count) * sizeof(uint64_t));
+
+	__m256 px = _mm256_set1_ps(x);
+	__m256 pz = _mm256_set1_ps(z);
+	__m256 r2 = _mm256_set1_ps(radiusSum * radiusSum);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(xs + i), px);
+		__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(zs + i), pz);
+		__m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz));
+		uint64_t bits = (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(d2, r2, _CMP_LT_OQ));
+		mask[i >> 6] |= bits << (i & 63);
+	}
+	for (; i < count; i++) {
+		float dx = xs[i] - x;
+		float dz = zs[i] - z;
+		mask[i >> 6] |= (uint64_t)(dx * dx + dz * dz < radiusSum * radiusSum) << (i & 63);
+	}
+
+	int hits = 0;
+	for (int w = 0; w < overlapMaskWords(count); w++)
+		hits += popCount64(mask[w]);
+	return hits;
+}
+
+#else
+
+int sim::overlapBatchSSE(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	return overlapBatchScalar(x, z, radiusSum, xs, zs, count, mask);
+}
+
+int sim::overlapBatchAVX2(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	return overlapBatchScalar(x, z, radiusSum, xs, zs, count, mask);
+}
+
+#endif
+
+int sim::overlapBatch(float x, float z, float radiusSum,
+	const float* xs, const float* zs, int count, uint64_t* mask)
+{
+	switch (getSimdPath()) {
+	case SIMD_AVX2: return overlapBatchAVX2(x, z, radiusSum, xs, zs, count, mask);
+	case SIMD_SSE:  return overlapBatchSSE(x, z, radiusSum, xs, zs, count, mask);
+	default:        return overlapBatchScalar(x, z, radiusSum, xs, zs, count, mask);
+	}
+}
@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: overlapKernel.h
+//
+// Desc: One ball against many: batched circle overlap on packed x / z arrays.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __overlapKernelH__
+#define __overlapKernelH__
+
+#include <stdint.h>
+
+namespace sim
+{
+	// words of hit mask needed for count candidates
+	inline int overlapMaskWords(int count) { return (count + 63) / 64; }
+
+	// bit i of mask[i / 64] is set when candidate i is closer than radiusSum to (x, z).
+	// mask must hold overlapMaskWords(count) words, they are overwritten. returns the hit count
+	int overlapBatch(float x, float z, float radiusSum,
+		const float* xs, const float* zs, int count, uint64_t* mask);
+
+	// the individual paths, overlapBatch picks the widest one getSimdPath() allows
+	int overlapBatchScalar(float x, float z, float radiusSum,
+		const float* xs, const float* zs, int count, uint64_t* mask);
+	int overlapBatchSSE(float x, float z, float radiusSum,
+		const float* xs, const float* zs, int count, uint64_t* mask);
+	int overlapBatchAVX2(float x, float z, float radiusSum,
+		const float* xs, const float* zs, int count, uint64_t* mask);
+}
+
+#endif // __overlapKernelH__
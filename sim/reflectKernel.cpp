@@ -0,0 +1,90 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: reflectKernel.cpp
+//
+// Desc: Scalar, SSE (4 contacts at a time) and AVX2 (8 at a time) reflection kernels.
+//       The vector paths do the same operations in the same order as reflectOffSphere, with
+//       min / max in place of its selects, so every path rounds the same way.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "reflectKernel.h"
+#include "simdSupport.h"
+
+void sim::reflectBatchScalar(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	for (int i = 0; i < count; i++)
+		reflectOffSphere(px[i], pz[i], ox[i], oz[i], vx[i], vz[i]);
+}
+
+#if defined(SIM_X86)
+
+void sim::reflectBatchSSE(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 minDist2 = _mm_set1_ps(REFLECT_MIN_DIST2);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 nx = _mm_sub_ps(_mm_loadu_ps(px + i), _mm_loadu_ps(ox + i));
+		__m128 nz = _mm_sub_ps(_mm_loadu_ps(pz + i), _mm_loadu_ps(oz + i));
+		__m128 x = _mm_loadu_ps(vx + i);
+		__m128 z = _mm_loadu_ps(vz + i);
+		__m128 vn = _mm_add_ps(_mm_mul_ps(x, nx), _mm_mul_ps(z, nz));
+		__m128 n2 = _mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz));
+		__m128 k = _mm_div_ps(_mm_mul_ps(two, _mm_min_ps(vn, zero)), _mm_max_ps(n2, minDist2));
+		_mm_storeu_ps(vx + i, _mm_sub_ps(x, _mm_mul_ps(k, nx)));
+		_mm_storeu_ps(vz + i, _mm_sub_ps(z, _mm_mul_ps(k, nz)));
+	}
+	reflectBatchScalar(px + i, pz + i, ox + i, oz + i, vx + i, vz + i, count - i);
+}
+
+SIM_TARGET_AVX2
+void sim::reflectBatchAVX2(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	__m256 zero = _mm256_setzero_ps();
+	__m256 two = _mm256_set1_ps(2.0f);
+	__m256 minDist2 = _mm256_set1_ps(REFLECT_MIN_DIST2);
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 nx = _mm256_sub_ps(_mm256_loadu_ps(px + i), _mm256_loadu_ps(ox + i));
+		__m256 nz = _mm256_sub_ps(_mm256_loadu_ps(pz + i), _mm256_loadu_ps(oz + i));
+		__m256 x = _mm256_loadu_ps(vx + i);
+		__m256 z = _mm256_loadu_ps(vz + i);
+		__m256 vn = _mm256_add_ps(_mm256_mul_ps(x, nx), _mm256_mul_ps(z, nz));
+		__m256 n2 = _mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(nz, nz));
+		__m256 k = _mm256_div_ps(_mm256_mul_ps(two, _mm256_min_ps(vn, zero)), _mm256_max_ps(n2, minDist2));
+		_mm256_storeu_ps(vx + i, _mm256_sub_ps(x, _mm256_mul_ps(k, nx)));
+		_mm256_storeu_ps(vz + i, _mm256_sub_ps(z, _mm256_mul_ps(k, nz)));
+	}
+	reflectBatchScalar(px + i, pz + i, ox + i, oz + i, vx + i, vz + i, count - i);
+}
+
+#else
+
+void sim::reflectBatchSSE(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	reflectBatchScalar(px, pz, ox, oz, vx, vz, count);
+}
+
+void sim::reflectBatchAVX2(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	reflectBatchScalar(px, pz, ox, oz, vx, vz, count);
+}
+
+#endif
+
+void sim::reflectBatch(const float* px, const float* pz, const float* ox, const float* oz,
+	float* vx, float* vz, int count)
+{
+	switch (getSimdPath()) {
+	case SIMD_AVX2: reflectBatchAVX2(px, pz, ox, oz, vx, vz, count); break;
+	case SIMD_SSE:  reflectBatchSSE(px, pz, ox, oz, vx, vz, count); break;
+	default:        reflectBatchScalar(px, pz, ox, oz, vx, vz, count); break;
+	}
+}
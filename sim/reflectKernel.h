@@ -0,0 +1,46 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: reflectKernel.h
+//
+// Desc: Bounce of a moving ball off a fixed sphere (a brick or the holder), without angles.
+//       With n the vector from the obstacle's center to the ball's, the velocity is mirrored
+//       about the contact plane:  v' = v - 2 * min(v.n, 0) / (n.n) * n
+//       A ball already moving away keeps its velocity, the speed never changes, and there is no
+//       branch, sqrt or trig in it, so batches of contacts run four or eight at a time.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __reflectKernelH__
+#define __reflectKernelH__
+
+namespace sim
+{
+	// n.n never gets below this, so concentric centers keep their velocity instead of NaN
+	const float REFLECT_MIN_DIST2 = 1e-12f;
+
+	inline void reflectOffSphere(float px, float pz, float ox, float oz, float& vx, float& vz)
+	{
+		float nx = px - ox, nz = pz - oz;
+		float vn = vx * nx + vz * nz;
+		float n2 = nx * nx + nz * nz;
+		float k = 2 * (vn < 0 ? vn : 0) / (n2 > REFLECT_MIN_DIST2 ? n2 : REFLECT_MIN_DIST2);
+		vx -= k * nx;
+		vz -= k * nz;
+	}
+
+	// contact i: ball at (px[i], pz[i]) with velocity (vx[i], vz[i]) against an obstacle at
+	// (ox[i], oz[i]). the velocities are updated in place
+	void reflectBatch(const float* px, const float* pz, const float* ox, const float* oz,
+		float* vx, float* vz, int count);
+
+	// the individual paths, reflectBatch picks the widest one getSimdPath() allows.
+	// all of them give the same bits
+	void reflectBatchScalar(const float* px, const float* pz, const float* ox, const float* oz,
+		float* vx, float* vz, int count);
+	void reflectBatchSSE(const float* px, const float* pz, const float* ox, const float* oz,
+		float* vx, float* vz, int count);
+	void reflectBatchAVX2(const float* px, const float* pz, const float* ox, const float* oz,
+		float* vx, float* vz, int count);
+}
+
+#endif // __reflectKernelH__
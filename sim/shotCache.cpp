@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotCache.cpp
+//
+// Desc: Sharded LRU memo of shot outcomes.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "shotCache.h"
+#include <cmath>
+
+static int32_t toCell(float v)
+{
+	return (int32_t)floorf(v / sim::SHOT_CACHE_QUANTUM + 0.5f);
+}
+
+static float fromCell(int32_t c)
+{
+	return c * sim::SHOT_CACHE_QUANTUM;
+}
+
+sim::CShotCache::CShotCache(int capacity)
+	: m_hits(0), m_misses(0), m_evictions(0)
+{
+	m_capacity = capacity > 0 ? capacity : 1;
+	for (int s = 0; s < SHOT_CACHE_SHARDS; s++) {
+		m_shards[s].capacity = m_capacity / SHOT_CACHE_SHARDS + (s < m_capacity % SHOT_CACHE_SHARDS);
+		m_shards[s].inserts = 0;
+	}
+}
+
+void sim::CShotCache::makeKey(const std::vector<CBall>& balls, int cue, float vx, float vz, ShotKey& key)
+{
+	key.cells.resize(3 + 4 * balls.size());
+	key.cells[0] = cue;
+	key.cells[1] = toCell(vx);
+	key.cells[2] = toCell(vz);
+	for (int i = 0; i < (int)balls.size(); i++) {
+		Vec3 c = balls[i].getCenter();
+		int32_t* cell = &key.cells[3 + 4 * i];
+		cell[0] = toCell(c.x);
+		cell[1] = toCell(c.z);
+		cell[2] = toCell(balls[i].getVelocity_X());
+		cell[3] = toCell(balls[i].getVelocity_Z());
+	}
+
+	// FNV-1a over the cells, then a final mix so the shard bits see every cell
+	uint64_t h = 14695981039346656037ull;
+	for (int i = 0; i < (int)key.cells.size(); i++) {
+		h ^= (uint32_t)key.cells[i];
+		h *= 1099511628211ull;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	key.hash = h;
+}
+
+void sim::CShotCache::snap(const ShotKey& key, float& vx, float& vz)
+{
+	vx = fromCell(key.cells[1]);
+	vz = fromCell(key.cells[2]);
+}
+
+void sim::CShotCache::snap(const ShotKey& key, std::vector<CBall>& balls)
+{
+	for (int i = 0; i < (int)balls.size(); i++) {
+		const int32_t* cell = &key.cells[3 + 4 * i];
+		Vec3 c = balls[i].getCenter();
+		balls[i].setCenter(fromCell(cell[0]), c.y, fromCell(cell[1]));
+		balls[i].setPower(fromCell(cell[2]), fromCell(cell[3]));
+	}
+}
+
+bool sim::CShotCache::find(const ShotKey& key, ShotOutcome& outcome)
+{
+	Shard& shard = shardOf(key.hash);
+	{
+		std::lock_guard<std::mutex> guard(shard.lock);
+		std::unordered_map<uint64_t, EntryList::iterator>::iterator it = shard.index.find(key.hash);
+		if (it != shard.index.end() && it->second->key.cells == key.cells) {
+			shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+			outcome = it->second->outcome;
+			m_hits++;
+			return true;
+		}
+	}
+	m_misses++;
+	return false;
+}
+
+void sim::CShotCache::insert(const ShotKey& key, const ShotOutcome& outcome)
+{
+	Shard& shard = shardOf(key.hash);
+	std::lock_guard<std::mutex> guard(shard.lock);
+
+	// another thread may have played the same key meanwhile, or a different key shares the hash
+	std::unordered_map<uint64_t, EntryList::iterator>::iterator it = shard.index.find(key.hash);
+	if (it != shard.index.end()) {
+		it->second->key = key;
+		it->second->outcome = outcome;
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		return;
+	}
+
+	if (shard.capacity == 0)
+		return;   // a cache smaller than SHOT_CACHE_SHARDS leaves some shards without room
+	if ((int)shard.entries.size() >= shard.capacity) {
+		shard.index.erase(shard.entries.back().key.hash);
+		shard.entries.pop_back();
+		m_evictions++;
+	}
+	Entry entry;
+	entry.key = key;
+	entry.outcome = outcome;
+	if (shard.inserts++ % SHOT_CACHE_PROMOTE_EVERY == 0) {
+		shard.entries.push_front(entry);
+		shard.index[key.hash] = shard.entries.begin();
+	}
+	else {
+		shard.entries.push_back(entry);
+		shard.index[key.hash] = --shard.entries.end();
+	}
+}
+
+void sim::CShotCache::clear(void)
+{
+	for (int s = 0; s < SHOT_CACHE_SHARDS; s++) {
+		std::lock_guard<std::mutex> guard(m_shards[s].lock);
+		m_shards[s].entries.clear();
+		m_shards[s].index.clear();
+		m_shards[s].inserts = 0;
+	}
+	m_hits = 0;
+	m_misses = 0;
+	m_evictions = 0;
+}
+
+int sim::CShotCache::getSize(void) const
+{
+	// a rough figure for reporting, read without the shard locks
+	int size = 0;
+	for (int s = 0; s < SHOT_CACHE_SHARDS; s++)
+		size += (int)m_shards[s].entries.size();
+	return size;
+}
@@ -0,0 +1,106 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotCache.h
+//
+// Desc: Memo of played shots. Ball positions, ball velocities and the shot are snapped to a fine
+//       grid and hashed, and the outcome of the snapped shot (where every ball comes to rest and
+//       which balls touched) is kept under that key. A search that tries the same shot on the
+//       same table again gets the outcome back in microseconds.
+//
+//       Callers play the snapped state, not the one they were given, so an outcome depends on
+//       its key alone and a cached answer is the same as a fresh one.
+//
+//       Entries live in shards, each with its own lock and least recently used order, so the
+//       threads of a search rarely wait on each other.
+//
+//       A search walks the same candidates from the first one every time, so with more samples
+//       than capacity plain LRU would evict each outcome just before it is asked for again. New
+//       outcomes therefore go in at the least recently used end, and only every
+//       SHOT_CACHE_PROMOTE_EVERY'th at the front: a scan keeps the entries it found first and
+//       the ones it hits, while outcomes of a table no longer played still age out.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __shotCacheH__
+#define __shotCacheH__
+
+#include "simCore.h"
+#include "eventSim.h"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace sim
+{
+	const float SHOT_CACHE_QUANTUM  = 1.0f / 1024;   // grid for positions, velocities and the shot
+	const int   SHOT_CACHE_CAPACITY = 1 << 16;       // outcomes kept by default
+	const int   SHOT_CACHE_SHARDS   = 16;
+	const int   SHOT_CACHE_PROMOTE_EVERY = 32;       // inserts per shard that go in at the front
+
+	struct ShotKey
+	{
+		std::vector<int32_t> cells;   // cue, shot, then x, z, vx, vz of every ball, in grid cells
+		uint64_t             hash;
+	};
+
+	struct ShotOutcome
+	{
+		std::vector<Vec3>        rest;       // where every ball stops
+		std::vector<BallContact> contacts;
+	};
+
+	class CShotCache {
+	public:
+		explicit CShotCache(int capacity = SHOT_CACHE_CAPACITY);
+
+		// key of the table and shot, and the snapped state a miss has to play
+		static void makeKey(const std::vector<CBall>& balls, int cue, float vx, float vz, ShotKey& key);
+		static void snap(const ShotKey& key, float& vx, float& vz);
+		static void snap(const ShotKey& key, std::vector<CBall>& balls);
+
+		// safe to call from several threads at once
+		bool find(const ShotKey& key, ShotOutcome& outcome);
+		void insert(const ShotKey& key, const ShotOutcome& outcome);
+		void clear(void);
+
+		long getHits(void) const { return m_hits; }
+		long getMisses(void) const { return m_misses; }
+		long getEvictions(void) const { return m_evictions; }
+		int  getSize(void) const;
+		int  getCapacity(void) const { return m_capacity; }
+
+	private:
+		struct Entry
+		{
+			ShotKey     key;
+			ShotOutcome outcome;
+		};
+
+		typedef std::list<Entry> EntryList;
+
+		struct Shard
+		{
+			std::mutex	lock;
+			int			capacity;  // the shards' capacities add up to the cache's
+			int			inserts;
+			EntryList	entries;   // most recently used first
+			std::unordered_map<uint64_t, EntryList::iterator> index;
+		};
+
+		CShotCache(const CShotCache&);
+		CShotCache& operator=(const CShotCache&);
+
+		Shard& shardOf(uint64_t hash) { return m_shards[hash >> 60 & (SHOT_CACHE_SHARDS - 1)]; }
+
+		Shard				m_shards[SHOT_CACHE_SHARDS];
+		int					m_capacity;
+		std::atomic<long>	m_hits;
+		std::atomic<long>	m_misses;
+		std::atomic<long>	m_evictions;
+	};
+}
+
+#endif // __shotCacheH__
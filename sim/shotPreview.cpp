@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotPreview.cpp
+//
+// Desc: Multi bounce aim line, traced with BVH sphere casts.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "shotPreview.h"
+#include "reflectKernel.h"
+#include <cfloat>
+#include <cmath>
+
+sim::CShotPreview::CShotPreview(void)
+{
+	m_table = LEGO_TABLE;
+	m_wallCount = 0;
+	m_rule = PREVIEW_MIRROR;
+	m_count = 0;
+	m_length = 0;
+}
+
+void sim::CShotPreview::setTable(const TableDesc& table, const CWall* walls, int wallCount)
+{
+	m_table = table;
+	m_wallCount = wallCount < 4 ? wallCount : 4;
+	for (int i = 0; i < m_wallCount; i++)
+		m_walls[i] = walls[i];
+}
+
+void sim::CShotPreview::addPoint(const Vec3& p, int item)
+{
+	m_points[m_count] = p;
+	m_items[m_count] = item;
+	m_count++;
+}
+
+int sim::CShotPreview::trace(const CBvh& bvh, const Vec3& start, float vx, float vz, int bounces,
+	float maxLength, int ignore)
+{
+	m_count = 0;
+	m_length = 0;
+	addPoint(start, -1);
+	if (bounces > PREVIEW_MAX_BOUNCES)
+		bounces = PREVIEW_MAX_BOUNCES;
+
+	// on cloth the speed drops by the same amount per distance whatever the speed, ballUpdate's
+	// exp(-FRICTION t) over a path of timeScale * v dt
+	float perDistance = m_table.friction ? FRICTION / m_table.timeScale : 0;
+	Vec3 p = start;
+	for (int contacts = 0; ; contacts++) {
+		float speed = sqrtf(vx * vx + vz * vz);
+		float axis = fmaxf(fabsf(vx), fabsf(vz));
+		if (axis <= STOP_SPEED)
+			break;
+
+		// to where the faster axis drops to STOP_SPEED, the rest test of ballUpdate
+		float left = maxLength - m_length;
+		if (perDistance > 0)
+			left = fminf(left, speed * (1 - STOP_SPEED / axis) / perDistance);
+		if (!(left > 0))
+			break;
+		Vec3 dir = { vx / speed, 0, vz / speed };
+		Vec3 d = dir * left;
+
+		// the first of a cushion, the edge where there is none, and a sphere
+		float first = 1;
+		int wall = -1, item = -1;
+		float t;
+		for (int i = 0; i < m_wallCount; i++) {
+			if (m_walls[i].sweep(p, d, BALL_RADIUS, t) && t < first) {
+				first = t;
+				wall = i;
+			}
+		}
+		float edgeX = d.x > 0 ? (m_table.maxX - p.x) / d.x : (d.x < 0 ? (m_table.minX - p.x) / d.x : FLT_MAX);
+		float edgeZ = d.z > 0 ? (m_table.maxZ - p.z) / d.z : (d.z < 0 ? (m_table.minZ - p.z) / d.z : FLT_MAX);
+		float edge = fmaxf(fminf(edgeX, edgeZ), 0.0f);
+		if (edge < first) {
+			first = edge;
+			wall = -1;
+		}
+		Ray ray = { p, dir };
+		RayHit hit = bvh.cast(ray, BALL_RADIUS, first * left, ignore);
+		if (hit.item >= 0) {
+			first = hit.t / left;
+			wall = -1;
+			item = hit.item;
+		}
+
+		p = p + d * first;
+		m_length += left * first;
+		if (perDistance > 0) {
+			float slower = (speed - perDistance * left * first) / speed;
+			vx *= slower;
+			vz *= slower;
+		}
+		if (wall < 0 && item < 0) {
+			addPoint(p, -1);   // at rest, off the table or out of length
+			break;
+		}
+		addPoint(p, item);
+		if (contacts == bounces)
+			break;
+
+		if (item >= 0) {
+			Vec3 c = bvh.getCenter(item);
+			if (m_rule == PREVIEW_MIRROR) {
+				reflectOffSphere(p.x, p.z, c.x, c.z, vx, vz);
+			}
+			else {
+				float nx = c.x - p.x, nz = c.z - p.z;
+				float dist = sqrtf(nx * nx + nz * nz);
+				float approach = dist > 0 ? (vx * nx + vz * nz) / dist : 0;
+				if (approach > 0) {
+					vx -= approach * nx / dist;
+					vz -= approach * nz / dist;
+				}
+			}
+		}
+		else {
+			// CWall::hitBy, the component into the cushion turned round
+			const CWall& w = m_walls[wall];
+			if (w.getAxis() == 0 && vx * w.getNormal() < 0) vx = -vx;
+			if (w.getAxis() != 0 && vz * w.getNormal() < 0) vz = -vz;
+		}
+	}
+	return m_count;
+}
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotPreview.h
+//
+// Desc: Predicted path of a shot before it is fired, for the aim line the games draw while the
+//       mouse moves. The ball is cast along its velocity against the cushions and the spheres of
+//       a CBvh, bounced by the same rules the scenes step with, and cast again, up to
+//       PREVIEW_MAX_BOUNCES times. The points live in fixed arrays inside the preview, so a
+//       trace never allocates and costs a few casts, whatever the size of the level.
+//
+//       The spheres stay where they are: a brick the path hits is not taken out, and a ball the
+//       cue ball hits does not move off, so a path that comes back to one meets it again.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __shotPreviewH__
+#define __shotPreviewH__
+
+#include "bvh.h"
+#include "simCore.h"
+
+namespace sim
+{
+	const int   PREVIEW_MAX_BOUNCES = 8;
+	const float PREVIEW_MAX_LENGTH  = 60.0f;   // a path without friction is cut here
+
+	enum PreviewRule {
+		PREVIEW_MIRROR,   // CBrick / CHolderBall::hitBy, the velocity mirrored about the contact plane
+		PREVIEW_CUE       // CBall::hitBy on a ball at rest, the part along the normal goes to it
+	};
+
+	// -----------------------------------------------------------------------------
+	// CShotPreview
+	// -----------------------------------------------------------------------------
+
+	class CShotPreview {
+	public:
+		CShotPreview(void);
+
+		// the cushions the path bounces off, the scenes' getWalls. where there is none the path
+		// ends at the edge of the table
+		void setTable(const TableDesc& table, const CWall* walls, int wallCount);
+		void setRule(PreviewRule rule) { m_rule = rule; }
+
+		// the ball at start shot with (vx, vz), as the scenes' shoot takes it. on a table with
+		// friction the path ends where the ball comes to rest, otherwise after maxLength.
+		// ignore is the bvh item of the ball itself, -1 when it is not in there.
+		// returns the number of points
+		int  trace(const CBvh& bvh, const Vec3& start, float vx, float vz, int bounces = PREVIEW_MAX_BOUNCES,
+			float maxLength = PREVIEW_MAX_LENGTH, int ignore = -1);
+
+		// start, each contact and the end. the item hit at a point, -1 for a cushion, the start
+		// and the end
+		int         getPointCount(void) const { return m_count; }
+		const Vec3& getPoint(int k) const { return m_points[k]; }
+		int         getItem(int k) const { return m_items[k]; }
+		float       getLength(void) const { return m_length; }
+
+	private:
+		void addPoint(const Vec3& p, int item);
+
+		TableDesc	m_table;
+		CWall		m_walls[4];
+		int			m_wallCount;
+		PreviewRule	m_rule;
+
+		Vec3		m_points[PREVIEW_MAX_BOUNCES + 2];
+		int			m_items[PREVIEW_MAX_BOUNCES + 2];
+		int			m_count;
+		float		m_length;
+	};
+}
+
+#endif // __shotPreviewH__
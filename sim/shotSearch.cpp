@@ -0,0 +1,180 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotSearch.cpp
+//
+// Desc: Parallel billiard shot search.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "shotSearch.h"
+#include "eventSim.h"
+#include <chrono>
+#include <cmath>
+
+sim::ShotSearchDesc::ShotSearchDesc(void)
+{
+	cue = 3;
+	targets[0] = 0;
+	targets[1] = 1;
+	foul = 2;
+	minPower = 0.5f;
+	maxPower = 5.0f;
+	samples = 100000;
+	budget = 0.05;
+	deterministic = false;
+	seed = 0;
+}
+
+sim::CShotSearch::CShotSearch(int threads)
+	: m_pool(threads)
+{
+	m_table = BILLIARD_TABLE;
+	m_cache = 0;
+}
+
+void sim::CShotSearch::setTable(const TableDesc& table)
+{
+	m_table = table;
+}
+
+void sim::CShotSearch::sample(const ShotSearchDesc& desc, long i, float& angle, float& power)
+{
+	// R2 sequence: evenly spread over (angle, power) for any prefix of it
+	double u = desc.seed + 0.7548776662466927 * (i + 1);
+	double v = desc.seed * 0.5 + 0.5698402909980532 * (i + 1);
+	u -= floor(u);
+	v -= floor(v);
+	angle = (float)(2 * PI * u);
+	power = (float)(desc.minPower + (desc.maxPower - desc.minPower) * v);
+}
+
+void sim::CShotSearch::play(const std::vector<CBall>& balls, int cue, float vx, float vz, ShotOutcome& outcome) const
+{
+	CEventBilliard table;
+	table.setTable(m_table);
+	table.load(balls);
+	table.shoot(cue, vx, vz);
+
+	// the table is still once the cue has stopped: no ball gets faster than it was struck
+	double speed = sqrt((double)vx * vx + (double)vz * vz);
+	double horizon = m_table.friction ? log((speed > STOP_SPEED ? speed : STOP_SPEED) / STOP_SPEED) / FRICTION + 1 : 30;
+	table.advance(horizon);
+
+	outcome.rest.resize(balls.size());
+	for (int i = 0; i < (int)balls.size(); i++)
+		outcome.rest[i] = table.getCenter(i);
+	outcome.contacts = table.getContacts();
+}
+
+sim::ShotResult sim::CShotSearch::evaluate(const std::vector<CBall>& balls, const ShotSearchDesc& desc,
+	float angle, float power) const
+{
+	ShotResult r;
+	r.angle = angle;
+	r.power = power;
+	r.vx = power * cosf(angle);
+	r.vz = power * sinf(angle);
+	r.evaluated = 1;
+	r.seconds = 0;
+
+	ShotOutcome outcome;
+	if (m_cache) {
+		ShotKey key;
+		CShotCache::makeKey(balls, desc.cue, r.vx, r.vz, key);
+		CShotCache::snap(key, r.vx, r.vz);
+
+		// the snapped shot is the one played, so it is the one the result describes
+		r.power = sqrtf(r.vx * r.vx + r.vz * r.vz);
+		r.angle = atan2f(r.vz, r.vx);
+		if (r.angle < 0)
+			r.angle += 2 * PI;
+		if (!m_cache->find(key, outcome)) {
+			std::vector<CBall> snapped(balls);
+			CShotCache::snap(key, snapped);
+			play(snapped, desc.cue, r.vx, r.vz, outcome);
+			m_cache->insert(key, outcome);
+		}
+	}
+	else {
+		play(balls, desc.cue, r.vx, r.vz, outcome);
+	}
+
+	bool hit[2] = { false, false };
+	r.foul = false;
+	const std::vector<BallContact>& contacts = outcome.contacts;
+	for (int k = 0; k < (int)contacts.size(); k++) {
+		int other;
+		if (contacts[k].a == desc.cue) other = contacts[k].b;
+		else if (contacts[k].b == desc.cue) other = contacts[k].a;
+		else continue;
+		if (other == desc.targets[0]) hit[0] = true;
+		if (other == desc.targets[1]) hit[1] = true;
+		if (other == desc.foul) r.foul = true;
+	}
+	r.targetsHit = (hit[0] ? 1 : 0) + (hit[1] ? 1 : 0);
+
+	// a point beats any miss, softer points beat harder ones, fouls come last
+	if (r.foul)
+		r.score = -1;
+	else if (r.targetsHit == 2)
+		r.score = 2 + 0.5f * (1 - r.power / desc.maxPower);
+	else
+		r.score = (float)r.targetsHit;
+	return r;
+}
+
+sim::ShotResult sim::CShotSearch::search(const CBilliardScene& scene, const ShotSearchDesc& desc)
+{
+	std::vector<CBall> balls(scene.getBallCount());
+	for (int i = 0; i < scene.getBallCount(); i++)
+		balls[i] = scene.getBall(i);
+	return search(balls, desc);
+}
+
+sim::ShotResult sim::CShotSearch::search(const std::vector<CBall>& balls, const ShotSearchDesc& desc)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	ShotResult best;
+	best.score = -2;
+	best.vx = best.vz = best.angle = best.power = 0;
+	best.targetsHit = 0;
+	best.foul = false;
+
+	long done = 0;
+	double roundTime = 0;
+	while (done < desc.samples) {
+		std::chrono::steady_clock::time_point roundStart = std::chrono::steady_clock::now();
+		int count = desc.samples - done < SHOT_ROUND ? (int)(desc.samples - done) : SHOT_ROUND;
+		m_round.resize(count);
+		long first = done;
+		m_pool.parallelFor(count, 16, [&](int begin, int end) {
+			for (int i = begin; i < end; i++) {
+				float angle, power;
+				sample(desc, first + i, angle, power);
+				m_round[i] = evaluate(balls, desc, angle, power);
+			}
+		});
+
+		// strictly better only, so ties go to the earlier sample whatever thread played it
+		for (int i = 0; i < count; i++)
+			if (m_round[i].score > best.score)
+				best = m_round[i];
+		done += count;
+
+		// stop before a round that would run past the budget
+		if (!desc.deterministic) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			std::chrono::duration<double> elapsed = now - start;
+			std::chrono::duration<double> last = now - roundStart;
+			roundTime = last.count();
+			if (elapsed.count() + roundTime >= desc.budget)
+				break;
+		}
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	best.evaluated = done;
+	best.seconds = elapsed.count();
+	return best;
+}
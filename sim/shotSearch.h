@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: shotSearch.h
+//
+// Desc: Finds a good billiard shot for the table as it stands. Angle / power candidates are
+//       played out headless on the event engine, spread over a thread pool, and scored on the
+//       balls the cue ball touches: both reds is a point, touching the yellow one is a foul.
+//
+//       Candidates come from a fixed low discrepancy sequence and the best one is picked in
+//       sample order, so a deterministic search returns the same shot on every machine and with
+//       any number of threads. A timed search plays the same sequence until its budget runs out.
+//
+//       With a CShotCache attached, candidates are snapped to the cache grid and a shot that was
+//       already played on the same table is looked up instead of simulated again.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __shotSearchH__
+#define __shotSearchH__
+
+#include "simScene.h"
+#include "threadPool.h"
+#include "shotCache.h"
+#include <vector>
+
+namespace sim
+{
+	const int SHOT_ROUND = 256;   // candidates played between two looks at the clock
+
+	struct ShotSearchDesc
+	{
+		int    cue;            // ball that is struck, the white one in the game
+		int    targets[2];     // balls the cue should touch, the two reds
+		int    foul;           // ball the cue must not touch, -1 for none
+		float  minPower, maxPower;
+		int    samples;        // candidates of a deterministic search, the cap of a timed one
+		double budget;         // seconds, ignored when deterministic
+		bool   deterministic;
+		double seed;           // offsets the sample sequence
+
+		ShotSearchDesc(void);  // the game's layout and power range, timed at 50 ms
+	};
+
+	struct ShotResult
+	{
+		float  vx, vz;         // what CBilliardScene::shoot takes
+		float  angle, power;
+		float  score;
+		int    targetsHit;
+		bool   foul;
+		long   evaluated;      // candidates played by the search
+		double seconds;
+	};
+
+	class CShotSearch {
+	public:
+		// 0 threads uses every hardware thread
+		explicit CShotSearch(int threads = 0);
+
+		void setTable(const TableDesc& table);
+
+		// outcomes are shared through the cache while it is set, 0 plays every candidate
+		void setCache(CShotCache* cache) { m_cache = cache; }
+
+		ShotResult search(const std::vector<CBall>& balls, const ShotSearchDesc& desc);
+		ShotResult search(const CBilliardScene& scene, const ShotSearchDesc& desc);
+
+		// plays and scores a single candidate
+		ShotResult evaluate(const std::vector<CBall>& balls, const ShotSearchDesc& desc,
+			float angle, float power) const;
+
+		// candidate number i of the sequence
+		static void sample(const ShotSearchDesc& desc, long i, float& angle, float& power);
+
+		int getThreadCount(void) const { return m_pool.getThreadCount(); }
+
+	private:
+		void play(const std::vector<CBall>& balls, int cue, float vx, float vz, ShotOutcome& outcome) const;
+
+		TableDesc				m_table;
+		CShotCache*				m_cache;
+		CThreadPool				m_pool;
+		std::vector<ShotResult>	m_round;
+	};
+}
+
+#endif // __shotSearchH__
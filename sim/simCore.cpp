@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simCore.cpp
+//
+// Desc: Ball, brick, holder and wall physics pulled out of the two virtualLego.cpp files.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simCore.h"
+#include "reflectKernel.h"
+#include <cmath>
+
+// the lego frame loop used to advance the shot ball four times per frame, fold that into the scale
+const sim::TableDesc sim::LEGO_TABLE     = { -3.0f, 3.0f, -4.5f, 4.5f, 4.0f, false };
+const sim::TableDesc sim::BILLIARD_TABLE = { -4.5f, 4.5f, -3.0f, 3.0f, 3.3f, true  };
+
+// -----------------------------------------------------------------------------
+// CBall
+// -----------------------------------------------------------------------------
+
+sim::CBall::CBall(void)
+{
+	center_x = center_y = center_z = 0;
+	m_velocity_x = 0;
+	m_velocity_z = 0;
+}
+
+bool sim::CBall::isMoving(void) const
+{
+	return fabs(m_velocity_x) > STOP_SPEED || fabs(m_velocity_z) > STOP_SPEED;
+}
+
+void sim::CBall::ballUpdate(float timeDiff, const TableDesc& table)
+{
+	if (isMoving())
+	{
+		center_x += table.timeScale * timeDiff * m_velocity_x;
+		center_z += table.timeScale * timeDiff * m_velocity_z;
+	}
+	else { setPower(0, 0); }
+	applyFriction(timeDiff, table);
+}
+
+void sim::CBall::applyFriction(float timeDiff, const TableDesc& table)
+{
+	if (table.friction) {
+		double rate = exp(-FRICTION * timeDiff);
+		setPower((float)(m_velocity_x * rate), (float)(m_velocity_z * rate));
+	}
+}
+
+bool sim::CBall::hasIntersected(const CBall& ball) const
+{
+	float dx = ball.center_x - center_x;
+	float dz = ball.center_z - center_z;
+	float r = getRadius() + ball.getRadius();
+	return dx * dx + dz * dz < r * r;
+}
+
+void sim::CBall::hitBy(CBall& ball)
+{
+	if (!hasIntersected(ball))
+		return;
+
+	float dx = ball.center_x - center_x;
+	float dz = ball.center_z - center_z;
+	float dist = sqrtf(dx * dx + dz * dz);
+	float nx = 1.0f, nz = 0.0f;
+	if (dist > 0) { nx = dx / dist; nz = dz / dist; }
+
+	// push the balls apart so they do not stick together on the next frame
+	float push = 0.5f * (getRadius() + ball.getRadius() - dist);
+	center_x -= nx * push;	center_z -= nz * push;
+	ball.center_x += nx * push;	ball.center_z += nz * push;
+
+	// equal masses: swap the velocity components along the contact normal
+	float approach = (m_velocity_x - ball.m_velocity_x) * nx + (m_velocity_z - ball.m_velocity_z) * nz;
+	if (approach <= 0)
+		return;
+	m_velocity_x -= approach * nx;		m_velocity_z -= approach * nz;
+	ball.m_velocity_x += approach * nx;	ball.m_velocity_z += approach * nz;
+}
+
+// -----------------------------------------------------------------------------
+// CBrick
+// -----------------------------------------------------------------------------
+
+bool sim::CBrick::hitBy(CBall& ball) // ball is shotPos
+{
+	Vec3 hitPos = this->getCenter();
+	Vec3 shotPos = ball.getCenter();
+	float dx = shotPos.x - hitPos.x, dz = shotPos.z - hitPos.z;
+	if (dx * dx + dz * dz > 4 * BALL_RADIUS * BALL_RADIUS)
+		return false;
+
+	// mirror the velocity about the contact plane, the brick itself stays put until removed
+	float vx = ball.getVelocity_X(), vz = ball.getVelocity_Z();
+	reflectOffSphere(shotPos.x, shotPos.z, hitPos.x, hitPos.z, vx, vz);
+	ball.setPower(vx, vz);
+	return true;
+}
+
+// -----------------------------------------------------------------------------
+// CHolderBall
+// -----------------------------------------------------------------------------
+
+void sim::CHolderBall::hitBy(CBall& ball) // ball is shotPos
+{
+	Vec3 hitPos = this->getCenter();
+	Vec3 shotPos = ball.getCenter();
+	float dx = shotPos.x - hitPos.x, dz = shotPos.z - hitPos.z;
+	float dist2 = dx * dx + dz * dz;
+	if (dist2 > 4 * BALL_RADIUS * BALL_RADIUS)
+		return;
+
+	float vx = ball.getVelocity_X(), vz = ball.getVelocity_Z();
+	reflectOffSphere(shotPos.x, shotPos.z, hitPos.x, hitPos.z, vx, vz);
+	ball.setPower(vx, vz);
+
+	// the holder does not give way, so the ball is put back at touching distance
+	if (this->hasIntersected(ball) && dist2 > REFLECT_MIN_DIST2) {
+		float push = 2 * BALL_RADIUS / sqrtf(dist2);
+		ball.setCenter(hitPos.x + dx * push, shotPos.y, hitPos.z + dz * push);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// CWall
+// -----------------------------------------------------------------------------
+
+sim::CWall::CWall(void)
+{
+	m_axis = 0;
+	m_offset = 0;
+	m_normal = 1;
+}
+
+void sim::CWall::setPlane(int axis, float offset, float normal)
+{
+	m_axis = axis;
+	m_offset = offset;
+	m_normal = normal;
+}
+
+bool sim::CWall::hasIntersected(const CBall& ball) const
+{
+	Vec3 c = ball.getCenter();
+	float d = (m_axis == 0 ? c.x : c.z) - m_offset;
+	return d * m_normal < ball.getRadius();
+}
+
+bool sim::CWall::hitBy(CBall& ball)
+{
+	if (!hasIntersected(ball))
+		return false;
+
+	// correction of position of ball, then mirror the velocity component into the table
+	Vec3 c = ball.getCenter();
+	float rest = m_offset + m_normal * ball.getRadius();
+	float vx = ball.getVelocity_X();
+	float vz = ball.getVelocity_Z();
+	if (m_axis == 0) {
+		c.x = rest;
+		if (vx * m_normal < 0) vx = -vx;
+	}
+	else {
+		c.z = rest;
+		if (vz * m_normal < 0) vz = -vz;
+	}
+	ball.setCenter(c.x, c.y, c.z);
+	ball.setPower(vx, vz);
+	return true;
+}
+
+bool sim::CWall::sweep(const Vec3& p, const Vec3& d, float radius, float& t) const
+{
+	float gap = ((m_axis == 0 ? p.x : p.z) - m_offset) * m_normal - radius;
+	float closing = (m_axis == 0 ? d.x : d.z) * m_normal;
+	if (closing >= 0)
+		return false;
+	if (gap <= 0) {
+		t = 0;
+		return true;
+	}
+	if (gap > -closing)
+		return false;
+	t = gap / -closing;
+	return true;
+}
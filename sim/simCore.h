@@ -0,0 +1,122 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simCore.h
+//
+// Desc: Portable ball / wall / holder physics shared by Virtual LEGO and Virtual Billiard.
+//       Nothing in here depends on Direct3D, so it builds on any platform with a C++11 compiler.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simCoreH__
+#define __simCoreH__
+
+#include "simMath.h"
+
+namespace sim
+{
+	//
+	// Constants
+	//
+
+	const float BALL_RADIUS   = 0.21f;   // same as M_RADIUS in the games
+	const float PI            = 3.14159265f;
+	const float DECREASE_RATE = 0.9982f;
+	const float STOP_SPEED    = 0.01f;   // per-axis speed below which a ball is at rest
+	const float FRICTION      = (1 - DECREASE_RATE) * 400;   // velocity decay per unit of time
+
+	//
+	// Table description
+	//
+
+	struct TableDesc
+	{
+		float minX, maxX;   // inner faces of the side cushions
+		float minZ, maxZ;   // inner faces of the end cushions
+		float timeScale;    // distance travelled per unit of velocity and time
+		bool  friction;     // billiard cloth slows balls down, the lego table does not
+	};
+
+	extern const TableDesc LEGO_TABLE;
+	extern const TableDesc BILLIARD_TABLE;
+
+	// -----------------------------------------------------------------------------
+	// CBall - position and velocity of one ball, no rendering data
+	// -----------------------------------------------------------------------------
+
+	class CBall {
+	protected:
+		float center_x, center_y, center_z;
+		float m_velocity_x;
+		float m_velocity_z;
+
+	public:
+		CBall(void);
+
+		void ballUpdate(float timeDiff, const TableDesc& table);
+
+		// velocity decay of a step on cloth, exact for any step length. the position is still
+		// moved a step at a time, so only the speed does not depend on how the time is sliced
+		void applyFriction(float timeDiff, const TableDesc& table);
+		bool hasIntersected(const CBall& ball) const;
+
+		// elastic response between two equal balls (billiard)
+		void hitBy(CBall& ball);
+
+		float getVelocity_X(void) const { return m_velocity_x; }
+		float getVelocity_Z(void) const { return m_velocity_z; }
+		void  setPower(float vx, float vz) { m_velocity_x = vx; m_velocity_z = vz; }
+		bool  isMoving(void) const;
+
+		void  setCenter(float x, float y, float z) { center_x = x; center_y = y; center_z = z; }
+		void  setCenter(const Vec3& c) { setCenter(c.x, c.y, c.z); }
+		Vec3  getCenter(void) const { Vec3 c = { center_x, center_y, center_z }; return c; }
+		float getRadius(void) const { return BALL_RADIUS; }
+	};
+
+	// -----------------------------------------------------------------------------
+	// CBrick - lego brick, destroyed by the first shot ball that touches it
+	// -----------------------------------------------------------------------------
+
+	class CBrick : public CBall {
+	public:
+		// returns true when the brick was hit and must be removed
+		bool hitBy(CBall& ball);
+	};
+
+	// -----------------------------------------------------------------------------
+	// CHolderBall - lego paddle ball the shot bounces off
+	// -----------------------------------------------------------------------------
+
+	class CHolderBall : public CBall {
+	public:
+		void hitBy(CBall& ball);
+	};
+
+	// -----------------------------------------------------------------------------
+	// CWall - axis aligned cushion, described by the inner face it presents to the table
+	// -----------------------------------------------------------------------------
+
+	class CWall {
+	private:
+		int   m_axis;      // 0 : face is x = offset, 2 : face is z = offset
+		float m_offset;
+		float m_normal;    // +1 or -1, points into the table
+
+	public:
+		CWall(void);
+
+		void setPlane(int axis, float offset, float normal);
+		bool hasIntersected(const CBall& ball) const;
+		bool hitBy(CBall& ball);
+
+		// ball at p moving by d during the step: fraction t of the step at which it first
+		// touches the face, false when it does not get there within the step
+		bool sweep(const Vec3& p, const Vec3& d, float radius, float& t) const;
+
+		int   getAxis(void) const { return m_axis; }
+		float getOffset(void) const { return m_offset; }
+		float getNormal(void) const { return m_normal; }
+	};
+}
+
+#endif // __simCoreH__
@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simMath.h
+//
+// Desc: Vector and matrix math that does not need the DirectX SDK. Header only.
+//       Vec2 / Vec3 are plain aggregates and most of their operations are constexpr, so constant
+//       positions can be built at compile time. Mat4 has the D3DXMATRIX layout and conventions
+//       (row major, row vectors, translation in the last row), so it can be handed to Direct3D
+//       as it is. The 4 wide matrix operations run on SSE or NEON where available, and fall back
+//       to scalar code that adds in the same order, so every path gives the same bits.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simMathH__
+#define __simMathH__
+
+#include "simdSupport.h"
+#include <cmath>
+
+namespace sim
+{
+	// -----------------------------------------------------------------------------
+	// Vec2 - a point or direction on the table plane
+	// -----------------------------------------------------------------------------
+
+	struct Vec2
+	{
+		float x, z;
+	};
+
+	constexpr Vec2  vec2(float x, float z) { return Vec2{ x, z }; }
+	constexpr Vec2  operator+(const Vec2& a, const Vec2& b) { return Vec2{ a.x + b.x, a.z + b.z }; }
+	constexpr Vec2  operator-(const Vec2& a, const Vec2& b) { return Vec2{ a.x - b.x, a.z - b.z }; }
+	constexpr Vec2  operator*(const Vec2& a, float s) { return Vec2{ a.x * s, a.z * s }; }
+	constexpr float dot(const Vec2& a, const Vec2& b) { return a.x * b.x + a.z * b.z; }
+	constexpr float cross(const Vec2& a, const Vec2& b) { return a.x * b.z - a.z * b.x; }
+	constexpr float lengthSq(const Vec2& a) { return dot(a, a); }
+	inline float length(const Vec2& a) { return sqrtf(lengthSq(a)); }
+
+	// -----------------------------------------------------------------------------
+	// Vec3
+	// -----------------------------------------------------------------------------
+
+	struct Vec3
+	{
+		float x, y, z;
+	};
+
+	constexpr Vec3  vec3(float x, float y, float z) { return Vec3{ x, y, z }; }
+	constexpr Vec3  operator+(const Vec3& a, const Vec3& b) { return Vec3{ a.x + b.x, a.y + b.y, a.z + b.z }; }
+	constexpr Vec3  operator-(const Vec3& a, const Vec3& b) { return Vec3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+	constexpr Vec3  operator*(const Vec3& a, float s) { return Vec3{ a.x * s, a.y * s, a.z * s }; }
+	constexpr float dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	constexpr Vec3  cross(const Vec3& a, const Vec3& b)
+	{
+		return Vec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	}
+	constexpr float lengthSq(const Vec3& a) { return dot(a, a); }
+	constexpr Vec2  onTable(const Vec3& a) { return Vec2{ a.x, a.z }; }
+	inline float length(const Vec3& a) { return sqrtf(lengthSq(a)); }
+
+	inline Vec3 normalize(const Vec3& a)
+	{
+		float len = length(a);
+		return len > 0 ? a * (1 / len) : a;
+	}
+
+	inline Vec3 lerp(const Vec3& a, const Vec3& b, float t)
+	{
+		Vec3 r = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t };
+		return r;
+	}
+
+	// -----------------------------------------------------------------------------
+	// Mat4 - same memory layout as D3DMATRIX
+	// -----------------------------------------------------------------------------
+
+	struct Mat4
+	{
+		float m[4][4];
+	};
+
+	constexpr Mat4 mat4Identity(void)
+	{
+		return Mat4{ { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } } };
+	}
+
+	// D3DXMatrixTranslation
+	constexpr Mat4 mat4Translation(float x, float y, float z)
+	{
+		return Mat4{ { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { x, y, z, 1 } } };
+	}
+
+	// D3DXMatrixScaling
+	constexpr Mat4 mat4Scaling(float x, float y, float z)
+	{
+		return Mat4{ { { x, 0, 0, 0 }, { 0, y, 0, 0 }, { 0, 0, z, 0 }, { 0, 0, 0, 1 } } };
+	}
+
+	// a * b, a applied first like D3DXMatrixMultiply. r may alias a or b
+	inline void mat4Multiply(Mat4& r, const Mat4& a, const Mat4& b)
+	{
+#if defined(SIM_X86)
+		__m128 b0 = _mm_loadu_ps(b.m[0]), b1 = _mm_loadu_ps(b.m[1]);
+		__m128 b2 = _mm_loadu_ps(b.m[2]), b3 = _mm_loadu_ps(b.m[3]);
+		__m128 rows[4];
+		for (int i = 0; i < 4; i++) {
+			__m128 t = _mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0);
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+			t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+			rows[i] = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(a.m[i][3]), b3));
+		}
+		for (int i = 0; i < 4; i++)
+			_mm_storeu_ps(r.m[i], rows[i]);
+#elif defined(SIM_NEON)
+		float32x4_t b0 = vld1q_f32(b.m[0]), b1 = vld1q_f32(b.m[1]);
+		float32x4_t b2 = vld1q_f32(b.m[2]), b3 = vld1q_f32(b.m[3]);
+		float32x4_t rows[4];
+		for (int i = 0; i < 4; i++) {
+			// mul then add, not vmla / vfma, to round like the other paths
+			float32x4_t t = vmulq_n_f32(b0, a.m[i][0]);
+			t = vaddq_f32(t, vmulq_n_f32(b1, a.m[i][1]));
+			t = vaddq_f32(t, vmulq_n_f32(b2, a.m[i][2]));
+			rows[i] = vaddq_f32(t, vmulq_n_f32(b3, a.m[i][3]));
+		}
+		for (int i = 0; i < 4; i++)
+			vst1q_f32(r.m[i], rows[i]);
+#else
+		Mat4 t;
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+				t.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		r = t;
+#endif
+	}
+
+	inline Mat4 operator*(const Mat4& a, const Mat4& b)
+	{
+		Mat4 r;
+		mat4Multiply(r, a, b);
+		return r;
+	}
+
+	// (v, 1) times m, before the divide by w
+	inline void transformRow(const Vec3& v, const Mat4& m, float out[4])
+	{
+#if defined(SIM_X86)
+		__m128 t = _mm_mul_ps(_mm_set1_ps(v.x), _mm_loadu_ps(m.m[0]));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(v.y), _mm_loadu_ps(m.m[1])));
+		t = _mm_add_ps(t, _mm_mul_ps(_mm_set1_ps(v.z), _mm_loadu_ps(m.m[2])));
+		_mm_storeu_ps(out, _mm_add_ps(t, _mm_loadu_ps(m.m[3])));
+#elif defined(SIM_NEON)
+		float32x4_t t = vmulq_n_f32(vld1q_f32(m.m[0]), v.x);
+		t = vaddq_f32(t, vmulq_n_f32(vld1q_f32(m.m[1]), v.y));
+		t = vaddq_f32(t, vmulq_n_f32(vld1q_f32(m.m[2]), v.z));
+		vst1q_f32(out, vaddq_f32(t, vld1q_f32(m.m[3])));
+#else
+		for (int j = 0; j < 4; j++)
+			out[j] = v.x * m.m[0][j] + v.y * m.m[1][j] + v.z * m.m[2][j] + m.m[3][j];
+#endif
+	}
+
+	// D3DXVec3TransformCoord: the point (v, 1) times m, divided by w
+	inline Vec3 transformCoord(const Vec3& v, const Mat4& m)
+	{
+		float out[4];
+		transformRow(v, m, out);
+		float w = out[3] != 0 ? 1 / out[3] : 0;
+		Vec3 r = { out[0] * w, out[1] * w, out[2] * w };
+		return r;
+	}
+
+	// mat4Translation(p) * m without the full product: the upper rows of m stay, the last one
+	// becomes p transformed by m
+	inline void mat4TranslationTimes(Mat4& r, const Vec3& p, const Mat4& m)
+	{
+		float row[4];
+		transformRow(p, m, row);
+		for (int i = 0; i < 3; i++)
+			for (int j = 0; j < 4; j++)
+				r.m[i][j] = m.m[i][j];
+		for (int j = 0; j < 4; j++)
+			r.m[3][j] = row[j];
+	}
+
+	constexpr Vec3 getTranslation(const Mat4& m) { return Vec3{ m.m[3][0], m.m[3][1], m.m[3][2] }; }
+}
+
+#endif // __simMathH__
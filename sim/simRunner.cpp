@@ -0,0 +1,1900 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simRunner.cpp
+//
+// Desc: Headless command line runner. Steps a scene for N frames as fast as possible and prints
+//       the final state and the step rate.
+//
+//       build : g++ -O2 -std=c++11 -pthread -o simRunner sim/*.cpp
+//       usage : simRunner [lego|billiard|overlap|trajectory|lanes|search|reflect|entities|release|level|stream|convert|generate|morton|bvh|preview] [batch] [-frames N] [-dt seconds] [-shot vx vz] [-bricks N] [-balls N]
+//                         [-event] [-untilrest] [-substep] [-movers N] [-nosleep] [-worlds N] [-threads T]
+//                         [-samples N] [-budget ms] [-deterministic] [-cache N] [-level file] [-out file] [-memory KB] [-seed N] [-quiet]
+//
+//       -event runs billiards on the event driven engine, -untilrest stops once the table is still
+//       -substep cuts every frame into substeps by the fastest ball's speed and prints the counts
+//       -movers N shoots only N of the -balls stress balls, -nosleep keeps resting balls integrated
+//       batch steps -worlds N independent lego or billiard tables on -threads T, and on one thread
+//       for comparison, and prints worlds x steps per second
+//       overlap benchmarks the batched overlap kernel on -bricks candidates for -frames queries
+//       trajectory steps one -shot ball on an open table until it rests and checks the closed form
+//       lanes steps -worlds 4 ball tables one per simd lane on every path and checks them against
+//       each other and against CBall
+//       search looks for a shot of the white ball that touches both reds on the default table,
+//       within -budget, or over exactly -samples candidates with -deterministic. -cache N runs
+//       it through an N entry outcome cache, searches again and times lookups of cached shots
+//       reflect bounces -bricks ball / sphere contacts with the old brick and holder functions
+//       and with the reflection kernel, and prints the rate and the angle error of each
+//       entities integrates -balls balls stored as one record each and from the hot / cold
+//       entity store, and prints bytes per ball and balls per second of both
+//       release frees the resources of -bricks bricks knocked out in one frame right away, 16
+//       a frame, on a per frame time budget and on a background worker, and prints the worst
+//       frame and the backlog of each
+//       -level plays a level file instead of the default layout, in either form (see levelFile.h)
+//       level writes a -bricks level (a million by default) as text and binary, times loading
+//       both, checks that the converter round trips and that an overlapping brick is refused
+//       stream writes a -bricks scroller as a chunked level and streams it through -memory KB
+//       while a camera flies up it, and prints the chunk latency, the late chunks, the game
+//       thread cost per frame and the resident set. a second flight through a small budget
+//       jumps the camera back now and then and checks no slot is evicted and loaded at once
+//       convert turns the -level file into the -out file, text to binary or back, and writes
+//       the default layout without -level
+//       generate makes a -bricks level (a million by default) from -seed on -threads T and on one
+//       thread, checks that both are the same and that no bricks overlap, prints the rate and
+//       writes it to the -out file if there is one, in the form its name asks for
+//       morton steps -balls balls (100000 by default) from the entity store in creation order and
+//       re-sorted in Morton order, checks the handles and prints the time per step and the L1
+//       and last level cache misses where the hardware counters can be read
+//       bvh builds a hierarchy over a generated -bricks level (100000 by default) and -balls balls
+//       and times batches of ray and sphere casts, checks them against testing every sphere,
+//       and does both again after knocking out a tenth of the bricks one by one
+//       preview traces 8 bounce aim lines through a generated -bricks level (100000 by default)
+//       for -frames holder positions and prints the latency and the allocations, then checks the
+//       first thing hit against stepping the default lego and billiard scenes
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simScene.h"
+#include "substepper.h"
+#include "trajectory.h"
+#include "worldBatch.h"
+#include "laneBilliard.h"
+#include "shotSearch.h"
+#include "overlapKernel.h"
+#include "reflectKernel.h"
+#include "entityStore.h"
+#include "deferredQueue.h"
+#include "levelFile.h"
+#include "levelStream.h"
+#include "levelGen.h"
+#include "bvh.h"
+#include "shotPreview.h"
+#include "simdSupport.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <new>
+#include <atomic>
+#include <algorithm>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum RunMode { RUN_LEGO, RUN_BILLIARD, RUN_OVERLAP, RUN_TRAJECTORY, RUN_LANES, RUN_SEARCH, RUN_REFLECT, RUN_ENTITIES, RUN_RELEASE, RUN_LEVEL, RUN_STREAM, RUN_CONVERT, RUN_GENERATE, RUN_MORTON, RUN_BVH, RUN_PREVIEW };
+
+// every allocation of the process is counted, so a run can show that a loop makes none. the
+// threaded modes allocate too, so the count is atomic. new[] and the nothrow forms come
+// through operator new, every delete through the plain one, which is kept out of line: gcc
+// takes a free inlined into a container's delete for one that does not match its new
+static std::atomic<long> g_allocations(0);
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RUNNER_NOINLINE __attribute__((noinline))
+#else
+#define RUNNER_NOINLINE
+#endif
+
+void* operator new(size_t size)
+{
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+RUNNER_NOINLINE void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	operator delete(p);
+}
+
+struct RunOptions
+{
+	RunMode mode;
+	long  frames;
+	float timeDelta;
+	float shotX, shotZ;
+	int   bricks;      // 0 keeps the default 54 brick level
+	int   balls;       // 0 keeps the default 4 ball table
+	int   movers;      // stress balls given a velocity, 0 shoots all of them
+	bool  sleep;
+	bool  batch;
+	int   worlds;
+	int   threads;     // 0 uses every hardware thread
+	int   samples;
+	float budget;      // milliseconds
+	bool  deterministic;
+	int   cache;       // shot outcomes kept, 0 searches without a cache
+	const char* level; // level file, 0 keeps the built in layouts
+	const char* out;
+	int   memory;      // KB of streamed level data
+	unsigned long long seed;
+	bool  event;
+	bool  untilRest;
+	bool  substep;
+	bool  quiet;
+};
+
+static void usage(void)
+{
+	printf("usage: simRunner [lego|billiard|overlap|trajectory|lanes|search|reflect|entities|release|level|stream|convert|generate|morton|bvh|preview] [batch] [-frames N] [-dt seconds] [-shot vx vz]\n"
+		"                 [-bricks N] [-balls N] [-event] [-untilrest] [-substep] [-movers N] [-nosleep]\n"
+		"                 [-worlds N] [-threads T] [-samples N] [-budget ms] [-deterministic] [-cache N] [-level file] [-out file] [-memory KB] [-seed N] [-quiet]\n");
+}
+
+static bool parseArgs(int argc, char** argv, RunOptions& opt)
+{
+	opt.mode = RUN_LEGO;
+	opt.frames = 100000;
+	opt.timeDelta = 0.01f;
+	// billiard default: the cue ball aimed at the blue target ball in the middle of the table
+	opt.shotX = -sim::billiardBallPos[3][0];
+	opt.shotZ = -sim::billiardBallPos[3][1];
+	opt.bricks = 0;
+	opt.balls = 0;
+	opt.movers = 0;
+	opt.sleep = true;
+	opt.batch = false;
+	opt.worlds = 1000;
+	opt.threads = 0;
+	opt.samples = 20000;
+	opt.budget = 50;
+	opt.deterministic = false;
+	opt.cache = 0;
+	opt.level = 0;
+	opt.out = 0;
+	opt.memory = 64;
+	opt.seed = 1;
+	opt.event = false;
+	opt.untilRest = false;
+	opt.substep = false;
+	opt.quiet = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "lego"))					opt.mode = RUN_LEGO;
+		else if (!strcmp(argv[i], "billiard"))			opt.mode = RUN_BILLIARD;
+		else if (!strcmp(argv[i], "overlap"))			opt.mode = RUN_OVERLAP;
+		else if (!strcmp(argv[i], "trajectory"))		opt.mode = RUN_TRAJECTORY;
+		else if (!strcmp(argv[i], "lanes"))				opt.mode = RUN_LANES;
+		else if (!strcmp(argv[i], "search"))			opt.mode = RUN_SEARCH;
+		else if (!strcmp(argv[i], "reflect"))			opt.mode = RUN_REFLECT;
+		else if (!strcmp(argv[i], "entities"))			opt.mode = RUN_ENTITIES;
+		else if (!strcmp(argv[i], "release"))			opt.mode = RUN_RELEASE;
+		else if (!strcmp(argv[i], "level"))				opt.mode = RUN_LEVEL;
+		else if (!strcmp(argv[i], "stream"))			opt.mode = RUN_STREAM;
+		else if (!strcmp(argv[i], "convert"))			opt.mode = RUN_CONVERT;
+		else if (!strcmp(argv[i], "generate"))			opt.mode = RUN_GENERATE;
+		else if (!strcmp(argv[i], "morton"))			opt.mode = RUN_MORTON;
+		else if (!strcmp(argv[i], "bvh"))				opt.mode = RUN_BVH;
+		else if (!strcmp(argv[i], "preview"))			opt.mode = RUN_PREVIEW;
+		else if (!strcmp(argv[i], "-level") && i + 1 < argc)	opt.level = argv[++i];
+		else if (!strcmp(argv[i], "-out") && i + 1 < argc)		opt.out = argv[++i];
+		else if (!strcmp(argv[i], "-memory") && i + 1 < argc)	opt.memory = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-seed") && i + 1 < argc)		opt.seed = strtoull(argv[++i], 0, 10);
+		else if (!strcmp(argv[i], "-samples") && i + 1 < argc)	opt.samples = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-budget") && i + 1 < argc)	opt.budget = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-deterministic"))	opt.deterministic = true;
+		else if (!strcmp(argv[i], "-cache") && i + 1 < argc)	opt.cache = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "batch"))				opt.batch = true;
+		else if (!strcmp(argv[i], "-worlds") && i + 1 < argc)	opt.worlds = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc)	opt.threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-frames") && i + 1 < argc)	opt.frames = atol(argv[++i]);
+		else if (!strcmp(argv[i], "-dt") && i + 1 < argc)		opt.timeDelta = (float)atof(argv[++i]);
+		else if (!strcmp(argv[i], "-shot") && i + 2 < argc) {
+			opt.shotX = (float)atof(argv[++i]);
+			opt.shotZ = (float)atof(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-bricks") && i + 1 < argc)	opt.bricks = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-balls") && i + 1 < argc)	opt.balls = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-movers") && i + 1 < argc)	opt.movers = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-nosleep"))			opt.sleep = false;
+		else if (!strcmp(argv[i], "-event"))			opt.event = true;
+		else if (!strcmp(argv[i], "-untilrest"))		opt.untilRest = true;
+		else if (!strcmp(argv[i], "-substep"))			opt.substep = true;
+		else if (!strcmp(argv[i], "-quiet"))			opt.quiet = true;
+		else return false;
+	}
+	if (opt.batch && opt.mode != RUN_LEGO && opt.mode != RUN_BILLIARD)
+		return false;
+	if (opt.mode == RUN_CONVERT && !opt.out)
+		return false;
+	return opt.frames > 0 && opt.timeDelta > 0 && opt.worlds > 0;
+}
+
+static void printBall(const char* name, int i, const sim::CBall& ball)
+{
+	sim::Vec3 c = ball.getCenter();
+	printf("%s %3d  pos (%8.4f, %8.4f)  vel (%8.4f, %8.4f)\n",
+		name, i, c.x, c.z, ball.getVelocity_X(), ball.getVelocity_Z());
+}
+
+// square lattice of bricks in front of the holder, on a table wide enough to hold it.
+// every other row takes the second colour
+static void makeStressLevel(sim::LevelData& level, int count)
+{
+	const float spacing = 2 * sim::BALL_RADIUS + 0.04f;
+	const float colours[8] = { 1, 1, 0, 1,  1, 0.5f, 0, 1 };
+	int cols = (int)sqrt((double)count) + 1;
+	int rows = (count + cols - 1) / cols;
+
+	level.colours.assign(colours, colours + 8);
+	level.pos.resize(2 * count);
+	level.colour.resize(count);
+	for (int i = 0; i < count; i++) {
+		level.pos[2 * i] = ((i % cols) - 0.5f * (cols - 1)) * spacing;
+		level.pos[2 * i + 1] = -2.0f + (i / cols) * spacing;
+		level.colour[i] = (uint8_t)((i / cols) & 1);
+	}
+
+	level.table = sim::LEGO_TABLE;
+	level.table.maxX = 0.5f * cols * spacing + 1.0f;
+	level.table.minX = -level.table.maxX;
+	level.table.maxZ = -2.0f + rows * spacing + 1.0f;
+}
+
+static void setupStressLevel(sim::CLegoScene& scene, int count)
+{
+	sim::LevelData level;
+	makeStressLevel(level, count);
+	scene.setTable(level.table);
+	scene.setup(level.getBrickPos(), count);
+}
+
+// a level file in either form, the binary one read in place from the mapping
+static bool setupLevelFile(sim::CLegoScene& scene, const char* path)
+{
+	std::string error;
+	if (sim::isLevelTextPath(path)) {
+		sim::LevelData level;
+		if (sim::readLevelText(path, level, error) && sim::checkLevel(level.getBrickPos(), level.getBrickCount(), level.table, error)) {
+			scene.setTable(level.table);
+			scene.setup(level.getBrickPos(), level.getBrickCount());
+			return true;
+		}
+	}
+	else {
+		sim::CLevelFile file;
+		if (file.open(path)) {
+			scene.setTable(file.getTable());
+			scene.setup(file.getBrickPos(), file.getBrickCount());
+			return true;
+		}
+		error = file.getError();
+	}
+	printf("%s: %s\n", path, error.c_str());
+	return false;
+}
+
+static void printSubsteps(const sim::CSubstepper& substepper)
+{
+	printf("substeps per frame: avg %.2f  peak %d  last frames:",
+		substepper.getAverage(), substepper.getPeak());
+	for (int i = 0; i < 16 && i < substepper.getHistorySize(); i++)
+		printf(" %d", substepper.getFrameSubsteps(i));
+	printf("\n");
+}
+
+static double runLego(const RunOptions& opt, long& steps)
+{
+	sim::CLegoScene scene;
+	sim::CSubstepper substepper;
+	if (opt.level) {
+		if (!setupLevelFile(scene, opt.level))
+			return 0;
+	}
+	else if (opt.bricks > 0)
+		setupStressLevel(scene, opt.bricks);
+	else
+		scene.setup();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (steps = 0; steps < opt.frames; steps++) {
+		// keep serving so a soak run exercises the whole brick field
+		if (!scene.isShot())
+			scene.shoot();
+		if (opt.substep) {
+			scene.step(opt.timeDelta, substepper.plan(scene.getMaxSpeed(), opt.timeDelta));
+			substepper.endFrame();
+		}
+		else {
+			scene.step(opt.timeDelta);
+		}
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (!opt.quiet && opt.bricks == 0 && !opt.level) {
+		for (int i = 0; i < scene.getBrickCount(); i++)
+			if (scene.isBrickAlive(i))
+				printBall("brick", i, scene.getBrick(i));
+		printBall("holder", 0, scene.getHolderBall());
+		printBall("shot", 0, scene.getShotBall());
+	}
+	printf("bricks alive: %d / %d\n", scene.getAliveCount(), scene.getBrickCount());
+	if (opt.substep)
+		printSubsteps(substepper);
+	return elapsed.count();
+}
+
+// loose rack of balls with a scrambled velocity for every one of movers, on a table sized to hold them
+static void setupStressTable(sim::CBilliardScene& scene, int count, int movers)
+{
+	const float spacing = 2 * sim::BALL_RADIUS + 0.2f;
+	int cols = (int)sqrt(count * 1.5) + 1;
+	int rows = (count + cols - 1) / cols;
+
+	std::vector<float> pos(2 * count);
+	for (int i = 0; i < count; i++) {
+		pos[2 * i] = ((i % cols) - 0.5f * (cols - 1)) * spacing;
+		pos[2 * i + 1] = ((i / cols) - 0.5f * (rows - 1)) * spacing;
+	}
+
+	sim::TableDesc table = sim::BILLIARD_TABLE;
+	table.maxX = 0.5f * cols * spacing + 0.5f;
+	table.minX = -table.maxX;
+	table.maxZ = 0.5f * rows * spacing + 0.5f;
+	table.minZ = -table.maxZ;
+	scene.setTable(table);
+	scene.setup((const float (*)[2])&pos[0], count);
+
+	int every = movers > 0 && movers < count ? count / movers : 1;
+	unsigned int seed = 12345;
+	for (int i = 0; i < count; i += every) {
+		seed = seed * 1103515245u + 12345u;
+		float vx = (float)((seed >> 8) % 2001) / 1000.0f - 1.0f;
+		seed = seed * 1103515245u + 12345u;
+		float vz = (float)((seed >> 8) % 2001) / 1000.0f - 1.0f;
+		scene.shoot(i, 2 * vx, 2 * vz);
+	}
+}
+
+static double runBilliard(const RunOptions& opt, long& steps)
+{
+	sim::CBilliardScene scene;
+	sim::CSubstepper substepper;
+	if (opt.balls > 0) {
+		scene.setSleeping(opt.sleep);
+		setupStressTable(scene, opt.balls, opt.movers);
+	}
+	else {
+		scene.setup();
+		scene.shoot(3, opt.shotX, opt.shotZ);
+	}
+	if (opt.event)
+		scene.setEngine(sim::ENGINE_EVENT);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (steps = 0; steps < opt.frames; steps++) {
+		if (opt.untilRest && !scene.isMoving())
+			break;
+		if (opt.substep) {
+			scene.step(opt.timeDelta, substepper.plan(scene.getMaxSpeed(), opt.timeDelta));
+			substepper.endFrame();
+		}
+		else {
+			scene.step(opt.timeDelta);
+		}
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (!opt.quiet && opt.balls == 0) {
+		for (int i = 0; i < scene.getBallCount(); i++)
+			printBall("ball", i, scene.getBall(i));
+	}
+	printf("table at rest: %s after %ld steps  awake: %d  asleep: %d\n", scene.isMoving() ? "no" : "yes",
+		steps, scene.getAwakeCount(), scene.getSleepingCount());
+	if (opt.event)
+		printf("events: %ld  stale: %ld  cell crossings: %ld over %d cells\n",
+			scene.getEventEngine().getEventCount(), scene.getEventEngine().getStaleCount(),
+			scene.getEventEngine().getCrossingCount(), scene.getEventEngine().getCellCount());
+	if (opt.substep)
+		printSubsteps(substepper);
+	return elapsed.count();
+}
+
+// one ball against -bricks random candidates, once per simd path
+static double runOverlap(const RunOptions& opt, long& steps)
+{
+	int count = opt.bricks > 0 ? opt.bricks : 1024;
+	std::vector<float> xs(count), zs(count);
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		xs[i] = 6.0f * rand() / RAND_MAX - 3.0f;
+		zs[i] = 9.0f * rand() / RAND_MAX - 4.5f;
+	}
+	std::vector<uint64_t> mask(sim::overlapMaskWords(count)), reference(mask.size());
+	sim::overlapBatchScalar(0, 0, 2 * sim::BALL_RADIUS, &xs[0], &zs[0], count, &reference[0]);
+
+	sim::SimdPath best = sim::detectSimdPath();
+	double total = 0;
+	for (int p = sim::SIMD_SCALAR; p <= best; p++) {
+		sim::setSimdPath((sim::SimdPath)p);
+		long hits = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (long f = 0; f < opt.frames; f++) {
+			float x = (f % 64) * 0.05f - 1.6f;
+			hits += sim::overlapBatch(x, 0, 2 * sim::BALL_RADIUS, &xs[0], &zs[0], count, &mask[0]);
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		total += elapsed.count();
+
+		sim::overlapBatch(0, 0, 2 * sim::BALL_RADIUS, &xs[0], &zs[0], count, &mask[0]);
+		printf("%-6s  %8.1f M candidates/sec  hits %ld  mask %s\n", sim::simdPathName((sim::SimdPath)p),
+			(double)count * opt.frames / elapsed.count() * 1e-6, hits, mask == reference ? "ok" : "MISMATCH");
+	}
+	sim::setSimdPath(best);
+
+	// the same items and one far off, which would ask a grid of BALL_RADIUS cells for
+	// trillions of cells. it grows its cells instead and still finds every neighbour
+	xs.push_back(1e6f);
+	zs.push_back(1e6f);
+	sim::CUniformGrid grid;
+	grid.build(xs, zs, 2 * sim::BALL_RADIUS);
+	std::vector<int> found;
+	grid.queryOverlap(0, 0, 2 * sim::BALL_RADIUS, found);
+	int want = 0;
+	for (int i = 0; i < count; i++)
+		want += xs[i] * xs[i] + zs[i] * zs[i] < 4 * sim::BALL_RADIUS * sim::BALL_RADIUS;
+	printf("sparse grid: %d cells of %.0f  %d of %d neighbours found\n", grid.getCellCount(),
+		grid.getCellSize(), (int)found.size(), want);
+	steps = opt.frames * (best + 1);
+	return total;
+}
+
+// the brick and holder bounces as they were before the reflection kernel, kept to compare against
+static bool legacyBrickHitBy(const sim::CBall& brick, sim::CBall& ball)
+{
+	sim::Vec3 hitPos = brick.getCenter();
+	sim::Vec3 shotPos = ball.getCenter();
+	double dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
+	double vx = ball.getVelocity_X(); float vz = ball.getVelocity_Z();
+	double dx = hitPos.x - shotPos.x; float dz = hitPos.z - shotPos.z;
+
+	if (dist > 2 * sim::BALL_RADIUS)
+		return false;
+
+	double shotDegree = 0.0;
+	double collideDegree = 0.0;
+	double newDegree = 0.0;
+
+	collideDegree = floor((180 / sim::PI) * ((int)(atan2(dx, dz) + 360) % 360));
+	shotDegree = floor((180 / sim::PI) * ((int)(atan2(vx, vz) + 360) % 360));
+
+	if (dx >= 0 && dz >= 0) {
+		newDegree = 180 + 2 * collideDegree - shotDegree;
+	}
+	else if (dx < 0 && dz >= 0) {
+		if (collideDegree - 90 <= shotDegree && shotDegree < collideDegree) {
+			newDegree = -180 + 2 * collideDegree - shotDegree;
+		}
+		else if (collideDegree <= shotDegree && shotDegree < collideDegree + 90) {
+			newDegree = 180 - 2 * collideDegree + shotDegree;
+		}
+	}
+	else {
+		if (collideDegree - 90 <= shotDegree && shotDegree < collideDegree) {
+			newDegree = -180 + 2 * collideDegree - shotDegree;
+		}
+		else {
+			newDegree = 2 * 180 - 2 * collideDegree + shotDegree;
+		}
+	}
+	ball.setPower((float)(2 * cos(newDegree)), (float)(2 * sin(newDegree)));
+	return true;
+}
+
+static void legacyHolderHitBy(const sim::CBall& holder, sim::CBall& ball)
+{
+	sim::Vec3 hitPos = holder.getCenter();
+	sim::Vec3 shotPos = ball.getCenter();
+
+	double dist = sqrt(pow(shotPos.x - hitPos.x, 2) + pow(shotPos.z - hitPos.z, 2));
+	float vx = ball.getVelocity_X(); float vz = ball.getVelocity_Z();
+	float dx = hitPos.x - shotPos.x; float dz = hitPos.z - shotPos.z;
+
+	if (dist > 2 * sim::BALL_RADIUS)
+		return;
+
+	ball.setPower(0, 0);
+	float shotTan = 0.0f;
+	float collideTan = 0.0f;
+	float limitTan = 0.0f;
+	float dbRadian = 0.0f;
+
+	if (dx == 0) collideTan = (float)pow(10, 8);
+	else collideTan = dz / dx;
+
+	limitTan = -1 / collideTan;
+
+	if (vx == 0) shotTan = (float)pow(10, 8);
+	else shotTan = vz / vx;
+
+	if (dx >= 0 && dz >= 0) {
+		dbRadian = (float)(sim::PI + 2 * atan2(dx, dz) - atan2(vx, vz));
+	}
+	else if (shotTan > collideTan || shotTan < limitTan) {
+		dbRadian = (float)(-sim::PI + 2 * atan2(dx, dz) - atan2(vx, vz));
+	}
+	else if (shotTan < collideTan && shotTan > limitTan) {
+		if (dx < 0 && dz >= 0)
+			dbRadian = (float)(sim::PI + 2 * atan2(dx, dz) - atan2(vx, vz));
+		else
+			dbRadian = (float)(2 * sim::PI - 2 * atan2(dx, dz) + atan2(vx, vz));
+	}
+
+	double dbDegree = floor((180 / sim::PI) * dbRadian);
+	double newTan = tan(dbDegree);
+	double v = 2 / sqrt(1 + pow(newTan, 2));
+
+	if (holder.hasIntersected(ball)) {
+		ball.setCenter((float)(shotPos.x + v * 0.01), shotPos.y, (float)(shotPos.z + v * newTan * 0.01));
+	}
+
+	ball.setPower((float)v, (float)(v * newTan));
+}
+
+// angle between two velocities in degrees, and how far their lengths differ
+static void bounceError(double ax, double az, double bx, double bz, double& degrees, double& speed)
+{
+	double dot = ax * bx + az * bz, cross = ax * bz - az * bx;
+	degrees = fabs(atan2(cross, dot)) * 180 / sim::PI;
+	speed = fabs(sqrt(ax * ax + az * az) - sqrt(bx * bx + bz * bz));
+}
+
+// -bricks contacts of a speed 2 ball against a sphere it touches from every side and direction,
+// bounced by the old functions and by the kernel on every path, against an exact mirror
+static double runReflect(const RunOptions& opt, long& steps)
+{
+	int count = opt.bricks > 0 ? opt.bricks : 4096;
+	std::vector<float> px(count), pz(count), ox(count), oz(count), vx(count), vz(count);
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		float at = 2 * sim::PI * rand() / RAND_MAX;
+		float dir = at + sim::PI + (sim::PI * rand() / RAND_MAX - 0.5f * sim::PI) * 0.98f;
+		ox[i] = 6.0f * rand() / RAND_MAX - 3.0f;
+		oz[i] = 9.0f * rand() / RAND_MAX - 4.5f;
+		px[i] = ox[i] + (2 * sim::BALL_RADIUS - 1e-4f) * cosf(at);
+		pz[i] = oz[i] + (2 * sim::BALL_RADIUS - 1e-4f) * sinf(at);
+		vx[i] = 2 * cosf(dir);
+		vz[i] = 2 * sinf(dir);
+	}
+	int rounds = opt.frames / 1000 > 0 ? (int)(opt.frames / 1000) : 1;
+	double total = 0;
+
+	// accuracy: the exact mirror in double against the old and the new bounces
+	double worst[3] = { 0, 0, 0 }, mean[3] = { 0, 0, 0 }, speedErr[3] = { 0, 0, 0 };
+	for (int i = 0; i < count; i++) {
+		double nx = px[i] - ox[i], nz = pz[i] - oz[i];
+		double k = 2 * (vx[i] * nx + vz[i] * nz) / (nx * nx + nz * nz);
+		double ex = vx[i] - k * nx, ez = vz[i] - k * nz;
+
+		sim::CBall obstacle, ball[3];
+		obstacle.setCenter(ox[i], sim::BALL_RADIUS, oz[i]);
+		for (int m = 0; m < 3; m++) {
+			ball[m].setCenter(px[i], sim::BALL_RADIUS, pz[i]);
+			ball[m].setPower(vx[i], vz[i]);
+		}
+		legacyBrickHitBy(obstacle, ball[0]);
+		legacyHolderHitBy(obstacle, ball[1]);
+		float rx = vx[i], rz = vz[i];
+		sim::reflectOffSphere(px[i], pz[i], ox[i], oz[i], rx, rz);
+		ball[2].setPower(rx, rz);
+		for (int m = 0; m < 3; m++) {
+			double degrees, speed;
+			bounceError(ex, ez, ball[m].getVelocity_X(), ball[m].getVelocity_Z(), degrees, speed);
+			mean[m] += degrees / count;
+			if (degrees > worst[m]) worst[m] = degrees;
+			if (speed > speedErr[m]) speedErr[m] = speed;
+		}
+	}
+
+	const char* names[3] = { "brick", "holder", "kernel" };
+	for (int m = 0; m < 2; m++) {
+		sim::CBall obstacle, ball;
+		double sum = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++)
+			for (int i = 0; i < count; i++) {
+				obstacle.setCenter(ox[i], sim::BALL_RADIUS, oz[i]);
+				ball.setCenter(px[i], sim::BALL_RADIUS, pz[i]);
+				ball.setPower(vx[i], vz[i]);
+				if (m == 0) legacyBrickHitBy(obstacle, ball);
+				else legacyHolderHitBy(obstacle, ball);
+				sum += ball.getVelocity_X();
+			}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		total += elapsed.count();
+		printf("legacy %-6s %8.1f M contacts/sec  angle error mean %7.3f max %7.3f deg  speed error %.4f  (checksum %.1f)\n",
+			names[m], (double)count * rounds / elapsed.count() * 1e-6, mean[m], worst[m], speedErr[m], sum);
+	}
+
+	std::vector<float> rx(count), rz(count), refX(count), refZ(count);
+	refX = vx;
+	refZ = vz;
+	sim::reflectBatchScalar(&px[0], &pz[0], &ox[0], &oz[0], &refX[0], &refZ[0], count);
+	sim::SimdPath best = sim::detectSimdPath();
+	for (int p = sim::SIMD_SCALAR; p <= best; p++) {
+		sim::setSimdPath((sim::SimdPath)p);
+		double sum = 0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int r = 0; r < rounds; r++) {
+			rx = vx;
+			rz = vz;
+			sim::reflectBatch(&px[0], &pz[0], &ox[0], &oz[0], &rx[0], &rz[0], count);
+			sum += rx[r % count];
+		}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		total += elapsed.count();
+		printf("kernel %-6s %8.1f M contacts/sec  angle error mean %7.3f max %7.3f deg  speed error %.4f  bits %s\n",
+			sim::simdPathName((sim::SimdPath)p), (double)count * rounds / elapsed.count() * 1e-6, mean[2], worst[2],
+			speedErr[2], rx == refX && rz == refZ ? "ok" : "MISMATCH");
+	}
+	sim::setSimdPath(best);
+	steps = (long)count * rounds;
+	return total;
+}
+
+// what a drawn ball carried before the hot / cold split: the physics ball next to its center,
+// radius, local matrix, material and mesh pointer, all in one record
+struct LegacyBall
+{
+	sim::CBall     ball;
+	float          center[3];
+	float          radius;
+	sim::Mat4      local;
+	sim::Material  material;
+	void*          mesh;
+};
+
+// the same pass as CEntityStore::integrate, over the records
+static void legacyIntegrate(std::vector<LegacyBall>& balls, float timeDiff, const sim::TableDesc& table)
+{
+	float scale = table.timeScale * timeDiff;
+	float rate = table.friction ? (float)exp(-sim::FRICTION * timeDiff) : 1.0f;
+	float minX = table.minX + sim::BALL_RADIUS, maxX = table.maxX - sim::BALL_RADIUS;
+	float minZ = table.minZ + sim::BALL_RADIUS, maxZ = table.maxZ - sim::BALL_RADIUS;
+	for (int i = 0; i < (int)balls.size(); i++) {
+		sim::CBall& b = balls[i].ball;
+		float vx = b.getVelocity_X(), vz = b.getVelocity_Z();
+		float moving = (fabsf(vx) > sim::STOP_SPEED || fabsf(vz) > sim::STOP_SPEED) ? 1.0f : 0.0f;
+		float ux = vx * moving, uz = vz * moving;
+		sim::Vec3 c = b.getCenter();
+		float px = c.x + scale * ux;
+		float pz = c.z + scale * uz;
+		float fx = (px < minX || px > maxX) ? -rate : rate;
+		float fz = (pz < minZ || pz > maxZ) ? -rate : rate;
+		b.setCenter(px < minX ? minX : (px > maxX ? maxX : px), c.y, pz < minZ ? minZ : (pz > maxZ ? maxZ : pz));
+		b.setPower(ux * fx, uz * fz);
+	}
+}
+
+// -balls balls (a million by default) with random shots on the billiard table, integrated
+// as records and from the entity store, frames / 1000 passes each
+static double runEntities(const RunOptions& opt, long& steps)
+{
+	int count = opt.balls > 0 ? opt.balls : 1000000;
+	int passes = opt.frames / 1000 > 0 ? (int)(opt.frames / 1000) : 1;
+	sim::TableDesc table = sim::BILLIARD_TABLE;
+
+	std::vector<LegacyBall> legacy(count);
+	sim::CEntityStore store;
+	store.reserve(count);
+	const float colours[4][3] = { { 1, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 } };
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		float x = (table.maxX - table.minX - 2 * sim::BALL_RADIUS) * rand() / RAND_MAX + table.minX + sim::BALL_RADIUS;
+		float z = (table.maxZ - table.minZ - 2 * sim::BALL_RADIUS) * rand() / RAND_MAX + table.minZ + sim::BALL_RADIUS;
+		float vx = 4.0f * rand() / RAND_MAX - 2.0f;
+		float vz = 4.0f * rand() / RAND_MAX - 2.0f;
+		const float* rgb = colours[i & 3];
+		sim::Material material = sim::makeMaterial(rgb[0], rgb[1], rgb[2], 1, 5.0f);
+
+		LegacyBall& b = legacy[i];
+		b.ball.setCenter(x, sim::BALL_RADIUS, z);
+		b.ball.setPower(vx, vz);
+		b.center[0] = x; b.center[1] = sim::BALL_RADIUS; b.center[2] = z;
+		b.radius = sim::BALL_RADIUS;
+		b.local = sim::mat4Translation(x, sim::BALL_RADIUS, z);
+		b.material = material;
+		b.mesh = 0;
+
+		int e = store.add(x, z, store.getMaterials().add(material));
+		store.setPower(e, vx, vz);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int p = 0; p < passes; p++)
+		legacyIntegrate(legacy, opt.timeDelta, table);
+	std::chrono::duration<double> records = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (int p = 0; p < passes; p++)
+		store.integrate(opt.timeDelta, table);
+	std::chrono::duration<double> split = std::chrono::steady_clock::now() - start;
+
+	double gap = 0;
+	for (int i = 0; i < count; i++) {
+		sim::Vec3 a = legacy[i].ball.getCenter(), b = store.getCenter(i);
+		gap = fmax(gap, fmax(fabs(a.x - b.x), fabs(a.z - b.z)));
+	}
+	printf("records : %4d bytes/ball  %8.1f M balls/sec\n", (int)sizeof(LegacyBall),
+		(double)count * passes / records.count() * 1e-6);
+	printf("split   : %4.1f bytes/ball hot, %.1f with the cold table  %8.1f M balls/sec  %d materials  max gap %g\n",
+		sim::CEntityStore::getHotBytesPerEntity(), sim::CEntityStore::getBytesPerEntity(),
+		(double)count * passes / split.count() * 1e-6, store.getMaterials().getCount(), gap);
+	steps = (long)count * passes;
+	return records.count() + split.count();
+}
+
+// stands in for a brick mesh: a block big enough that freeing it goes back to the system
+static const int RELEASE_BLOCK = 256 * 1024;
+static const double RELEASE_BUDGET = 0.2e-3;
+
+static void releaseBlock(void* block)
+{
+	delete[] (char*)block;
+}
+
+// -frames frames knocking out 2 bricks each and -bricks at once every 60th, with the brick
+// resources freed in the frame, drained 16 per frame, drained for RELEASE_BUDGET a frame, or
+// handed to a background worker. prints the mean and the worst frame, and the backlog: 16 a
+// frame falls behind a big burst, the budget works it off
+static double runRelease(const RunOptions& opt, long& steps)
+{
+	int burst = opt.bricks > 0 ? opt.bricks : 1000;
+	long frames = opt.frames < 600 ? opt.frames : 600;
+	const char* names[4] = { "immediate", "drain 16", "budget", "worker" };
+	double total = 0;
+	for (int mode = 0; mode < 4; mode++) {
+		sim::CDeferredQueue queue;
+		if (mode == 3)
+			queue.startWorker();
+		double worst = 0, sum = 0;
+		long freed = 0;
+		int peak = 0;
+		for (long f = 0; f < frames; f++) {
+			int removals = f % 60 == 0 ? burst : 2;
+			std::vector<char*> blocks(removals);
+			for (int i = 0; i < removals; i++) {
+				blocks[i] = new char[RELEASE_BLOCK];
+				memset(blocks[i], 1, RELEASE_BLOCK);
+			}
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < removals; i++) {
+				if (mode == 0) { releaseBlock(blocks[i]); freed++; }
+				else queue.push(releaseBlock, blocks[i]);
+			}
+			if (mode == 1)
+				queue.drain(16);
+			if (mode == 2)
+				queue.drainFor(RELEASE_BUDGET);
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			if (mode != 3 && queue.getPending() > peak)
+				peak = queue.getPending();
+			sum += elapsed.count();
+			if (elapsed.count() > worst)
+				worst = elapsed.count();
+		}
+		queue.stopWorker();
+		int left = queue.getPending();
+		queue.drain();
+		total += sum;
+		printf("%-10s  frame mean %8.1f us  worst %8.1f us  %ld released in frames, %d pending at the end, %d at most\n",
+			names[mode], sum / frames * 1e6, worst * 1e6, mode == 0 ? freed : queue.getReleased() - left, left, peak);
+	}
+	steps = frames * 4;
+	return total;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+static bool sameFile(const char* a, const char* b)
+{
+	FILE* fa = fopen(a, "rb");
+	FILE* fb = fopen(b, "rb");
+	bool same = fa && fb;
+	while (same) {
+		int ca = fgetc(fa), cb = fgetc(fb);
+		same = ca == cb;
+		if (ca == EOF)
+			break;
+	}
+	if (fa) fclose(fa);
+	if (fb) fclose(fb);
+	return same;
+}
+
+// a -bricks lattice level written in both forms and loaded back. the binary load maps the
+// file and checks every brick for overlap, the text load parses it as well
+static double runLevel(const RunOptions& opt, long& steps)
+{
+	int count = opt.bricks > 0 ? opt.bricks : 1000000;
+	const char* binPath = "simRunner_level.lvl";
+	const char* txtPath = "simRunner_level.txt";
+	const char* backPath = "simRunner_level_back.lvl";
+
+	sim::LevelData level;
+	makeStressLevel(level, count);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = sim::writeLevelBinary(binPath, level);
+	double writeBin = secondsSince(start);
+	start = std::chrono::steady_clock::now();
+	ok = ok && sim::writeLevelText(txtPath, level);
+	double writeTxt = secondsSince(start);
+	if (!ok) {
+		printf("can not write the level files\n");
+		return 0;
+	}
+
+	sim::CLevelFile file;
+	start = std::chrono::steady_clock::now();
+	ok = file.open(binPath);
+	double openBin = secondsSince(start);
+	std::string error;
+	start = std::chrono::steady_clock::now();
+	sim::checkLevel(file.getBrickPos(), file.getBrickCount(), file.getTable(), error);
+	double check = secondsSince(start);
+
+	sim::CLegoScene scene;
+	start = std::chrono::steady_clock::now();
+	scene.setTable(file.getTable());
+	scene.setup(file.getBrickPos(), file.getBrickCount());
+	double setup = secondsSince(start);
+	printf("binary  %9d bricks  %10ld bytes  write %8.2f ms  open %8.2f ms (overlap check %.2f ms)  %s\n",
+		file.getBrickCount(), (long)(sizeof(sim::LevelHeader) + 16 * level.colours.size() / 4 + 9L * count),
+		writeBin * 1e3, openBin * 1e3, check * 1e3, ok ? "ok" : file.getError().c_str());
+	printf("scene setup from the mapping %.2f ms\n", setup * 1e3);
+
+	sim::LevelData text;
+	start = std::chrono::steady_clock::now();
+	ok = sim::readLevelText(txtPath, text, error);
+	double readTxt = secondsSince(start);
+	printf("text    %9d bricks  write %8.2f ms  read %8.2f ms  %s\n",
+		text.getBrickCount(), writeTxt * 1e3, readTxt * 1e3, ok ? "ok" : error.c_str());
+
+	start = std::chrono::steady_clock::now();
+	ok = sim::convertLevel(txtPath, backPath, error);
+	double convert = secondsSince(start);
+	printf("convert text to binary %.2f ms, %s\n", convert * 1e3,
+		!ok ? error.c_str() : sameFile(binPath, backPath) ? "same bytes as the original" : "DIFFERS from the original");
+
+	// the second brick moved onto the first one
+	level.pos[2] = level.pos[0] + 0.5f * sim::BALL_RADIUS;
+	level.pos[3] = level.pos[1];
+	sim::writeLevelBinary(backPath, level);
+	sim::CLevelFile bad;
+	ok = bad.open(backPath);
+	printf("overlapping level: %s\n", ok ? "ACCEPTED" : bad.getError().c_str());
+
+	file.close();
+	remove(binPath);
+	remove(txtPath);
+	remove(backPath);
+	steps = count;
+	return openBin;
+}
+
+// resident set of the process, 0 where it can not be read
+static long residentKB(void)
+{
+	long pages = 0, resident = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(file);
+	return resident * 4;
+}
+
+// 12 bricks a row on the default table width, rows going up the table for as long as they
+// need. the colour changes every 8 rows
+static void makeScrollerLevel(sim::LevelData& level, int count)
+{
+	const float spacing = 2 * sim::BALL_RADIUS + 0.04f;
+	const float colours[8] = { 1, 1, 0, 1,  0, 0.6f, 1, 1 };
+	const int cols = 12;
+	int rows = (count + cols - 1) / cols;
+
+	level.colours.assign(colours, colours + 8);
+	level.pos.resize(2 * count);
+	level.colour.resize(count);
+	for (int i = 0; i < count; i++) {
+		level.pos[2 * i] = ((i % cols) - 0.5f * (cols - 1)) * spacing;
+		level.pos[2 * i + 1] = -2.0f + (i / cols) * spacing;
+		level.colour[i] = (uint8_t)((i / cols / 8) & 1);
+	}
+	level.table = sim::LEGO_TABLE;
+	level.table.maxZ = -2.0f + rows * spacing + 1.0f;
+}
+
+// a -bricks scroller streamed through a -memory KB budget while a camera flies up the level
+// at STREAM_SCROLL_SPEED, in frames of -dt paced to the wall clock. the game thread cost is
+// the update and the slot loads, the chunk latency is from queueing to ready on the I/O thread.
+// a second flight through STREAM_JUMP_BUDGET KB jumps the camera back now and then
+static const float STREAM_SCROLL_SPEED = 40.0f;
+static const float STREAM_VIEW_BEHIND  = 6.0f;
+static const float STREAM_VIEW_AHEAD   = 12.0f;
+static const int   STREAM_JUMP_BUDGET  = 16;
+static const int   STREAM_JUMP_FRAMES  = 200;
+static const float STREAM_JUMP_BACK    = 64.0f;
+
+// with jump, the camera jumps back past the chunks it keeps behind at most every
+// STREAM_JUMP_FRAMES, as the game's does when the shot ball goes back to the holder. it jumps
+// the frame after an eviction, which queued a chunk ahead, so that chunk finishes in the same
+// update that wants the ones behind again
+static double flyStream(const char* path, int budgetKB, bool jump, const RunOptions& opt, long& steps)
+{
+	long frames = opt.frames < 1000 ? opt.frames : 1000;
+	sim::CLevelStream stream;
+	if (!stream.open(path, (size_t)budgetKB * 1024)) {
+		printf("%s: %s\n", path, stream.getError().c_str());
+		return 0;
+	}
+	sim::CLegoScene scene;
+	scene.setTable(stream.getTable());
+	scene.setupSlots(stream.getSlotCount(), stream.getSlotCapacity());
+	printf("%s: %d chunks of %.0f, %d slots of %d bricks in a %d KB budget\n", jump ? "jumping back" : "forward",
+		stream.getChunkCount(), stream.getChunkDepth(), stream.getSlotCount(), stream.getSlotCapacity(), budgetKB);
+
+	double total = 0, worst = 0;
+	int peakBricks = 0;
+	long conflicts = 0, jumps = 0;
+	long jumpAt = -1, lastJump = 0;
+	float flown = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	for (steps = 0; steps < frames; steps++) {
+		flown += STREAM_SCROLL_SPEED * opt.timeDelta;
+		if (steps == jumpAt) {
+			flown = flown > STREAM_JUMP_BACK ? flown - STREAM_JUMP_BACK : 0;
+			lastJump = steps;
+			jumps++;
+		}
+		float camera = sim::LEGO_TABLE.minZ + flown;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		stream.update(camera - STREAM_VIEW_BEHIND, camera + STREAM_VIEW_AHEAD);
+		const std::vector<int>& evicted = stream.getEvicted();
+		if (jump && !evicted.empty() && steps - lastJump >= STREAM_JUMP_FRAMES)
+			jumpAt = steps + 1;
+		for (int k = 0; k < (int)evicted.size(); k++)
+			scene.clearSlot(evicted[k]);
+		for (int k = 0; k < (int)stream.getLoaded().size(); k++) {
+			int s = stream.getLoaded()[k];
+			if (std::find(evicted.begin(), evicted.end(), s) != evicted.end())
+				conflicts++;
+			scene.loadSlot(s, stream.getSlotBrickPos(s), stream.getSlotBrickCount(s));
+		}
+		double elapsed = secondsSince(start);
+		total += elapsed;
+		if (elapsed > worst)
+			worst = elapsed;
+		if (scene.getAliveCount() > peakBricks)
+			peakBricks = scene.getAliveCount();
+
+		if (!scene.isShot())
+			scene.shoot();
+		scene.step(opt.timeDelta);
+		std::this_thread::sleep_until(begin + std::chrono::duration<double>(opt.timeDelta * (steps + 1)));
+	}
+
+	if (jump)
+		printf("camera flew %.0f in %ld frames, jumped back %.0f %ld times\n", STREAM_SCROLL_SPEED * opt.timeDelta * frames,
+			frames, STREAM_JUMP_BACK, jumps);
+	else
+		printf("camera flew %.0f in %ld frames\n", STREAM_SCROLL_SPEED * opt.timeDelta * frames, frames);
+	printf("game thread per frame: mean %.1f us  worst %.1f us\n", total / frames * 1e6, worst * 1e6);
+	printf("chunks loaded %ld  evicted %ld  late %ld  bad %ld  latency mean %.2f ms  max %.2f ms\n",
+		stream.getLoadCount(), stream.getEvictionCount(), stream.getLateCount(), stream.getBadChunkCount(),
+		stream.getMeanLatency() * 1e3, stream.getMaxLatency() * 1e3);
+	printf("resident: %d chunks, %zu bytes now, %zu peak of %zu budget, %d bricks peak in the scene\n",
+		stream.getResidentChunks(), stream.getResidentBytes(), stream.getPeakResidentBytes(), stream.getBudget(), peakBricks);
+	printf("slots both evicted and loaded by one update: %ld%s\n", conflicts, conflicts ? "  WRONG" : "");
+	stream.close();
+	return total;
+}
+
+static double runStream(const RunOptions& opt, long& steps)
+{
+	int count = opt.bricks > 0 ? opt.bricks : 1000000;
+	const char* path = "simRunner_level.lvs";
+
+	std::string error;
+	{
+		sim::LevelData level;
+		makeScrollerLevel(level, count);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if (!sim::writeLevelChunked(path, level, sim::LEVEL_CHUNK_DEPTH, error)) {
+			printf("%s\n", error.c_str());
+			return 0;
+		}
+		printf("chunked level: %d bricks, %.0f long, written in %.1f ms\n", count,
+			level.table.maxZ - level.table.minZ, secondsSince(start) * 1e3);
+	}
+	long residentBefore = residentKB();
+
+	double total = flyStream(path, opt.memory, false, opt, steps);
+	if (residentBefore)
+		printf("process resident set %ld KB before open, %ld KB now\n", residentBefore, residentKB());
+	long jumpSteps = 0;
+	flyStream(path, STREAM_JUMP_BUDGET, true, opt, jumpSteps);
+
+	remove(path);
+	return total;
+}
+
+static double runConvert(const RunOptions& opt, long& steps)
+{
+	std::string error;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok;
+	if (opt.level) {
+		ok = sim::convertLevel(opt.level, opt.out, error);
+	}
+	else {
+		sim::LevelData level;
+		sim::makeDefaultLevel(level);
+		ok = sim::isLevelTextPath(opt.out) ? sim::writeLevelText(opt.out, level) : sim::writeLevelBinary(opt.out, level);
+		error = std::string("can not write ") + opt.out;
+	}
+	if (!ok)
+		printf("%s\n", error.c_str());
+	else
+		printf("%s -> %s\n", opt.level ? opt.level : "default level", opt.out);
+	steps = 1;
+	return secondsSince(start);
+}
+
+static double runGenerate(const RunOptions& opt, long& steps)
+{
+	sim::LevelGenDesc desc;
+	desc.seed = opt.seed;
+	desc.count = opt.bricks > 0 ? opt.bricks : 1000000;
+
+	sim::CThreadPool pool(opt.threads);
+	sim::LevelData level;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool ok = sim::generateLevel(desc, level, &pool);
+	double seconds = secondsSince(start);
+	if (!ok) {
+		printf("can not generate %d bricks\n", desc.count);
+		return 0;
+	}
+	int made[sim::GEN_COLOURS] = { 0 };
+	for (int i = 0; i < level.getBrickCount(); i++)
+		made[level.colour[i]]++;
+	printf("threads %2d  %9d bricks  %8.2f ms  %.0f bricks/sec  fill %d  rings %d  walls %d\n",
+		pool.getThreadCount(), level.getBrickCount(), seconds * 1e3, level.getBrickCount() / seconds,
+		made[sim::GEN_FILL], made[sim::GEN_RING], made[sim::GEN_WALL]);
+	printf("table x %.1f .. %.1f  z %.1f .. %.1f\n",
+		level.table.minX, level.table.maxX, level.table.minZ, level.table.maxZ);
+
+	// the same seed on one thread gives the same bricks
+	sim::LevelData single;
+	start = std::chrono::steady_clock::now();
+	sim::generateLevel(desc, single, 0);
+	double singleSeconds = secondsSince(start);
+	bool same = single.pos == level.pos && single.colour == level.colour;
+	printf("threads  1  %9d bricks  %8.2f ms  %s\n", single.getBrickCount(), singleSeconds * 1e3,
+		same ? "same level" : "DIFFERENT level");
+
+	std::string error;
+	start = std::chrono::steady_clock::now();
+	ok = sim::checkLevel(level.getBrickPos(), level.getBrickCount(), level.table, error);
+	printf("overlap check %.2f ms: %s\n", secondsSince(start) * 1e3, ok ? "no overlaps" : error.c_str());
+
+	if (opt.out) {
+		if (sim::isLevelChunkedPath(opt.out))
+			ok = sim::writeLevelChunked(opt.out, level, sim::LEVEL_CHUNK_DEPTH, error);
+		else if (sim::isLevelTextPath(opt.out))
+			ok = sim::writeLevelText(opt.out, level);
+		else
+			ok = sim::writeLevelBinary(opt.out, level);
+		if (ok)
+			printf("written to %s\n", opt.out);
+		else
+			printf("can not write %s %s\n", opt.out, error.c_str());
+	}
+	steps = level.getBrickCount();
+	return seconds;
+}
+
+// L1 data and last level cache read misses of this thread, from the hardware counters on Linux.
+// elsewhere, and where the counters are not exposed, isOpen is false
+class CCacheCounters {
+public:
+	CCacheCounters(void)
+	{
+		m_fd[0] = m_fd[1] = -1;
+#ifdef __linux__
+		const uint64_t events[2] = {
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+		for (int k = 0; k < 2; k++) {
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = events[k];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			m_fd[k] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+
+	~CCacheCounters(void)
+	{
+#ifdef __linux__
+		for (int k = 0; k < 2; k++)
+			if (m_fd[k] >= 0)
+				::close(m_fd[k]);
+#endif
+	}
+
+	bool isOpen(void) const { return m_fd[0] >= 0 && m_fd[1] >= 0; }
+
+	void start(void)
+	{
+#ifdef __linux__
+		for (int k = 0; k < 2 && isOpen(); k++) {
+			ioctl(m_fd[k], PERF_EVENT_IOC_RESET, 0);
+			ioctl(m_fd[k], PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	void stop(long long& l1, long long& last)
+	{
+		long long counts[2] = { 0, 0 };
+#ifdef __linux__
+		for (int k = 0; k < 2 && isOpen(); k++) {
+			ioctl(m_fd[k], PERF_EVENT_IOC_DISABLE, 0);
+			if (read(m_fd[k], &counts[k], sizeof(counts[k])) != sizeof(counts[k]))
+				counts[k] = 0;
+		}
+#endif
+		l1 = counts[0];
+		last = counts[1];
+	}
+
+private:
+	int m_fd[2];
+};
+
+// -balls balls at random on a square table, a quarter of it covered, all shot at random
+static void makeMortonStore(sim::CEntityStore& store, sim::TableDesc& table, int count)
+{
+	float side = sqrtf(count * sim::PI * sim::BALL_RADIUS * sim::BALL_RADIUS / 0.25f);
+	table = sim::BILLIARD_TABLE;
+	table.minX = table.minZ = -0.5f * side;
+	table.maxX = table.maxZ = 0.5f * side;
+	const float colours[4][3] = { { 1, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 } };
+
+	store.clear();
+	store.reserve(count);
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		float x = (side - 2 * sim::BALL_RADIUS) * rand() / RAND_MAX + table.minX + sim::BALL_RADIUS;
+		float z = (side - 2 * sim::BALL_RADIUS) * rand() / RAND_MAX + table.minZ + sim::BALL_RADIUS;
+		const float* rgb = colours[i & 3];
+		int e = store.add(x, z, store.getMaterials().add(sim::makeMaterial(rgb[0], rgb[1], rgb[2], 1, 5.0f)));
+		store.setPower(e, 4.0f * rand() / RAND_MAX - 2.0f, 4.0f * rand() / RAND_MAX - 2.0f);
+	}
+}
+
+// -frames steps (200 at most) of the same balls in creation order and in Morton order
+static double runMorton(const RunOptions& opt, long& steps)
+{
+	int count = opt.balls > 0 ? opt.balls : 100000;
+	int frames = (int)(opt.frames < 200 ? opt.frames : 200);
+	CCacheCounters counters;
+	double total = 0;
+	double perStep[2];
+
+	for (int sorted = 0; sorted < 2; sorted++) {
+		sim::CEntityStore store;
+		sim::TableDesc table;
+		makeMortonStore(store, table, count);
+		store.setSortInterval(sorted ? sim::MORTON_SORT_INTERVAL : 0);
+
+		// the sorts are timed with the steps
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		long long l1 = 0, last = 0;
+		counters.start();
+		int pairs = 0;
+		for (int f = 0; f < frames; f++)
+			pairs += store.step(opt.timeDelta, table);
+		counters.stop(l1, last);
+		double seconds = secondsSince(start);
+		total += seconds;
+		perStep[sorted] = seconds / frames;
+
+		// every handle still finds its ball, and the ball its handle. handles 0 and 1 of every
+		// four are red, material 0, then yellow and white
+		int lost = 0;
+		for (int h = 0; h < count; h++) {
+			int i = store.getIndex(h);
+			int material = (h & 3) < 2 ? 0 : (h & 3) - 1;
+			if (store.getHandle(i) != h || store.getMaterial(i) != material)
+				lost++;
+		}
+		printf("%-8s %d balls  %8.3f ms/step  %7.1f contacts/step", sorted ? "morton" : "created", count,
+			seconds / frames * 1e3, (double)pairs / frames);
+		if (counters.isOpen())
+			printf("  L1 misses %9.0f/step  last level %8.0f/step", (double)l1 / frames, (double)last / frames);
+		printf("  handles %s\n", lost ? "LOST" : "ok");
+	}
+	if (!counters.isOpen())
+		printf("cache counters not available here, times only\n");
+	printf("morton order %.2fx the speed of creation order, a sort every %d steps\n",
+		perStep[0] / perStep[1], sim::MORTON_SORT_INTERVAL);
+	steps = 2L * frames;
+	return total;
+}
+
+// what CBvh::cast answers, from every sphere in turn
+static sim::RayHit castEverything(const sim::CBvh& bvh, const std::vector<sim::Vec3>& centers,
+	const sim::Ray& ray, float radius, float maxT)
+{
+	sim::RayHit hit = { maxT, sim::vec3(0, 0, 0), -1 };
+	float a = sim::dot(ray.direction, ray.direction);
+	float reach = sim::BALL_RADIUS + radius;
+	for (int i = 0; i < (int)centers.size(); i++) {
+		if (!bvh.contains(i))
+			continue;
+		sim::Vec3 oc = ray.origin - centers[i];
+		float b = sim::dot(oc, ray.direction);
+		float c = sim::dot(oc, oc) - reach * reach;
+		float disc = b * b - a * c;
+		float t = c < 0 ? 0 : (-b - sqrtf(disc > 0 ? disc : 0)) / a;
+		if (b < 0 && (c < 0 || disc >= 0) && t < hit.t) {
+			hit.t = t;
+			hit.item = i;
+		}
+	}
+	return hit;
+}
+
+// rays up the table from random points behind the bricks, up to 60 degrees off straight
+static void makeBvhRays(std::vector<sim::Ray>& rays, const sim::TableDesc& table)
+{
+	for (int i = 0; i < (int)rays.size(); i++) {
+		float angle = (2.0f * rand() / RAND_MAX - 1.0f) * sim::PI / 3;
+		rays[i].origin = sim::vec3(table.minX + (table.maxX - table.minX) * rand() / RAND_MAX,
+			sim::BALL_RADIUS, table.minZ + sim::BALL_RADIUS);
+		rays[i].direction = sim::vec3(sinf(angle), 0, cosf(angle));
+	}
+}
+
+// -frames batches (100 at most) of 1000 rays and 1000 sphere casts, in microseconds a cast.
+// returns the casts that disagree with castEverything over the first 200 rays of each kind
+static int timeBvhCasts(const sim::CBvh& bvh, const std::vector<sim::Vec3>& centers,
+	const sim::TableDesc& table, int batches, double& rayMicros, double& sphereMicros)
+{
+	std::vector<sim::Ray> rays(1000);
+	std::vector<sim::RayHit> hits(rays.size()), sphereHits(rays.size());
+	float maxT = table.maxZ - table.minZ;
+	double raySeconds = 0, sphereSeconds = 0;
+	for (int b = 0; b < batches; b++) {
+		makeBvhRays(rays, table);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		bvh.castRays(&rays[0], (int)rays.size(), maxT, &hits[0]);
+		raySeconds += secondsSince(start);
+		start = std::chrono::steady_clock::now();
+		bvh.castSpheres(&rays[0], (int)rays.size(), sim::BALL_RADIUS, maxT, &sphereHits[0]);
+		sphereSeconds += secondsSince(start);
+	}
+	rayMicros = raySeconds / ((double)batches * rays.size()) * 1e6;
+	sphereMicros = sphereSeconds / ((double)batches * rays.size()) * 1e6;
+
+	int wrong = 0;
+	for (int i = 0; i < 200; i++) {
+		for (int kind = 0; kind < 2; kind++) {
+			float radius = kind ? sim::BALL_RADIUS : 0;
+			const sim::RayHit& got = kind ? sphereHits[i] : hits[i];
+			sim::RayHit want = castEverything(bvh, centers, rays[i], radius, maxT);
+			if (got.item != want.item && fabsf(got.t - want.t) > 1e-4f * (1 + want.t))
+				wrong++;
+			else if (got.item >= 0 && fabsf(sim::length(got.normal) - 1) > 1e-4f)
+				wrong++;
+		}
+	}
+	return wrong;
+}
+
+static double runBvh(const RunOptions& opt, long& steps)
+{
+	sim::LevelGenDesc desc;
+	desc.count = opt.bricks > 0 ? opt.bricks : 100000;
+	sim::LevelData level;
+	sim::generateLevel(desc, level, 0);
+	int balls = opt.balls > 0 ? opt.balls : 16;
+	int batches = (int)(opt.frames < 100 ? opt.frames : 100);
+
+	// the bricks, then the balls in the free rows in front of them
+	std::vector<sim::Vec3> centers(desc.count + balls);
+	for (int i = 0; i < desc.count; i++)
+		centers[i] = sim::vec3(level.pos[2 * i], sim::BALL_RADIUS, level.pos[2 * i + 1]);
+	srand(1);
+	for (int i = 0; i < balls; i++)
+		centers[desc.count + i] = sim::vec3(level.table.minX + (level.table.maxX - level.table.minX) * rand() / RAND_MAX,
+			sim::BALL_RADIUS, -3.0f);
+
+	sim::CBvh bvh;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bvh.build(&centers[0], (int)centers.size(), sim::BALL_RADIUS);
+	double build = secondsSince(start);
+	printf("build %d bricks + %d balls  %.2f ms  %d nodes  depth %d\n",
+		desc.count, balls, build * 1e3, bvh.getNodeCount(), bvh.getDepth());
+
+	double rayMicros, sphereMicros;
+	int wrong = timeBvhCasts(bvh, centers, level.table, batches, rayMicros, sphereMicros);
+	printf("rays %.3f us  sphere casts %.3f us  %d of 400 checked casts wrong\n", rayMicros, sphereMicros, wrong);
+
+	// a tenth of the bricks knocked out, and the balls rolled a little
+	int removals = desc.count / 10;
+	start = std::chrono::steady_clock::now();
+	for (int k = 0; k < removals; k++)
+		bvh.remove((int)(((long long)rand() * RAND_MAX + rand()) % desc.count));
+	for (int i = 0; i < balls; i++) {
+		centers[desc.count + i].x += 0.5f;
+		bvh.move(desc.count + i, centers[desc.count + i]);
+	}
+	double refit = secondsSince(start);
+	printf("%d removals and %d moves  %.3f us each\n", removals, balls, refit / (removals + balls) * 1e6);
+
+	wrong = timeBvhCasts(bvh, centers, level.table, batches, rayMicros, sphereMicros);
+	printf("rays %.3f us  sphere casts %.3f us  %d of 400 checked casts wrong\n", rayMicros, sphereMicros, wrong);
+
+	// every sphere on one center, as the empty slots of a streamed level are
+	std::vector<sim::Vec3> same(centers.size(), sim::vec3(0, 0, 0));
+	start = std::chrono::steady_clock::now();
+	bvh.build(&same[0], (int)same.size(), sim::BALL_RADIUS);
+	double sameBuild = secondsSince(start);
+	int depth = bvh.getDepth();
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < (int)same.size(); i++)
+		bvh.remove(i);
+	double sameRemove = secondsSince(start);
+	printf("%d on one center: build %.2f ms  depth %d  all removed in %.2f ms\n", (int)same.size(),
+		sameBuild * 1e3, depth, sameRemove * 1e3);
+
+	// the bricks cut into bands as a chunked level is, one group of slot size a band and the
+	// balls last, all empty until each slot is filled as streamLevel fills it
+	int chunks = (int)ceilf((level.table.maxZ - level.table.minZ) / sim::LEVEL_CHUNK_DEPTH);
+	std::vector<std::vector<sim::Vec3> > band(chunks);
+	for (int i = 0; i < desc.count; i++) {
+		int c = (int)((centers[i].z - level.table.minZ) / sim::LEVEL_CHUNK_DEPTH);
+		band[c < 0 ? 0 : (c < chunks ? c : chunks - 1)].push_back(centers[i]);
+	}
+	int slotSize = 1;
+	for (int c = 0; c < chunks; c++)
+		slotSize = (int)band[c].size() > slotSize ? (int)band[c].size() : slotSize;
+	std::vector<sim::Vec3> slotted((size_t)chunks * slotSize + balls, sim::vec3(0, 0, 0));
+	bvh.buildGroups(&slotted[0], (int)slotted.size(), sim::BALL_RADIUS, slotSize);
+	for (int c = 0; c < chunks; c++)
+		bvh.rebuildGroup(c, NULL, 0);
+	start = std::chrono::steady_clock::now();
+	for (int c = 0; c < chunks; c++) {
+		std::copy(band[c].begin(), band[c].end(), slotted.begin() + (size_t)c * slotSize);
+		if (!band[c].empty())
+			bvh.rebuildGroup(c, &band[c][0], (int)band[c].size());
+	}
+	std::copy(centers.begin() + desc.count, centers.end(), slotted.begin() + (size_t)chunks * slotSize);
+	bvh.rebuildGroup(chunks, &centers[desc.count], balls);
+	double fill = secondsSince(start);
+	printf("%d slots of %d filled in %.2f ms  %.3f ms a slot\n", chunks, slotSize, fill * 1e3,
+		fill / chunks * 1e3);
+	wrong = timeBvhCasts(bvh, slotted, level.table, batches, rayMicros, sphereMicros);
+	printf("rays %.3f us  sphere casts %.3f us  %d of 400 checked casts wrong\n", rayMicros, sphereMicros, wrong);
+	steps = 2L * 2 * batches * 1000;
+	return build + refit;
+}
+
+// first brick knocked out by the shot with the holder moved by dx, -1 when the ball is lost
+static int firstBrickHit(float dx)
+{
+	sim::CLegoScene scene;
+	scene.setup();
+	scene.moveHolder(dx);
+	scene.shoot();
+	for (int f = 0; f < 20000 && scene.isShot(); f++) {
+		scene.step(0.01f);
+		if (!scene.getRemoved().empty())
+			return scene.getRemoved()[0];
+	}
+	return -1;
+}
+
+// first ball the cue ball sets moving when shot with (vx, vz), -1 when none
+static int firstBallHit(float vx, float vz)
+{
+	sim::CBilliardScene scene;
+	scene.setup();
+	scene.shoot(3, vx, vz);
+	for (int f = 0; f < 20000 && scene.isMoving(); f++) {
+		scene.step(0.01f);
+		for (int i = 0; i < 3; i++)
+			if (scene.getBall(i).isMoving())
+				return i;
+	}
+	return -1;
+}
+
+// first item the preview hit, -1 when it only met cushions
+static int firstPreviewItem(const sim::CShotPreview& preview)
+{
+	for (int k = 1; k < preview.getPointCount(); k++)
+		if (preview.getItem(k) >= 0)
+			return preview.getItem(k);
+	return -1;
+}
+
+// what the games do on a mouse move: move the holder item and trace the shot ball's path
+static double runPreview(const RunOptions& opt, long& steps)
+{
+	sim::LevelGenDesc desc;
+	desc.count = opt.bricks > 0 ? opt.bricks : 100000;
+	sim::LevelData level;
+	sim::generateLevel(desc, level, 0);
+	sim::CLegoScene scene;
+	scene.setTable(level.table);
+	scene.setup(level.getBrickPos(), level.getBrickCount());
+
+	// the bricks and, last, the holder the ball can come back to
+	int holder = scene.getBrickCount();
+	std::vector<sim::Vec3> centers(holder + 1);
+	for (int i = 0; i < holder; i++)
+		centers[i] = scene.getBrick(i).getCenter();
+	centers[holder] = scene.getHolderBall().getCenter();
+	sim::CBvh bvh;
+	bvh.build(&centers[0], holder + 1, sim::BALL_RADIUS);
+
+	sim::CShotPreview preview;
+	preview.setTable(scene.getTable(), scene.getWalls(), scene.getWallCount());
+	preview.setRule(sim::PREVIEW_MIRROR);
+
+	// holder positions across the table, the shot at up to 60 degrees off straight
+	int traces = (int)(opt.frames < 10000 ? opt.frames : 10000);
+	std::vector<double> latency(traces);
+	std::vector<sim::Vec3> starts(traces);
+	std::vector<float> angles(traces);
+	srand(1);
+	float width = level.table.maxX - level.table.minX - 2 * sim::BALL_RADIUS;
+	for (int k = 0; k < traces; k++) {
+		starts[k] = sim::vec3(level.table.minX + sim::BALL_RADIUS + width * rand() / RAND_MAX, sim::BALL_RADIUS, sim::LEGO_SHOT_Z);
+		angles[k] = (2.0f * rand() / RAND_MAX - 1.0f) * sim::PI / 3;
+	}
+
+	// as the level is, and with a cushion across the near side too, so every path takes all
+	// of its bounces
+	sim::CWall closed[4];
+	for (int i = 0; i < 3; i++)
+		closed[i] = scene.getWalls()[i];
+	closed[3].setPlane(2, level.table.minZ, +1);
+	double total = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass)
+			preview.setTable(scene.getTable(), closed, 4);
+		long allocations = g_allocations.load(std::memory_order_relaxed);
+		long bounces = 0;
+		for (int k = 0; k < traces; k++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			sim::Vec3 h = starts[k];
+			h.z = sim::LEGO_HOLDER_Z;
+			bvh.move(holder, h);
+			preview.trace(bvh, starts[k], 2 * sinf(angles[k]), 2 * cosf(angles[k]));
+			latency[k] = secondsSince(start);
+			bounces += preview.getPointCount() - 2;
+		}
+		allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+		double sum = 0;
+		for (int k = 0; k < traces; k++)
+			sum += latency[k];
+		total += sum;
+		std::sort(latency.begin(), latency.end());
+		printf("%-10s %d bricks  %d traces  %.1f bounces each  mean %.2f us  p99 %.2f us  max %.2f us  allocations %ld\n",
+			pass ? "closed" : "open near", desc.count, traces, (double)bounces / traces, sum / traces * 1e6,
+			latency[(size_t)(traces * 0.99)] * 1e6, latency.back() * 1e6, allocations);
+	}
+
+	// the first thing hit, against stepping the scenes. lego shoots straight up the table
+	sim::CLegoScene lego;
+	lego.setup();
+	std::vector<sim::Vec3> bricks(sim::LEGO_BRICK_COUNT + 1);
+	for (int i = 0; i < sim::LEGO_BRICK_COUNT; i++)
+		bricks[i] = lego.getBrick(i).getCenter();
+	bricks[sim::LEGO_BRICK_COUNT] = lego.getHolderBall().getCenter();
+	sim::CBvh legoBvh;
+	legoBvh.build(&bricks[0], sim::LEGO_BRICK_COUNT + 1, sim::BALL_RADIUS);
+	sim::CShotPreview legoPreview;
+	legoPreview.setTable(lego.getTable(), lego.getWalls(), lego.getWallCount());
+	int legoWrong = 0, checks = 50;
+	for (int k = 0; k < checks; k++) {
+		float dx = -2.5f + 5.0f * k / (checks - 1);
+		sim::Vec3 shot = lego.getShotBall().getCenter(), hold = lego.getHolderBall().getCenter();
+		shot.x += dx;
+		hold.x += dx;
+		legoBvh.move(sim::LEGO_BRICK_COUNT, hold);
+		legoPreview.trace(legoBvh, shot, 0, 2);
+		if (firstPreviewItem(legoPreview) != firstBrickHit(dx))
+			legoWrong++;
+	}
+
+	sim::CBilliardScene billiard;
+	billiard.setup();
+	std::vector<sim::Vec3> balls(4);
+	for (int i = 0; i < 4; i++)
+		balls[i] = billiard.getBall(i).getCenter();
+	sim::CBvh billiardBvh;
+	billiardBvh.build(&balls[0], 4, sim::BALL_RADIUS);
+	sim::CShotPreview billiardPreview;
+	billiardPreview.setTable(billiard.getTable(), billiard.getWalls(), billiard.getWallCount());
+	billiardPreview.setRule(sim::PREVIEW_CUE);
+	int billiardWrong = 0;
+	for (int k = 0; k < checks; k++) {
+		float angle = 2 * sim::PI * k / checks + 0.01f;
+		float vx = 3 * cosf(angle), vz = 3 * sinf(angle);
+		billiardPreview.trace(billiardBvh, balls[3], vx, vz, sim::PREVIEW_MAX_BOUNCES, sim::PREVIEW_MAX_LENGTH, 3);
+		if (firstPreviewItem(billiardPreview) != firstBallHit(vx, vz))
+			billiardWrong++;
+	}
+	printf("first hit against the scenes: lego %d of %d differ, billiard %d of %d differ\n",
+		legoWrong, checks, billiardWrong, checks);
+
+	steps = 2L * traces;
+	return total;
+}
+
+// one ball with billiard friction and no cushions, stepped to rest and then asked in closed form
+static double runTrajectory(const RunOptions& opt, long& steps)
+{
+	sim::TableDesc table = sim::BILLIARD_TABLE;
+	sim::CBall ball;
+	ball.setCenter(0, sim::BALL_RADIUS, 0);
+	ball.setPower(opt.shotX, opt.shotZ);
+	sim::CTrajectory path(ball, table);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (steps = 0; steps < opt.frames && ball.isMoving(); steps++)
+		ball.ballUpdate(opt.timeDelta, table);
+	std::chrono::duration<double> stepped = std::chrono::steady_clock::now() - start;
+
+	sim::Vec3 rest = path.getRestPosition();
+	sim::Vec3 end = ball.getCenter();
+	printf("stepped : rest after %ld steps (t = %.3f)  at (%8.4f, %8.4f)\n",
+		steps, steps * opt.timeDelta, end.x, end.z);
+	printf("closed  : stop time %.3f  rest at (%8.4f, %8.4f)  gap %.5f\n",
+		path.getStopTime(), rest.x, rest.z, sqrt((rest.x - end.x) * (rest.x - end.x) + (rest.z - end.z) * (rest.z - end.z)));
+
+	// the same question asked many times over, one evaluation each
+	const long queries = 1000000;
+	double sum = 0;
+	start = std::chrono::steady_clock::now();
+	for (long i = 0; i < queries; i++)
+		sum += path.positionAt((i % 1000) * 0.001 * path.getStopTime()).x;
+	std::chrono::duration<double> closed = std::chrono::steady_clock::now() - start;
+	printf("closed  : %.1f M positionAt/sec (checksum %.1f), stepping to rest took %.1f us\n",
+		queries / closed.count() * 1e-6, sum, stepped.count() * 1e6);
+	return stepped.count();
+}
+
+// cue shot turned a little further for every world
+static void laneShot(const RunOptions& opt, int world, float& vx, float& vz)
+{
+	float angle = ((float)(world % 97) / 96.0f - 0.5f) * 0.6f;
+	vx = opt.shotX * cosf(angle) - opt.shotZ * sinf(angle);
+	vz = opt.shotX * sinf(angle) + opt.shotZ * cosf(angle);
+}
+
+// the same tables as plain CBall objects, stepped with the discrete rules the lanes copy.
+// not CBilliardScene, which sweeps walls and pairs and so plays a different game
+static float laneReferenceGap(const RunOptions& opt, const sim::CLaneBilliard& lanes, int worlds)
+{
+	sim::TableDesc table = sim::BILLIARD_TABLE;
+	sim::CWall walls[4];
+	walls[0].setPlane(2, table.maxZ, -1);
+	walls[1].setPlane(2, table.minZ, +1);
+	walls[2].setPlane(0, table.maxX, -1);
+	walls[3].setPlane(0, table.minX, +1);
+
+	float gap = 0;
+	for (int w = 0; w < worlds; w++) {
+		sim::CBall balls[sim::LANE_BALLS];
+		for (int b = 0; b < sim::LANE_BALLS; b++)
+			balls[b].setCenter(sim::billiardBallPos[b][0], sim::BALL_RADIUS, sim::billiardBallPos[b][1]);
+		float vx, vz;
+		laneShot(opt, w, vx, vz);
+		balls[3].setPower(vx, vz);
+		for (long f = 0; f < opt.frames; f++) {
+			for (int b = 0; b < sim::LANE_BALLS; b++) {
+				balls[b].ballUpdate(opt.timeDelta, table);
+				for (int k = 0; k < 4; k++)
+					walls[k].hitBy(balls[b]);
+			}
+			for (int a = 0; a < sim::LANE_BALLS; a++)
+				for (int b = a + 1; b < sim::LANE_BALLS; b++)
+					balls[a].hitBy(balls[b]);
+		}
+		for (int b = 0; b < sim::LANE_BALLS; b++) {
+			sim::Vec3 c = balls[b].getCenter(), l = lanes.getCenter(w, b);
+			float d = fabsf(c.x - l.x) + fabsf(c.z - l.z);
+			if (d > gap)
+				gap = d;
+		}
+	}
+	return gap;
+}
+
+static double runLanes(const RunOptions& opt, long& steps)
+{
+	sim::SimdPath best = sim::detectSimdPath();
+	std::vector<float> reference;
+	double total = 0;
+	for (int p = sim::SIMD_SCALAR; p <= best; p++) {
+		sim::CLaneBilliard lanes;
+		lanes.setup(opt.worlds);
+		for (int w = 0; w < opt.worlds; w++) {
+			float vx, vz;
+			laneShot(opt, w, vx, vz);
+			lanes.shoot(w, 3, vx, vz);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (long f = 0; f < opt.frames; f++)
+			lanes.step(opt.timeDelta, (sim::SimdPath)p);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		total += elapsed.count();
+
+		std::vector<float> state;
+		for (int w = 0; w < opt.worlds; w++) {
+			for (int b = 0; b < sim::LANE_BALLS; b++) {
+				sim::Vec3 c = lanes.getCenter(w, b);
+				state.push_back(c.x);
+				state.push_back(c.z);
+			}
+		}
+		if (p == sim::SIMD_SCALAR)
+			reference = state;
+		printf("%-6s  %8.2f M world-steps/sec  moving %d  lanes %s", sim::simdPathName((sim::SimdPath)p),
+			(double)opt.worlds * opt.frames / elapsed.count() * 1e-6, lanes.getMovingCount(),
+			state == reference ? "match" : "MISMATCH");
+		if (p == sim::SIMD_SCALAR)
+			printf("  discrete CBall gap %.6f", laneReferenceGap(opt, lanes, opt.worlds < 64 ? opt.worlds : 64));
+		printf("\n");
+	}
+	steps = (long)opt.worlds * opt.frames * (best + 1);
+	return total;
+}
+
+static void printShot(const char* name, int threads, const sim::ShotResult& r)
+{
+	printf("%-13s threads %2d  shot (%7.4f, %7.4f)  power %.3f  reds %d  foul %s  score %.4f"
+		"  %ld candidates in %.1f ms  %.0f/sec\n", name, threads, r.vx, r.vz, r.power, r.targetsHit,
+		r.foul ? "yes" : "no", r.score, r.evaluated, r.seconds * 1e3, r.evaluated / r.seconds);
+}
+
+// the search again on a warm cache, then the cost of a single lookup
+static void runCacheCheck(sim::CShotSearch& search, sim::CShotCache& cache, const sim::CBilliardScene& scene,
+	const sim::ShotSearchDesc& desc, const sim::ShotResult& best)
+{
+	printf("cache    : %d of %d entries, %ld hits %ld misses %ld evictions\n", cache.getSize(),
+		cache.getCapacity(), cache.getHits(), cache.getMisses(), cache.getEvictions());
+
+	long hits = cache.getHits(), misses = cache.getMisses();
+	sim::ShotResult again = search.search(scene, desc);
+	printShot("cached", search.getThreadCount(), again);
+	printf("cache    : %ld hits %ld misses on the second search, same shot: %s\n", cache.getHits() - hits,
+		cache.getMisses() - misses, again.vx == best.vx && again.vz == best.vz ? "yes" : "NO");
+
+	// which of the samples played are in the cache now, then lookups of those alone. the
+	// shards fill unevenly, so fewer samples than the capacity are found: a shard that is full
+	// evicts while another still has room
+	std::vector<sim::CBall> balls(scene.getBallCount());
+	for (int i = 0; i < scene.getBallCount(); i++)
+		balls[i] = scene.getBall(i);
+	sim::ShotKey key;
+	sim::ShotOutcome outcome;
+	std::vector<long> cached;
+	for (long i = 0; i < again.evaluated; i++) {
+		float angle, power;
+		sim::CShotSearch::sample(desc, i, angle, power);
+		sim::CShotCache::makeKey(balls, desc.cue, power * cosf(angle), power * sinf(angle), key);
+		if (cache.find(key, outcome))
+			cached.push_back(i);
+	}
+	printf("cache    : %d of %ld samples found, %.1f%% of the capacity\n", (int)cached.size(), again.evaluated,
+		100.0 * cached.size() / cache.getCapacity());
+	if (cached.empty())
+		return;
+
+	const long queries = 200000;
+	long found = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (long i = 0; i < queries; i++) {
+		float angle, power;
+		sim::CShotSearch::sample(desc, cached[i % cached.size()], angle, power);
+		sim::CShotCache::makeKey(balls, desc.cue, power * cosf(angle), power * sinf(angle), key);
+		if (cache.find(key, outcome))
+			found++;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	printf("cache    : %.2f us per lookup, %ld of %ld found\n", elapsed.count() / queries * 1e6, found, queries);
+}
+
+static double runSearch(const RunOptions& opt, long& steps)
+{
+	sim::CBilliardScene scene;
+	scene.setup();
+
+	sim::ShotSearchDesc desc;
+	desc.samples = opt.samples;
+	desc.budget = opt.budget * 1e-3;
+	desc.deterministic = opt.deterministic;
+
+	sim::CShotSearch search(opt.threads);
+	sim::CShotCache cache(opt.cache);
+	if (opt.cache)
+		search.setCache(&cache);
+	sim::ShotResult best = search.search(scene, desc);
+	printShot(opt.deterministic ? "deterministic" : "timed", search.getThreadCount(), best);
+
+	if (opt.cache)
+		runCacheCheck(search, cache, scene, desc, best);
+
+	// the deterministic answer may not depend on the thread count. a cached search plays
+	// snapped shots, so the single thread one gets a fresh cache of its own to compare with
+	if (opt.deterministic && search.getThreadCount() > 1) {
+		sim::CShotSearch single(1);
+		sim::CShotCache singleCache(opt.cache);
+		if (opt.cache)
+			single.setCache(&singleCache);
+		sim::ShotResult check = single.search(scene, desc);
+		printShot("deterministic", 1, check);
+		printf("same shot on 1 and %d threads: %s\n", search.getThreadCount(),
+			check.vx == best.vx && check.vz == best.vz ? "yes" : "NO");
+	}
+
+	// and the shot does what the search says on the stepped game engine
+	scene.shoot(desc.cue, best.vx, best.vz);
+	for (steps = 0; steps < 100000 && scene.isMoving(); steps++)
+		scene.step(opt.timeDelta);
+	if (!opt.quiet)
+		for (int i = 0; i < scene.getBallCount(); i++)
+			printBall("ball", i, scene.getBall(i));
+	return best.seconds;
+}
+
+// -worlds tables with the holder or the cue shot varied per world, stepped -frames times
+static double runBatchOn(const RunOptions& opt, int threads, long& steps)
+{
+	sim::CWorldBatch batch;
+	for (int w = 0; w < opt.worlds; w++) {
+		float spread = (float)(w % 97) / 96.0f - 0.5f;
+		if (opt.mode == RUN_LEGO) {
+			sim::CLegoScene& scene = batch.addLego();
+			scene.setup();
+			scene.moveHolder(4.0f * spread);
+			scene.shoot();
+		}
+		else {
+			sim::CBilliardScene& scene = batch.addBilliard();
+			scene.setup();
+			float vx, vz;
+			laneShot(opt, w, vx, vz);
+			scene.shoot(3, vx, vz);
+		}
+	}
+
+	sim::CThreadPool pool(threads);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	batch.advance(pool, opt.timeDelta, (int)opt.frames);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// worlds never share state, so the result may not depend on the thread count
+	double checksum = 0;
+	for (int w = 0; w < batch.getLegoCount(); w++)
+		checksum += batch.getLego(w).getShotBall().getCenter().x + batch.getLego(w).getAliveCount();
+	for (int w = 0; w < batch.getBilliardCount(); w++)
+		for (int i = 0; i < batch.getBilliard(w).getBallCount(); i++)
+			checksum += batch.getBilliard(w).getBall(i).getCenter().x;
+
+	steps = (long)opt.worlds * opt.frames;
+	printf("threads %2d  worlds %d x steps %ld  %.3f s  %.0f world-steps/sec  steals %ld  checksum %.4f\n",
+		pool.getThreadCount(), opt.worlds, opt.frames, elapsed.count(),
+		steps / elapsed.count(), pool.getStealCount(), checksum);
+	return elapsed.count();
+}
+
+static double runBatch(const RunOptions& opt, long& steps)
+{
+	double single = runBatchOn(opt, 1, steps);
+	sim::CThreadPool probe(opt.threads);
+	if (probe.getThreadCount() == 1)
+		return single;
+	double seconds = runBatchOn(opt, opt.threads, steps);
+	printf("speedup %.2fx on %d threads\n", single / seconds, probe.getThreadCount());
+	return seconds;
+}
+
+int main(int argc, char** argv)
+{
+	RunOptions opt;
+	if (!parseArgs(argc, argv, opt)) {
+		usage();
+		return 1;
+	}
+
+	double seconds = 0;
+	long steps = 0;
+	if (opt.batch)
+		seconds = runBatch(opt, steps);
+	else switch (opt.mode) {
+	case RUN_LEGO:     seconds = runLego(opt, steps); break;
+	case RUN_BILLIARD: seconds = runBilliard(opt, steps); break;
+	case RUN_OVERLAP:  seconds = runOverlap(opt, steps); break;
+	case RUN_TRAJECTORY: seconds = runTrajectory(opt, steps); break;
+	case RUN_LANES:    seconds = runLanes(opt, steps); break;
+	case RUN_SEARCH:   seconds = runSearch(opt, steps); break;
+	case RUN_REFLECT:  seconds = runReflect(opt, steps); break;
+	case RUN_ENTITIES: seconds = runEntities(opt, steps); break;
+	case RUN_RELEASE:  seconds = runRelease(opt, steps); break;
+	case RUN_LEVEL:    seconds = runLevel(opt, steps); break;
+	case RUN_STREAM:   seconds = runStream(opt, steps); break;
+	case RUN_CONVERT:  seconds = runConvert(opt, steps); break;
+	case RUN_GENERATE: seconds = runGenerate(opt, steps); break;
+	case RUN_MORTON:   seconds = runMorton(opt, steps); break;
+	case RUN_BVH:      seconds = runBvh(opt, steps); break;
+	case RUN_PREVIEW:  seconds = runPreview(opt, steps); break;
+	}
+
+	printf("frames: %ld  time: %.3f s  steps/sec: %.0f\n",
+		steps, seconds, seconds > 0 ? steps / seconds : 0.0);
+	return 0;
+}
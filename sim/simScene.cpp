@@ -0,0 +1,612 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simScene.cpp
+//
+// Desc: Frame update of both games, in the same order the old Display() functions used.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simScene.h"
+#include "sweptTests.h"
+#include <algorithm>
+#include <cmath>
+
+// initialize the position (coordinate) of each brick (brick0 ~ brick53)
+const float sim::legoBrickPos[sim::LEGO_BRICK_COUNT][2] = {
+	{-0.21f,-2.0f} , {-0.63f, -2.0f} , {0.63f, -2.0f} , {0.21f, -2.0f},
+	{-1.05f, -2.0f}, {-1.47f, -2.0f}, {1.47f, -2.0f}, {1.05f, -2.0f},
+	{-1.8f, -1.7f}, {-2.1f, -1.4f}, {2.1f, -1.4f}, {1.8f, -1.7f},
+	{-2.1f, -0.98f}, {-2.1f, -0.56f}, {2.1f, -0.56f}, {2.1f, -0.98f},
+	{-2.1f, -0.14f}, {-2.1f, 0.28f}, {2.1f, 0.28f}, {2.1f, -0.14f},
+	{-2.1f, 0.7f}, {-2.1f, 1.12f}, {2.1f, 1.12f}, {2.1f, 0.7f},
+	{-2.1f, 1.54f}, {-2.1f, 1.96f}, {2.1f, 1.96f}, {2.1f, 1.54f},
+	{-2.1f, 2.38f}, {-1.8f, 2.68f}, {1.8f, 2.68f}, {2.1f, 2.38f},
+	{-1.47f, 2.98f}, {-1.05f, 2.98f}, {1.05f, 2.98f}, {1.47f, 2.98f},
+	{-0.63f, 2.87f}, {-0.21f, 2.98f}, {0.21f, 2.98f}, {0.63f, 2.98f},
+	{-0.21f, -0.56f}, {-0.63f, -0.56f}, {0.63f, -0.56f}, {0.21f, -0.56f},
+	{-0.93f, -0.26f}, {-1.23f, 0.04f}, {1.23f, 0.04f}, {0.93f, -0.26f},
+	{-0.21f, 0.28f}, {-0.21f, 0.7f}, {-0.93f, 1.54f}, {-0.93f, 1.96f},
+	{0.93f, 1.54f}, {0.93f, 1.96f} };
+
+// initialize the position (coordinate) of each ball (ball0 ~ ball3)
+const float sim::billiardBallPos[sim::BILLIARD_BALL_COUNT][2] = {
+	{-2.7f,0} , {+2.4f,0} , {3.3f,0} , {-2.7f,-0.9f} };
+
+// -----------------------------------------------------------------------------
+// CLegoScene
+// -----------------------------------------------------------------------------
+
+sim::CLegoScene::CLegoScene(void)
+{
+	m_aliveCount = 0;
+	m_slotCapacity = 0;
+	m_isShot = false;
+	setTable(LEGO_TABLE);
+}
+
+void sim::CLegoScene::setTable(const TableDesc& table)
+{
+	m_table = table;
+
+	// up, right and left. the near side is open, that is where the ball gets lost
+	m_walls[0].setPlane(2, table.maxZ, -1);
+	m_walls[1].setPlane(0, table.maxX, -1);
+	m_walls[2].setPlane(0, table.minX, +1);
+}
+
+void sim::CLegoScene::setup(void)
+{
+	setup(legoBrickPos, LEGO_BRICK_COUNT);
+}
+
+void sim::CLegoScene::setup(const float (*brickPos)[2], int count)
+{
+	setupSlots(1, count);
+	loadSlot(0, brickPos, count);
+}
+
+void sim::CLegoScene::setupSlots(int slots, int capacity)
+{
+	int count = slots * capacity;
+	m_bricks.assign(count, CBrick());
+	m_alive.assign((count + 63) / 64, 0);
+	m_removed.clear();
+	m_aliveCount = 0;
+	m_slotCapacity = capacity;
+	m_slots.assign(slots, BrickSlot());
+	for (int s = 0; s < slots; s++) {
+		m_slots[s].minZ = 1;
+		m_slots[s].maxZ = 0;
+	}
+
+	m_holderBall.setCenter(0, BALL_RADIUS, LEGO_HOLDER_Z);
+	m_holderBall.setPower(0, 0);
+	resetShotBall();
+}
+
+void sim::CLegoScene::loadSlot(int slot, const float (*brickPos)[2], int count)
+{
+	clearSlot(slot);
+	BrickSlot& s = m_slots[slot];
+	int first = slot * m_slotCapacity;
+	m_slotX.resize(count);
+	m_slotZ.resize(count);
+	for (int i = 0; i < count; i++) {
+		int b = first + i;
+		m_bricks[b].setCenter(brickPos[i][0], BALL_RADIUS, brickPos[i][1]);
+		m_bricks[b].setPower(0, 0);
+		m_alive[b >> 6] |= (uint64_t)1 << (b & 63);
+		m_slotX[i] = brickPos[i][0];
+		m_slotZ[i] = brickPos[i][1];
+		if (i == 0 || m_slotZ[i] < s.minZ) s.minZ = m_slotZ[i];
+		if (i == 0 || m_slotZ[i] > s.maxZ) s.maxZ = m_slotZ[i];
+	}
+	m_aliveCount += count;
+	s.grid.build(m_slotX, m_slotZ, 2 * BALL_RADIUS);
+}
+
+void sim::CLegoScene::clearSlot(int slot)
+{
+	BrickSlot& s = m_slots[slot];
+	int first = slot * m_slotCapacity;
+	for (int b = first; b < first + m_slotCapacity; b++) {
+		uint64_t bit = (uint64_t)1 << (b & 63);
+		if (m_alive[b >> 6] & bit) {
+			m_alive[b >> 6] &= ~bit;
+			m_aliveCount--;
+		}
+	}
+	s.grid.clear();
+	s.minZ = 1;
+	s.maxZ = 0;
+}
+
+void sim::CLegoScene::resetShotBall(void)
+{
+	m_shotBall.setPower(0, 0);
+	m_shotBall.setCenter(m_holderBall.getCenter().x, BALL_RADIUS, LEGO_SHOT_Z);
+	m_prevShot = m_shotBall.getCenter();
+	m_isShot = false;
+}
+
+void sim::CLegoScene::shoot(void)
+{
+	m_shotBall.setPower(0, LEGO_SHOT_SPEED);
+	m_isShot = true;
+}
+
+void sim::CLegoScene::moveHolder(float dx)
+{
+	Vec3 c = m_holderBall.getCenter();
+	if (c.x + dx > LEGO_HOLDER_LIMIT || c.x + dx < -LEGO_HOLDER_LIMIT)
+		return;
+	m_holderBall.setCenter(c.x + dx, c.y, c.z);
+	if (!m_isShot) {
+		m_shotBall.setCenter(c.x + dx, c.y, c.z + 2 * BALL_RADIUS);
+		m_prevShot = m_shotBall.getCenter();
+	}
+}
+
+sim::Vec3 sim::CLegoScene::getShotBallCenter(float alpha) const
+{
+	return lerp(m_prevShot, m_shotBall.getCenter(), alpha);
+}
+
+float sim::CLegoScene::getMaxSpeed(void) const
+{
+	float vx = m_shotBall.getVelocity_X(), vz = m_shotBall.getVelocity_Z();
+	return m_table.timeScale * sqrtf(vx * vx + vz * vz);
+}
+
+void sim::CLegoScene::step(float timeDelta, int substeps)
+{
+	m_prevShot = m_shotBall.getCenter();
+	if (substeps < 1)
+		substeps = 1;
+	for (int i = 0; i < substeps; i++)
+		substep(timeDelta / substeps);
+}
+
+void sim::CLegoScene::substep(float timeDelta)
+{
+	if (!m_shotBall.isMoving()) {
+		m_shotBall.setPower(0, 0);
+		return;
+	}
+
+	// move the shot ball to its first contact inside the step, bounce, and go on with the rest
+	// of the step. a long step can not carry it through a brick, the holder or a wall this way
+	float left = 1;
+	for (int k = 0; k < MAX_CONTACTS_PER_STEP && left > 0; k++) {
+		Vec3 p = m_shotBall.getCenter();
+		float scale = m_table.timeScale * timeDelta * left;
+		Vec3 d = { scale * m_shotBall.getVelocity_X(), 0, scale * m_shotBall.getVelocity_Z() };
+		float contact = 2 * BALL_RADIUS - CONTACT_SKIN;
+
+		float first = 1;
+		int wall = -1, brick = -1;
+		bool holder = false;
+		float t;
+		for (int i = 0; i < 3; i++) {
+			if (m_walls[i].sweep(p, d, BALL_RADIUS - CONTACT_SKIN, t) && t < first) {
+				first = t;
+				wall = i;
+			}
+		}
+		if (sweptSphereSphere(p, d, m_holderBall.getCenter(), contact, t) && t < first) {
+			first = t;
+			wall = -1;
+			holder = true;
+		}
+
+		// only the bricks along the path, found without visiting the far side of the table.
+		// a slot is a band of the level, most of them lie nowhere near the path
+		float pathMinZ = (d.z < 0 ? p.z + d.z : p.z) - 2 * BALL_RADIUS;
+		float pathMaxZ = (d.z < 0 ? p.z : p.z + d.z) + 2 * BALL_RADIUS;
+		for (int s = 0; s < (int)m_slots.size(); s++) {
+			if (m_slots[s].maxZ < pathMinZ || m_slots[s].minZ > pathMaxZ)
+				continue;
+			m_slots[s].grid.querySweep(p.x, p.z, p.x + d.x, p.z + d.z, 2 * BALL_RADIUS, m_candidates);
+			for (int j = 0; j < (int)m_candidates.size(); j++) {
+				int i = s * m_slotCapacity + m_candidates[j];
+				if (sweptSphereSphere(p, d, m_bricks[i].getCenter(), contact, t) && t < first) {
+					first = t;
+					wall = -1;
+					holder = false;
+					brick = i;
+				}
+			}
+		}
+
+		m_shotBall.setCenter(p.x + d.x * first, p.y, p.z + d.z * first);
+		if (brick >= 0) {
+			if (m_bricks[brick].hitBy(m_shotBall)) {
+				m_alive[brick >> 6] &= ~((uint64_t)1 << (brick & 63));
+				m_removed.push_back(brick);
+				m_aliveCount--;
+				m_slots[brick / m_slotCapacity].grid.remove(brick % m_slotCapacity);
+			}
+		}
+		else if (holder) {
+			m_holderBall.hitBy(m_shotBall);
+		}
+		else if (wall >= 0) {
+			m_walls[wall].hitBy(m_shotBall);
+		}
+		else {
+			break;
+		}
+		left *= 1 - first;
+	}
+
+	if (m_shotBall.getCenter().z <= LEGO_LOST_Z)
+		resetShotBall();
+}
+
+// -----------------------------------------------------------------------------
+// CBilliardScene
+// -----------------------------------------------------------------------------
+
+sim::CBilliardScene::CBilliardScene(void)
+{
+	m_engine = ENGINE_STEPPED;
+	m_sleeping = true;
+	setTable(BILLIARD_TABLE);
+}
+
+void sim::CBilliardScene::setEngine(BilliardEngine engine)
+{
+	m_engine = engine;
+	wakeAll();
+	if (engine == ENGINE_EVENT)
+		m_eventSim.load(m_balls);
+}
+
+void sim::CBilliardScene::shoot(int i, float vx, float vz)
+{
+	if (isAsleep(i))
+		wakeIsland(i);
+	m_balls[i].setPower(vx, vz);
+	m_restSteps[i] = 0;
+	if (m_engine == ENGINE_EVENT)
+		m_eventSim.shoot(i, vx, vz);
+}
+
+void sim::CBilliardScene::setTable(const TableDesc& table)
+{
+	m_table = table;
+	m_walls[0].setPlane(2, table.maxZ, -1);
+	m_walls[1].setPlane(2, table.minZ, +1);
+	m_walls[2].setPlane(0, table.maxX, -1);
+	m_walls[3].setPlane(0, table.minX, +1);
+	m_sap.setBounds(table.minZ, table.maxZ);
+	m_eventSim.setTable(table);
+}
+
+void sim::CBilliardScene::setup(void)
+{
+	setup(billiardBallPos, BILLIARD_BALL_COUNT);
+}
+
+void sim::CBilliardScene::setup(const float (*ballPos)[2], int count)
+{
+	m_balls.assign(count, CBall());
+	m_prev.resize(count);
+	m_start.resize(count);
+	m_x.resize(count);
+	m_z.resize(count);
+	for (int i = 0; i < count; i++) {
+		m_balls[i].setCenter(ballPos[i][0], BALL_RADIUS, ballPos[i][1]);
+		m_prev[i] = m_balls[i].getCenter();
+	}
+	wakeAll();
+	if (m_engine == ENGINE_EVENT)
+		m_eventSim.load(m_balls);
+}
+
+void sim::CBilliardScene::setSleeping(bool enable)
+{
+	m_sleeping = enable;
+	if (!enable)
+		wakeAll();
+}
+
+void sim::CBilliardScene::wakeAll(void)
+{
+	int n = (int)m_balls.size();
+	m_awake.resize(n);
+	for (int i = 0; i < n; i++)
+		m_awake[i] = i;
+	m_restSteps.assign(n, 0);
+	m_sleepSlot.assign(n, -1);
+	m_sleepers.clear();
+	m_sleepGrid.clear();
+	m_sap.clear();
+}
+
+void sim::CBilliardScene::wakeIsland(int i)
+{
+	// wake the ball and every sleeping ball it rests against, and theirs, so a pack is
+	// taken back as a whole and its balls collide with each other in the same step
+	m_wakeStack.clear();
+	m_wakeStack.push_back(i);
+	while (!m_wakeStack.empty()) {
+		int j = m_wakeStack.back();
+		m_wakeStack.pop_back();
+		if (m_sleepSlot[j] < 0)
+			continue;
+		m_sleepGrid.remove(m_sleepSlot[j]);
+		m_sleepSlot[j] = -1;
+		m_restSteps[j] = 0;
+		m_awake.push_back(j);
+		m_start[j] = m_prev[j] = m_balls[j].getCenter();
+
+		Vec3 c = m_balls[j].getCenter();
+		m_sleepGrid.queryOverlap(c.x, c.z, 2 * BALL_RADIUS + ISLAND_GAP, m_neighbours);
+		for (int k = 0; k < (int)m_neighbours.size(); k++)
+			if (m_sleepSlot[m_sleepers[m_neighbours[k]]] >= 0)
+				m_wakeStack.push_back(m_sleepers[m_neighbours[k]]);
+	}
+
+	// the sweep and prune order is kept by position in m_awake, which just changed
+	m_sap.clear();
+}
+
+void sim::CBilliardScene::updateSleep(void)
+{
+	int awake = (int)m_awake.size();
+	int ready = 0;
+	for (int k = 0; k < awake; k++) {
+		int i = m_awake[k];
+		if (m_balls[i].isMoving())
+			m_restSteps[i] = 0;
+		else if (++m_restSteps[i] >= SLEEP_DELAY)
+			ready++;
+	}
+
+	// the grid is rebuilt for a batch at a time, the few balls waiting for it cost little
+	int sleeping = getSleepingCount();
+	if (ready == 0 || (ready < awake && (ready < SLEEP_BATCH || 4 * ready < sleeping)))
+		return;
+
+	std::vector<int> sleepers;
+	sleepers.reserve(sleeping + ready);
+	for (int k = 0; k < (int)m_sleepers.size(); k++)
+		if (m_sleepSlot[m_sleepers[k]] >= 0)
+			sleepers.push_back(m_sleepers[k]);
+	int kept = 0;
+	for (int k = 0; k < awake; k++) {
+		int i = m_awake[k];
+		if (m_restSteps[i] >= SLEEP_DELAY) {
+			m_balls[i].setPower(0, 0);
+			m_prev[i] = m_balls[i].getCenter();
+			sleepers.push_back(i);
+		}
+		else {
+			m_awake[kept++] = i;
+		}
+	}
+	m_awake.resize(kept);
+	m_sleepers.swap(sleepers);
+	m_sap.clear();
+
+	std::vector<float> x(m_sleepers.size()), z(m_sleepers.size());
+	for (int k = 0; k < (int)m_sleepers.size(); k++) {
+		Vec3 c = m_balls[m_sleepers[k]].getCenter();
+		x[k] = c.x;
+		z[k] = c.z;
+		m_sleepSlot[m_sleepers[k]] = k;
+	}
+	m_sleepGrid.build(x, z, 2 * BALL_RADIUS);
+}
+
+sim::Vec3 sim::CBilliardScene::getBallCenter(int i, float alpha) const
+{
+	return lerp(m_prev[i], m_balls[i].getCenter(), alpha);
+}
+
+bool sim::CBilliardScene::isMoving(void) const
+{
+	for (int k = 0; k < (int)m_awake.size(); k++)
+		if (m_balls[m_awake[k]].isMoving())
+			return true;
+	return false;
+}
+
+float sim::CBilliardScene::getMaxSpeed(void) const
+{
+	float fastest = 0;
+	for (int k = 0; k < (int)m_awake.size(); k++) {
+		const CBall& ball = m_balls[m_awake[k]];
+		float vx = ball.getVelocity_X(), vz = ball.getVelocity_Z();
+		float speed = vx * vx + vz * vz;
+		if (speed > fastest)
+			fastest = speed;
+	}
+	return m_table.timeScale * sqrtf(fastest);
+}
+
+void sim::CBilliardScene::step(float timeDelta, int substeps)
+{
+	if (m_engine == ENGINE_EVENT) {
+		// the event engine only does work for moving balls already, every ball stays awake
+		int n = (int)m_balls.size();
+		m_eventSim.advance(timeDelta);
+		m_eventSim.clearContacts();
+		for (int i = 0; i < n; i++) {
+			float vx, vz;
+			m_prev[i] = m_balls[i].getCenter();
+			m_eventSim.getVelocity(i, vx, vz);
+			m_balls[i].setCenter(m_eventSim.getCenter(i));
+			m_balls[i].setPower(vx, vz);
+		}
+		return;
+	}
+
+	// sleeping balls keep m_prev equal to their center, they do not move until woken
+	for (int k = 0; k < (int)m_awake.size(); k++)
+		m_prev[m_awake[k]] = m_balls[m_awake[k]].getCenter();
+
+	if (substeps < 1)
+		substeps = 1;
+	for (int i = 0; i < substeps; i++)
+		substep(timeDelta / substeps);
+	if (m_sleeping)
+		updateSleep();
+}
+
+void sim::CBilliardScene::substep(float timeDelta)
+{
+	// update the position of each awake ball, bouncing off the walls at the time of contact
+	int moved = (int)m_awake.size();
+	float reach = 0;
+	for (int k = 0; k < moved; k++) {
+		int i = m_awake[k];
+		m_start[i] = m_balls[i].getCenter();
+		sweptBallUpdate(m_balls[i], timeDelta, m_table, m_walls, 4);
+		Vec3 c = m_balls[i].getCenter();
+		float dx = fabsf(c.x - m_start[i].x), dz = fabsf(c.z - m_start[i].z);
+		if (dx > reach) reach = dx;
+		if (dz > reach) reach = dz;
+	}
+
+	// sleeping balls along a moving ball's path wake up with their island and join the sweep
+	if (!m_sleepers.empty()) {
+		for (int k = 0; k < moved; k++) {
+			int i = m_awake[k];
+			Vec3 p = m_start[i], c = m_balls[i].getCenter();
+			if (p.x == c.x && p.z == c.z)
+				continue;
+			Vec3 d = { c.x - p.x, 0, c.z - p.z };
+			m_sleepGrid.querySweep(p.x, p.z, c.x, c.z, 2 * BALL_RADIUS, m_candidates);
+			for (int j = 0; j < (int)m_candidates.size(); j++) {
+				int other = m_sleepers[m_candidates[j]];
+				float t;
+				if (m_sleepSlot[other] >= 0 &&
+					sweptSphereSphere(p, d, m_balls[other].getCenter(), 2 * BALL_RADIUS, t))
+					wakeIsland(other);
+			}
+		}
+	}
+
+	int n = (int)m_awake.size();
+	if (n == 0)
+		return;
+	m_x.resize(n);
+	m_z.resize(n);
+	for (int k = 0; k < n; k++) {
+		Vec3 c = m_balls[m_awake[k]].getCenter();
+		m_x[k] = c.x;
+		m_z[k] = c.z;
+	}
+
+	// widen the boxes by twice the longest move of the step, so pairs that crossed each other
+	// inside the step are reported too, and so are the ones a ball sent off by a contact meets
+	m_sap.update(&m_x[0], &m_z[0], n, BALL_RADIUS + 2 * reach);
+	const std::vector<BallPair>& pairs = m_sap.getPairs();
+
+	// every ball runs from m_start at m_startTime to its center at the end of the substep.
+	// contacts are taken earliest first, each sets both balls off from where they touched, at
+	// the time they touched, and sweeps their new paths against the pairs they are in
+	m_startTime.assign(n, 0);
+	m_version.assign(n, 0);
+	m_hits.clear();
+	for (int k = 0; k < (int)pairs.size(); k++)
+		sweepPair(pairs[k].a, pairs[k].b);
+
+	// the pairs of each ball, for sweeping again after a contact. most substeps have none
+	if (!m_hits.empty()) {
+		m_partnerStart.assign(n + 1, 0);
+		for (int k = 0; k < (int)pairs.size(); k++) {
+			m_partnerStart[pairs[k].a + 1]++;
+			m_partnerStart[pairs[k].b + 1]++;
+		}
+		for (int k = 0; k < n; k++)
+			m_partnerStart[k + 1] += m_partnerStart[k];
+		m_partners.resize(2 * pairs.size());
+		m_fill.assign(m_partnerStart.begin(), m_partnerStart.end() - 1);
+		for (int k = 0; k < (int)pairs.size(); k++) {
+			m_partners[m_fill[pairs[k].a]++] = pairs[k].b;
+			m_partners[m_fill[pairs[k].b]++] = pairs[k].a;
+		}
+	}
+	long guard = (long)pairs.size() * MAX_CONTACTS_PER_STEP;
+	while (!m_hits.empty() && guard-- > 0) {
+		PairHit hit = m_hits.front();
+		std::pop_heap(m_hits.begin(), m_hits.end());
+		m_hits.pop_back();
+		if (hit.versionA != m_version[hit.a] || hit.versionB != m_version[hit.b])
+			continue;
+
+		int ia = m_awake[hit.a], ib = m_awake[hit.b];
+		CBall& a = m_balls[ia];
+		CBall& b = m_balls[ib];
+		Vec3 pa = pathAt(hit.a, hit.time), pb = pathAt(hit.b, hit.time);
+		a.setCenter(pa.x, pa.y, pa.z);
+		b.setCenter(pb.x, pb.y, pb.z);
+		a.hitBy(b);
+		float rest = m_table.timeScale * timeDelta * (1 - hit.time);
+		int moved[2] = { hit.a, hit.b };
+		for (int m = 0; m < 2; m++) {
+			int k = moved[m];
+			CBall& ball = m_balls[m_awake[k]];
+			Vec3 c = ball.getCenter();
+			m_start[m_awake[k]] = c;
+			m_startTime[k] = hit.time;
+			ball.setCenter(c.x + rest * ball.getVelocity_X(), c.y, c.z + rest * ball.getVelocity_Z());
+			for (int j = 0; j < 4; j++)
+				m_walls[j].hitBy(ball);
+			m_version[k]++;
+		}
+
+		// the pair itself has just been parted, like the event engine it is not swept again
+		for (int m = 0; m < 2; m++) {
+			int k = moved[m], other = moved[1 - m];
+			for (int p = m_partnerStart[k]; p < m_partnerStart[k + 1]; p++)
+				if (m_partners[p] != other)
+					sweepPair(k, m_partners[p]);
+		}
+	}
+
+	// what the sweeps left overlapping, balls that started the substep in contact for one, is
+	// parted where the balls ended up
+	for (int k = 0; k < (int)pairs.size(); k++)
+		m_balls[m_awake[pairs[k].a]].hitBy(m_balls[m_awake[pairs[k].b]]);
+}
+
+// where awake ball k is at time s of the substep, on the straight path it is on since m_startTime
+sim::Vec3 sim::CBilliardScene::pathAt(int k, float s) const
+{
+	int i = m_awake[k];
+	const Vec3& p = m_start[i];
+	Vec3 c = m_balls[i].getCenter();
+	float t0 = m_startTime[k];
+	if (s == t0)
+		return p;
+	if (!(t0 < 1))
+		return c;
+	float f = (s - t0) / (1 - t0);
+	Vec3 r = { p.x + (c.x - p.x) * f, c.y, p.z + (c.z - p.z) * f };
+	return r;
+}
+
+// the first contact of awake balls ka and kb from the later of their start times on
+void sim::CBilliardScene::sweepPair(int ka, int kb)
+{
+	float s0 = m_startTime[ka] > m_startTime[kb] ? m_startTime[ka] : m_startTime[kb];
+	Vec3 pa = pathAt(ka, s0), pb = pathAt(kb, s0);
+	Vec3 ca = m_balls[m_awake[ka]].getCenter(), cb = m_balls[m_awake[kb]].getCenter();
+	Vec3 da = { ca.x - pa.x, 0, ca.z - pa.z };
+	Vec3 db = { cb.x - pb.x, 0, cb.z - pb.z };
+	float t;
+	if (!sweptSpherePair(pa, da, pb, db, 2 * BALL_RADIUS - CONTACT_SKIN, t))
+		return;
+	PairHit hit;
+	hit.time = s0 + t * (1 - s0);
+	hit.a = ka;
+	hit.b = kb;
+	hit.versionA = m_version[ka];
+	hit.versionB = m_version[kb];
+	m_hits.push_back(hit);
+	std::push_heap(m_hits.begin(), m_hits.end());
+}
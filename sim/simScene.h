@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simScene.h
+//
+// Desc: Complete game states that can be stepped without a window or a device.
+//       The games keep one scene each and only read positions back for drawing.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simSceneH__
+#define __simSceneH__
+
+#include "simCore.h"
+#include "uniformGrid.h"
+#include "sweepAndPrune.h"
+#include "eventSim.h"
+#include <vector>
+#include <stdint.h>
+
+namespace sim
+{
+	//
+	// Default layouts
+	//
+
+	const int LEGO_BRICK_COUNT = 54;
+	const int BILLIARD_BALL_COUNT = 4;
+
+	extern const float legoBrickPos[LEGO_BRICK_COUNT][2];
+	extern const float billiardBallPos[BILLIARD_BALL_COUNT][2];
+
+	const float LEGO_HOLDER_Z = -4.3f;
+	const float LEGO_SHOT_Z   = -3.88f;
+	const float LEGO_LOST_Z   = -8.25f;   // shot ball is gone once it passes this line
+	const float LEGO_HOLDER_LIMIT = 2.79f;
+	const float LEGO_SHOT_SPEED   = 2.0f;    // z velocity the shot ball leaves the holder with
+
+	const int   SLEEP_DELAY = 4;      // steps a ball rests before it is put to sleep
+	const int   SLEEP_BATCH = 16;     // resting balls gathered before the sleep grid is rebuilt
+	const float ISLAND_GAP  = 0.01f;  // sleeping balls closer than this count as touching
+
+	// -----------------------------------------------------------------------------
+	// CLegoScene
+	// -----------------------------------------------------------------------------
+
+	class CLegoScene {
+	public:
+		CLegoScene(void);
+
+		// stress levels need a bigger table than the default 6 x 9 one
+		void setTable(const TableDesc& table);
+		void setup(void);
+		void setup(const float (*brickPos)[2], int count);
+
+		// streamed levels keep the bricks in slots of equal capacity that are filled and emptied
+		// as chunks of the level come and go (see CLevelStream). brick i is entry i % capacity of
+		// slot i / capacity, and setup(brickPos, count) is a single slot holding every brick
+		void setupSlots(int slots, int capacity);
+		void loadSlot(int slot, const float (*brickPos)[2], int count);
+		void clearSlot(int slot);
+		int  getSlotCapacity(void) const { return m_slotCapacity; }
+
+		// one step of timeDelta, run as substeps equal slices (see CSubstepper)
+		void step(float timeDelta, int substeps = 1);
+
+		void shoot(void);
+		void moveHolder(float dx);
+
+		int  getBrickCount(void) const { return (int)m_bricks.size(); }
+		int  getAliveCount(void) const { return m_aliveCount; }
+		bool isBrickAlive(int i) const { return (m_alive[i >> 6] >> (i & 63)) & 1; }
+
+		// bit i of word i / 64 is set while brick i stands, for loops that visit the survivors
+		// with countTrailingZeros64 instead of testing every brick
+		const uint64_t* getAliveMask(void) const { return m_alive.empty() ? 0 : &m_alive[0]; }
+		int  getAliveMaskWords(void) const { return (int)m_alive.size(); }
+
+		// bricks knocked out since the last clearRemoved, in the order they went
+		const std::vector<int>& getRemoved(void) const { return m_removed; }
+		void clearRemoved(void) { m_removed.clear(); }
+		bool isShot(void) const { return m_isShot; }
+		const TableDesc& getTable(void) const { return m_table; }
+
+		// distance the shot ball covers per unit of timeDelta right now
+		float getMaxSpeed(void) const;
+
+		const CBrick&      getBrick(int i) const { return m_bricks[i]; }
+		const CBall&       getShotBall(void) const { return m_shotBall; }
+		const CHolderBall& getHolderBall(void) const { return m_holderBall; }
+
+		// the far and the two side cushions, the near side is open
+		const CWall* getWalls(void) const { return m_walls; }
+		int          getWallCount(void) const { return 3; }
+
+		// shot ball position blended between the previous and the current step
+		Vec3 getShotBallCenter(float alpha) const;
+
+	private:
+		struct BrickSlot
+		{
+			CUniformGrid	grid;
+			float			minZ, maxZ;   // of the brick centers, minZ > maxZ while empty
+		};
+
+		void resetShotBall(void);
+		void substep(float timeDelta);
+
+		std::vector<CBrick>	m_bricks;
+		std::vector<uint64_t>	m_alive;
+		std::vector<int>	m_removed;
+		int					m_aliveCount;
+		std::vector<BrickSlot>	m_slots;
+		int					m_slotCapacity;
+		std::vector<float>	m_slotX, m_slotZ;   // scratch for the slot grid builds
+		std::vector<int>	m_candidates;
+		TableDesc			m_table;
+		CBall				m_shotBall;
+		Vec3				m_prevShot;
+		CHolderBall			m_holderBall;
+		CWall				m_walls[3];
+		bool				m_isShot;
+	};
+
+	// -----------------------------------------------------------------------------
+	// CBilliardScene
+	// -----------------------------------------------------------------------------
+
+	enum BilliardEngine {
+		ENGINE_STEPPED,   // ballUpdate and hitBy every step
+		ENGINE_EVENT      // jump from one contact to the next, see CEventBilliard
+	};
+
+	class CBilliardScene {
+	public:
+		CBilliardScene(void);
+
+		// stress tables hold more balls than the default 9 x 6 table fits
+		void setTable(const TableDesc& table);
+		void setup(void);
+		void setup(const float (*ballPos)[2], int count);
+
+		// one step of timeDelta, run as substeps equal slices (see CSubstepper).
+		// the event engine is exact whatever the step and ignores substeps
+		void step(float timeDelta, int substeps = 1);
+
+		// switching keeps the table as it is and carries on with the other engine
+		void setEngine(BilliardEngine engine);
+		BilliardEngine getEngine(void) const { return m_engine; }
+		const CEventBilliard& getEventEngine(void) const { return m_eventSim; }
+
+		void shoot(int i, float vx, float vz);
+		bool isMoving(void) const;
+
+		// distance the fastest ball covers per unit of timeDelta right now
+		float getMaxSpeed(void) const;
+
+		int          getBallCount(void) const { return (int)m_balls.size(); }
+		const CBall& getBall(int i) const { return m_balls[i]; }
+
+		const TableDesc& getTable(void) const { return m_table; }
+		const CWall* getWalls(void) const { return m_walls; }
+		int          getWallCount(void) const { return 4; }
+
+		// on by default, off keeps every ball integrated every step
+		void setSleeping(bool enable);
+
+		// balls still integrated and swept, and balls asleep until something reaches them
+		int  getAwakeCount(void) const { return (int)m_awake.size(); }
+		int  getSleepingCount(void) const { return (int)m_balls.size() - (int)m_awake.size(); }
+		bool isAsleep(int i) const { return m_sleepSlot[i] >= 0; }
+
+		// ball position blended between the previous and the current step
+		Vec3 getBallCenter(int i, float alpha) const;
+
+	private:
+		// a swept contact of two awake balls, at a fraction of the substep
+		struct PairHit
+		{
+			float time;
+			int   a, b;                 // in m_awake order
+			int   versionA, versionB;   // dropped once either ball has been set on a new path
+
+			bool operator<(const PairHit& h) const { return time > h.time; }   // heap top is earliest
+		};
+
+		void substep(float timeDelta);
+		Vec3 pathAt(int k, float s) const;
+		void sweepPair(int ka, int kb);
+		void wakeAll(void);
+		void wakeIsland(int i);
+		void updateSleep(void);
+
+		std::vector<CBall>	m_balls;
+		std::vector<Vec3>	m_prev;      // at the start of the step, for drawing
+		std::vector<Vec3>	m_start;     // where each ball's path in the substep starts, for the swept pair test
+		CWall				m_walls[4];
+		TableDesc			m_table;
+		CSweepAndPrune		m_sap;       // over the awake balls only
+		std::vector<float>	m_x, m_z;    // awake ball centers, in m_awake order
+		std::vector<float>	m_startTime;       // fraction of the substep m_start is at, in m_awake order
+		std::vector<int>	m_version;         // bumped when a contact sets a ball on a new path
+		std::vector<int>	m_partnerStart;    // broadphase partners of each awake ball, in m_partners
+		std::vector<int>	m_partners;
+		std::vector<int>	m_fill;
+		std::vector<PairHit> m_hits;           // heap of contacts still to be taken
+
+		// resting balls leave the awake list for a grid that is only queried along moving balls
+		std::vector<int>	m_awake;
+		std::vector<int>	m_restSteps;
+		std::vector<int>	m_sleepSlot;   // grid item of each sleeping ball, -1 while awake
+		std::vector<int>	m_sleepers;    // ball of each grid item, woken ones stay until the rebuild
+		CUniformGrid		m_sleepGrid;
+		bool				m_sleeping;
+		std::vector<int>	m_candidates;
+		std::vector<int>	m_neighbours;
+		std::vector<int>	m_wakeStack;
+		BilliardEngine		m_engine;
+		CEventBilliard		m_eventSim;
+	};
+}
+
+#endif // __simSceneH__
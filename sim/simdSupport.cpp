@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simdSupport.cpp
+//
+// Desc: Run time instruction set detection.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "simdSupport.h"
+
+static sim::SimdPath g_simdPath = sim::detectSimdPath();
+
+sim::SimdPath sim::detectSimdPath(void)
+{
+#if defined(SIM_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] >= 7) {
+		bool osAvx = false;
+		__cpuid(info, 1);
+		bool fma = (info[2] & (1 << 12)) != 0;
+		if ((info[2] & (1 << 27)) && (info[2] & (1 << 28)))
+			osAvx = (_xgetbv(0) & 6) == 6;
+		__cpuidex(info, 7, 0);
+		if (osAvx && fma && (info[1] & (1 << 5)))
+			return SIMD_AVX2;
+	}
+	return SIMD_SSE;
+#elif defined(SIM_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return SIMD_AVX2;
+	return SIMD_SSE;
+#else
+	return SIMD_SCALAR;
+#endif
+}
+
+sim::SimdPath sim::getSimdPath(void)
+{
+	return g_simdPath;
+}
+
+void sim::setSimdPath(SimdPath path)
+{
+	// never go above what the cpu can run
+	if (path > detectSimdPath())
+		path = detectSimdPath();
+	g_simdPath = path;
+}
+
+const char* sim::simdPathName(SimdPath path)
+{
+	switch (path) {
+	case SIMD_AVX2: return "avx2";
+	case SIMD_SSE:  return "sse";
+	default:        return "scalar";
+	}
+}
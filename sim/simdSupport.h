@@ -0,0 +1,80 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: simdSupport.h
+//
+// Desc: Instruction set detection and the compiler glue needed to build AVX2 code paths next to
+//       plain SSE2 ones in the same translation unit.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __simdSupportH__
+#define __simdSupportH__
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIM_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define SIM_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include <stdint.h>
+
+// gcc and clang only emit AVX2 instructions inside functions that ask for them.
+// fma is left out on purpose: with it the compiler fuses mul + add and the AVX2 paths would
+// round differently from the scalar and SSE ones
+#if defined(SIM_X86) && (defined(__GNUC__) || defined(__clang__))
+#define SIM_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIM_TARGET_AVX2
+#endif
+
+namespace sim
+{
+	enum SimdPath { SIMD_SCALAR, SIMD_SSE, SIMD_AVX2 };
+
+	// widest path this cpu runs, can be lowered for benchmarks and tests
+	SimdPath getSimdPath(void);
+	void     setSimdPath(SimdPath path);
+	SimdPath detectSimdPath(void);
+
+	const char* simdPathName(SimdPath path);
+
+	//
+	// Bit helpers
+	//
+
+	inline int popCount64(uint64_t v)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(v);
+#else
+		int n = 0;
+		while (v) { v &= v - 1; n++; }
+		return n;
+#endif
+	}
+
+	// index of the lowest set bit, v must not be 0
+	inline int countTrailingZeros64(uint64_t v)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		unsigned long i;
+		_BitScanForward64(&i, v);
+		return (int)i;
+#else
+		int n = 0;
+		while (!(v & 1)) { v >>= 1; n++; }
+		return n;
+#endif
+	}
+}
+
+#endif // __simdSupportH__
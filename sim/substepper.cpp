@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: substepper.cpp
+//
+// Desc: Speed driven substep count.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "substepper.h"
+#include "simCore.h"
+#include <cmath>
+
+sim::CSubstepper::CSubstepper(float travel, int maxSubsteps)
+{
+	m_travel = travel;
+	m_maxSubsteps = maxSubsteps;
+	m_history.assign(SUBSTEP_HISTORY, 0);
+	reset();
+}
+
+void sim::CSubstepper::reset(void)
+{
+	m_current = 0;
+	m_frames = 0;
+	m_total = 0;
+	m_peak = 0;
+}
+
+int sim::CSubstepper::plan(float maxSpeed, float timeDelta)
+{
+	float reach = maxSpeed * timeDelta / (m_travel * BALL_RADIUS);
+	int substeps = 1;
+	if (reach > 1)
+		substeps = reach >= m_maxSubsteps ? m_maxSubsteps : (int)ceilf(reach);
+	m_current += substeps;
+	return substeps;
+}
+
+void sim::CSubstepper::endFrame(void)
+{
+	m_history[m_frames % SUBSTEP_HISTORY] = m_current;
+	m_frames++;
+	m_total += m_current;
+	if (m_current > m_peak)
+		m_peak = m_current;
+	m_current = 0;
+}
+
+int sim::CSubstepper::getFrameSubsteps(int age) const
+{
+	if (age < 0 || age >= getHistorySize())
+		return 0;
+	return m_history[(m_frames - 1 - age) % SUBSTEP_HISTORY];
+}
@@ -0,0 +1,53 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: substepper.h
+//
+// Desc: Picks how many substeps a physics step is cut into from the speed of the fastest ball.
+//       A quiet table runs one substep per step, a break is cut so that no ball moves more
+//       than a fraction of its radius per substep. The substeps run in every frame are kept,
+//       so the extra cost of violent frames can be looked at afterwards.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __substepperH__
+#define __substepperH__
+
+#include <vector>
+
+namespace sim
+{
+	const float SUBSTEP_TRAVEL  = 0.5f;   // farthest a ball may move in one substep, in radii
+	const int   MAX_SUBSTEPS    = 16;
+	const int   SUBSTEP_HISTORY = 256;    // frames kept for getFrameSubsteps
+
+	class CSubstepper {
+	public:
+		CSubstepper(float travel = SUBSTEP_TRAVEL, int maxSubsteps = MAX_SUBSTEPS);
+
+		// substeps for a step of timeDelta, maxSpeed is the distance the fastest ball covers
+		// per unit of timeDelta (see the scenes' getMaxSpeed)
+		int  plan(float maxSpeed, float timeDelta);
+
+		// closes the count of the current frame
+		void endFrame(void);
+		void reset(void);
+
+		// substeps run age frames ago, 0 is the last finished frame
+		int    getFrameSubsteps(int age) const;
+		int    getHistorySize(void) const { return m_frames < SUBSTEP_HISTORY ? (int)m_frames : SUBSTEP_HISTORY; }
+		long   getFrameCount(void) const { return m_frames; }
+		double getAverage(void) const { return m_frames > 0 ? (double)m_total / m_frames : 0.0; }
+		int    getPeak(void) const { return m_peak; }
+
+	private:
+		float				m_travel;
+		int					m_maxSubsteps;
+		int					m_current;
+		std::vector<int>	m_history;   // ring buffer, last frame at (m_frames - 1) % SUBSTEP_HISTORY
+		long				m_frames;
+		long				m_total;
+		int					m_peak;
+	};
+}
+
+#endif // __substepperH__
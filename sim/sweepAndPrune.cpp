@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sweepAndPrune.cpp
+//
+// Desc: Incremental sweep and prune.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "sweepAndPrune.h"
+#include <cmath>
+
+sim::CSweepAndPrune::CSweepAndPrune(void)
+{
+	m_swaps = 0;
+	setBounds(-0.5f * SAP_STRIP_DEPTH, 0.5f * SAP_STRIP_DEPTH);
+}
+
+void sim::CSweepAndPrune::setBounds(float minZ, float maxZ)
+{
+	int strips = (int)ceil((maxZ - minZ) / SAP_STRIP_DEPTH - 0.001f);
+	if (strips < 1)
+		strips = 1;
+
+	m_minZ = minZ;
+	m_stripDepth = (maxZ - minZ) / strips;
+	if (m_stripDepth <= 0)
+		m_stripDepth = SAP_STRIP_DEPTH;
+	m_strips.assign(strips, Strip());
+	m_first.clear();
+	m_last.clear();
+}
+
+void sim::CSweepAndPrune::clear(void)
+{
+	for (int k = 0; k < (int)m_strips.size(); k++)
+		m_strips[k] = Strip();
+	m_first.clear();
+	m_last.clear();
+	m_pairs.clear();
+	m_swaps = 0;
+}
+
+int sim::CSweepAndPrune::stripOf(float z) const
+{
+	int k = (int)floorf((z - m_minZ) / m_stripDepth);
+	if (k < 0) return 0;
+	if (k >= (int)m_strips.size()) return (int)m_strips.size() - 1;
+	return k;
+}
+
+void sim::CSweepAndPrune::sortStrip(Strip& strip, const float* x, const float* z)
+{
+	int count = (int)strip.order.size();
+	strip.sortX.resize(count);
+	strip.sortZ.resize(count);
+	for (int i = 0; i < count; i++)
+		strip.sortX[i] = x[strip.order[i]];
+
+	// balls move little between steps, so this insertion sort only does a few swaps
+	for (int i = 1; i < count; i++) {
+		int id = strip.order[i];
+		float key = strip.sortX[i];
+		int j = i - 1;
+		while (j >= 0 && strip.sortX[j] > key) {
+			strip.order[j + 1] = strip.order[j];
+			strip.sortX[j + 1] = strip.sortX[j];
+			j--;
+			m_swaps++;
+		}
+		strip.order[j + 1] = id;
+		strip.sortX[j + 1] = key;
+	}
+
+	for (int i = 0; i < count; i++)
+		strip.sortZ[i] = z[strip.order[i]];
+}
+
+void sim::CSweepAndPrune::sweepStrip(const Strip& strip, int index, float radius)
+{
+	// every ball only looks ahead while the intervals on x still overlap
+	float diameter = 2 * radius;
+	int count = (int)strip.order.size();
+	bool single = m_strips.size() == 1;
+	for (int i = 0; i < count; i++) {
+		float xa = strip.sortX[i];
+		float za = strip.sortZ[i];
+		for (int j = i + 1; j < count && strip.sortX[j] - xa < diameter; j++) {
+			float zb = strip.sortZ[j];
+			float dz = zb - za;
+			if (dz >= diameter || dz <= -diameter)
+				continue;
+
+			// a pair near a strip border is seen by two strips, only the one holding the
+			// low edge of the overlap region reports it
+			if (!single && stripOf((za > zb ? za : zb) - radius) != index)
+				continue;
+
+			int a = strip.order[i];
+			int b = strip.order[j];
+			BallPair p;
+			p.a = a < b ? a : b;
+			p.b = a < b ? b : a;
+			m_pairs.push_back(p);
+		}
+	}
+}
+
+void sim::CSweepAndPrune::update(const float* x, const float* z, int count, float radius)
+{
+	// a different ball count means a new table, start from creation order
+	if ((int)m_first.size() != count) {
+		for (int k = 0; k < (int)m_strips.size(); k++)
+			m_strips[k].order.clear();
+		m_first.assign(count, 0);
+		m_last.assign(count, -1);
+	}
+
+	// drop the balls that left a strip, keeping the order of the ones that stay
+	int strips = (int)m_strips.size();
+	for (int k = 0; k < strips; k++) {
+		std::vector<int>& order = m_strips[k].order;
+		int kept = 0;
+		for (int i = 0; i < (int)order.size(); i++) {
+			int id = order[i];
+			if (stripOf(z[id] - radius) <= k && k <= stripOf(z[id] + radius))
+				order[kept++] = id;
+		}
+		order.resize(kept);
+	}
+
+	// and append the balls that entered one
+	for (int i = 0; i < count; i++) {
+		int first = stripOf(z[i] - radius);
+		int last = stripOf(z[i] + radius);
+		for (int k = first; k <= last; k++)
+			if (k < m_first[i] || k > m_last[i])
+				m_strips[k].order.push_back(i);
+		m_first[i] = first;
+		m_last[i] = last;
+	}
+
+	m_swaps = 0;
+	m_pairs.clear();
+	for (int k = 0; k < strips; k++) {
+		sortStrip(m_strips[k], x, z);
+		sweepStrip(m_strips[k], k, radius);
+	}
+}
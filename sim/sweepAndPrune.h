@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sweepAndPrune.h
+//
+// Desc: Sweep and prune broadphase for moving balls along the long (x) axis of the table.
+//       The sorted order is kept from one step to the next, so re-sorting an almost sorted list
+//       is close to linear and so is the whole pass.
+//
+//       A single sorted axis degrades on big square tables, where many balls share an x interval.
+//       Large tables are therefore cut into strips along z, each strip keeping its own sorted list.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __sweepAndPruneH__
+#define __sweepAndPruneH__
+
+#include <vector>
+
+namespace sim
+{
+	const float SAP_STRIP_DEPTH = 6.0f;   // the default table is exactly one strip
+
+	struct BallPair
+	{
+		int a, b;   // a < b
+	};
+
+	class CSweepAndPrune {
+	public:
+		CSweepAndPrune(void);
+
+		// z range the balls live in, picks how many strips are used
+		void setBounds(float minZ, float maxZ);
+
+		// x[i], z[i] is the center of ball i, all balls share one radius.
+		// afterwards getPairs() holds every pair whose bounding squares overlap, each pair once
+		void update(const float* x, const float* z, int count, float radius);
+		void clear(void);
+
+		const std::vector<BallPair>& getPairs(void) const { return m_pairs; }
+
+		// insertion sort moves of the last update, a measure of how coherent the motion was
+		int getSwapCount(void) const { return m_swaps; }
+		int getStripCount(void) const { return (int)m_strips.size(); }
+
+	private:
+		struct Strip
+		{
+			std::vector<int>	order;    // ball ids sorted by x
+			std::vector<float>	sortX;    // x and z of order[i], packed in sorted order for the sweep
+			std::vector<float>	sortZ;
+		};
+
+		int  stripOf(float z) const;
+		void sortStrip(Strip& strip, const float* x, const float* z);
+		void sweepStrip(const Strip& strip, int index, float radius);
+
+		float					m_minZ;
+		float					m_stripDepth;
+		std::vector<Strip>		m_strips;
+		std::vector<int>		m_first, m_last;   // strips each ball was in after the last update
+		std::vector<BallPair>	m_pairs;
+		int						m_swaps;
+	};
+}
+
+#endif // __sweepAndPruneH__
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sweptTests.cpp
+//
+// Desc: Continuous collision tests.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "sweptTests.h"
+#include <cmath>
+
+bool sim::sweptSphereSphere(const Vec3& p, const Vec3& d, const Vec3& q, float radiusSum, float& t)
+{
+	// |m + d * t| = radiusSum, first root while the balls get closer
+	float mx = p.x - q.x, mz = p.z - q.z;
+	float b = mx * d.x + mz * d.z;
+	if (b >= 0)
+		return false;
+	float c = mx * mx + mz * mz - radiusSum * radiusSum;
+	if (c <= 0) {
+		t = 0;
+		return true;
+	}
+	float a = d.x * d.x + d.z * d.z;
+	float disc = b * b - a * c;
+	if (disc < 0)
+		return false;
+	float root = (-b - sqrtf(disc)) / a;
+	if (root > 1)
+		return false;
+	t = root < 0 ? 0 : root;
+	return true;
+}
+
+bool sim::sweptSpherePair(const Vec3& p, const Vec3& d, const Vec3& q, const Vec3& e, float radiusSum, float& t)
+{
+	// the same test seen from the second ball
+	Vec3 rel = { d.x - e.x, d.y - e.y, d.z - e.z };
+	return sweptSphereSphere(p, rel, q, radiusSum, t);
+}
+
+void sim::sweptBallUpdate(CBall& ball, float timeDiff, const TableDesc& table, CWall* walls, int wallCount)
+{
+	if (!ball.isMoving()) {
+		ball.setPower(0, 0);
+		return;
+	}
+
+	float left = 1;
+	for (int k = 0; k < MAX_CONTACTS_PER_STEP && left > 0; k++) {
+		Vec3 p = ball.getCenter();
+		float scale = table.timeScale * timeDiff * left;
+		Vec3 d = { scale * ball.getVelocity_X(), 0, scale * ball.getVelocity_Z() };
+
+		float first = 1;
+		int hit = -1;
+		for (int w = 0; w < wallCount; w++) {
+			float t;
+			if (walls[w].sweep(p, d, ball.getRadius() - CONTACT_SKIN, t) && t < first) {
+				first = t;
+				hit = w;
+			}
+		}
+		ball.setCenter(p.x + d.x * first, p.y, p.z + d.z * first);
+		if (hit < 0)
+			break;
+		walls[hit].hitBy(ball);
+		left *= 1 - first;
+	}
+	ball.applyFriction(timeDiff, table);
+}
@@ -0,0 +1,36 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: sweptTests.h
+//
+// Desc: Continuous collision tests. Instead of moving a ball a whole step and looking for overlap
+//       afterwards, these find the fraction of the step at which contact first happens, so a fast
+//       ball can not jump over a brick, a ball or a cushion during a long step.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __sweptTestsH__
+#define __sweptTestsH__
+
+#include "simCore.h"
+
+namespace sim
+{
+	// contacts are placed this far inside the touching distance, so the hitBy functions that
+	// resolve them see an overlap and do not miss it to rounding
+	const float CONTACT_SKIN = 1e-4f;
+
+	// most contacts one ball resolves inside a single step before the rest of the step is dropped
+	const int MAX_CONTACTS_PER_STEP = 8;
+
+	// ball at p moving by d against a ball resting at q, on the table plane (x, z).
+	// t is the fraction of d travelled when the centers are radiusSum apart
+	bool sweptSphereSphere(const Vec3& p, const Vec3& d, const Vec3& q, float radiusSum, float& t);
+
+	// two moving balls, d and e are their displacements over the step
+	bool sweptSpherePair(const Vec3& p, const Vec3& d, const Vec3& q, const Vec3& e, float radiusSum, float& t);
+
+	// ballUpdate that bounces off the walls at the exact time of contact instead of after the step
+	void sweptBallUpdate(CBall& ball, float timeDiff, const TableDesc& table, CWall* walls, int wallCount);
+}
+
+#endif // __sweptTestsH__
@@ -0,0 +1,129 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: threadPool.cpp
+//
+// Desc: Work stealing thread pool.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "threadPool.h"
+
+sim::CThreadPool::CThreadPool(int threads)
+	: m_generation(0), m_quit(false), m_task(0), m_pending(0), m_steals(0)
+{
+	if (threads <= 0)
+		threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	for (int i = 0; i < threads; i++)
+		m_queues.push_back(new Queue());
+	for (int i = 1; i < threads; i++)
+		m_threads.push_back(std::thread(&CThreadPool::workerMain, this, i));
+}
+
+sim::CThreadPool::~CThreadPool(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_quit = true;
+	}
+	m_start.notify_all();
+	for (int i = 0; i < (int)m_threads.size(); i++)
+		m_threads[i].join();
+	for (int i = 0; i < (int)m_queues.size(); i++)
+		delete m_queues[i];
+}
+
+void sim::CThreadPool::workerMain(int self)
+{
+	long seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> guard(m_lock);
+			while (!m_quit && m_generation == seen)
+				m_start.wait(guard);
+			if (m_quit)
+				return;
+			seen = m_generation;
+		}
+		runChunks(self);
+	}
+}
+
+bool sim::CThreadPool::popOwn(int self, Chunk& chunk)
+{
+	Queue& q = *m_queues[self];
+	std::lock_guard<std::mutex> guard(q.lock);
+	if (q.chunks.empty())
+		return false;
+	chunk = q.chunks.back();
+	q.chunks.pop_back();
+	return true;
+}
+
+bool sim::CThreadPool::steal(int self, Chunk& chunk)
+{
+	int threads = (int)m_queues.size();
+	for (int k = 1; k < threads; k++) {
+		Queue& q = *m_queues[(self + k) % threads];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.chunks.empty())
+			continue;
+		chunk = q.chunks.front();
+		q.chunks.pop_front();
+		m_steals++;
+		return true;
+	}
+	return false;
+}
+
+void sim::CThreadPool::runChunks(int self)
+{
+	Chunk chunk;
+	while (popOwn(self, chunk) || steal(self, chunk)) {
+		(*m_task)(chunk.begin, chunk.end);
+		if (--m_pending == 0) {
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_done.notify_all();
+		}
+	}
+}
+
+void sim::CThreadPool::parallelFor(int count, int grain, const std::function<void(int, int)>& task)
+{
+	if (count <= 0)
+		return;
+	if (grain < 1)
+		grain = 1;
+	int threads = (int)m_queues.size();
+	if (threads == 1 || count <= grain) {
+		task(0, count);
+		return;
+	}
+
+	int chunks = (count + grain - 1) / grain;
+	m_task = &task;
+	m_pending = chunks;
+	for (int t = 0; t < threads; t++) {
+		int first = (int)((long long)chunks * t / threads);
+		int last = (int)((long long)chunks * (t + 1) / threads);
+		Queue& q = *m_queues[t];
+		std::lock_guard<std::mutex> guard(q.lock);
+		for (int c = first; c < last; c++) {
+			Chunk chunk = { c * grain, (c + 1) * grain < count ? (c + 1) * grain : count };
+			q.chunks.push_back(chunk);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_generation++;
+	}
+	m_start.notify_all();
+
+	// the caller works too, then waits for chunks still running elsewhere
+	runChunks(0);
+	std::unique_lock<std::mutex> guard(m_lock);
+	while (m_pending.load() != 0)
+		m_done.wait(guard);
+}
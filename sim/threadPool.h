@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: threadPool.h
+//
+// Desc: Work stealing thread pool for batches of independent jobs (whole tables, shot samples).
+//       parallelFor cuts a range into chunks and deals a contiguous block of them to every
+//       thread. A thread works through its own block from the back and, once it runs dry, steals
+//       from the front of another's, so uneven jobs (a table that is still rolling next to one
+//       at rest) even out without a shared queue.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __threadPoolH__
+#define __threadPoolH__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim
+{
+	class CThreadPool {
+	public:
+		// 0 threads uses every hardware thread. the calling thread counts as one of them
+		explicit CThreadPool(int threads = 0);
+		~CThreadPool(void);
+
+		// runs task(begin, end) over [0, count) in chunks of at most grain, returns when all are done
+		void parallelFor(int count, int grain, const std::function<void(int, int)>& task);
+
+		int  getThreadCount(void) const { return (int)m_queues.size(); }
+
+		// chunks taken from another thread's block since the pool was made
+		long getStealCount(void) const { return m_steals.load(); }
+
+	private:
+		struct Chunk
+		{
+			int begin, end;
+		};
+
+		struct Queue
+		{
+			std::mutex			lock;
+			std::deque<Chunk>	chunks;
+		};
+
+		CThreadPool(const CThreadPool&);
+		CThreadPool& operator=(const CThreadPool&);
+
+		void workerMain(int self);
+		void runChunks(int self);
+		bool popOwn(int self, Chunk& chunk);
+		bool steal(int self, Chunk& chunk);
+
+		std::vector<Queue*>		m_queues;    // one per thread, 0 belongs to the caller
+		std::vector<std::thread> m_threads;
+
+		std::mutex				m_lock;
+		std::condition_variable	m_start;
+		std::condition_variable	m_done;
+		long					m_generation;
+		bool					m_quit;
+
+		const std::function<void(int, int)>* m_task;
+		std::atomic<int>		m_pending;
+		std::atomic<long>		m_steals;
+	};
+}
+
+#endif // __threadPoolH__
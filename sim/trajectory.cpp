@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: trajectory.cpp
+//
+// Desc: Closed form single ball motion.
+//
+//       Exponential: p(t) = p0 + s * v0 * (1 - exp(-k t)) / k
+//       Linear:      p(t) = p0 + s * v0 * (t - a t^2 / (2 |v0|))
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "trajectory.h"
+#include <cmath>
+
+double sim::exponentialTravel(double k, double tau)
+{
+	if (k <= 0)
+		return tau;
+	return (1 - exp(-k * tau)) / k;
+}
+
+double sim::exponentialTimeForTravel(double k, double u)
+{
+	if (k <= 0)
+		return u;
+	// friction caps how far a ball can ever get
+	if (k * u >= 1)
+		return NEVER_STOPS;
+	return -log(1 - k * u) / k;
+}
+
+sim::CTrajectory::CTrajectory(void)
+{
+	Vec3 origin = { 0, BALL_RADIUS, 0 };
+	init(origin, 0, 0, 1, FRICTION_NONE, 0);
+}
+
+sim::CTrajectory::CTrajectory(const CBall& ball, const TableDesc& table)
+{
+	init(ball.getCenter(), ball.getVelocity_X(), ball.getVelocity_Z(), table.timeScale,
+		table.friction ? FRICTION_EXPONENTIAL : FRICTION_NONE, FRICTION);
+}
+
+sim::CTrajectory::CTrajectory(const Vec3& center, float vx, float vz, float timeScale,
+	FrictionModel model, float rate)
+{
+	init(center, vx, vz, timeScale, model, rate);
+}
+
+void sim::CTrajectory::init(const Vec3& center, float vx, float vz, float timeScale,
+	FrictionModel model, float rate)
+{
+	m_start = center;
+	m_vx = vx;
+	m_vz = vz;
+	m_speed = sqrt(m_vx * m_vx + m_vz * m_vz);
+	m_timeScale = timeScale;
+	m_model = rate > 0 ? model : FRICTION_NONE;
+	m_rate = rate;
+
+	double axis = fabs(m_vx) > fabs(m_vz) ? fabs(m_vx) : fabs(m_vz);
+	if (axis <= STOP_SPEED) {
+		m_vx = m_vz = m_speed = 0;
+		m_stopTime = 0;
+	}
+	else if (m_model == FRICTION_EXPONENTIAL) {
+		m_stopTime = log(axis / STOP_SPEED) / m_rate;
+	}
+	else if (m_model == FRICTION_LINEAR) {
+		// both axes shrink in proportion to the speed
+		m_stopTime = m_speed * (1 - STOP_SPEED / axis) / m_rate;
+	}
+	else {
+		m_stopTime = NEVER_STOPS;
+	}
+}
+
+double sim::CTrajectory::travel(double t) const
+{
+	if (t <= 0)
+		return 0;
+	if (t > m_stopTime)
+		t = m_stopTime;
+	switch (m_model) {
+	case FRICTION_EXPONENTIAL: return exponentialTravel(m_rate, t);
+	case FRICTION_LINEAR:      return t - 0.5 * m_rate * t * t / m_speed;
+	default:                   return t;
+	}
+}
+
+sim::Vec3 sim::CTrajectory::positionAt(double t) const
+{
+	double u = m_timeScale * travel(t);
+	Vec3 p = { (float)(m_start.x + m_vx * u), m_start.y, (float)(m_start.z + m_vz * u) };
+	return p;
+}
+
+void sim::CTrajectory::velocityAt(double t, float& vx, float& vz) const
+{
+	if (t >= m_stopTime) {
+		vx = vz = 0;
+		return;
+	}
+	if (t < 0)
+		t = 0;
+	double scale = 1;
+	if (m_model == FRICTION_EXPONENTIAL)
+		scale = exp(-m_rate * t);
+	else if (m_model == FRICTION_LINEAR)
+		scale = 1 - m_rate * t / m_speed;
+	vx = (float)(m_vx * scale);
+	vz = (float)(m_vz * scale);
+}
+
+double sim::CTrajectory::timeForDistance(double distance) const
+{
+	if (distance <= 0)
+		return 0;
+	if (m_speed <= 0)
+		return NEVER_STOPS;
+
+	// path length per unit of start speed
+	double u = distance / (m_timeScale * m_speed);
+	double t;
+	switch (m_model) {
+	case FRICTION_EXPONENTIAL:
+		t = exponentialTimeForTravel(m_rate, u);
+		break;
+	case FRICTION_LINEAR: {
+		// t - a t^2 / (2 |v0|) = u, the earlier root
+		double a = m_rate / m_speed;
+		double disc = 1 - 2 * a * u;
+		if (disc < 0)
+			return NEVER_STOPS;
+		t = (1 - sqrt(disc)) / a;
+		break;
+	}
+	default:
+		t = u;
+		break;
+	}
+	return t <= m_stopTime ? t : NEVER_STOPS;
+}
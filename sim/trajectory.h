@@ -0,0 +1,67 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: trajectory.h
+//
+// Desc: Closed form motion of a single ball between contacts. Where the ball is, how fast it goes
+//       and when it comes to rest are answered for any time in O(1), without stepping.
+//
+//       Exponential friction is what ballUpdate does (velocity times exp(-k t)), linear friction
+//       takes a constant amount of speed off per unit of time, like rolling resistance.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __trajectoryH__
+#define __trajectoryH__
+
+#include "simCore.h"
+
+namespace sim
+{
+	enum FrictionModel {
+		FRICTION_NONE,
+		FRICTION_EXPONENTIAL,   // rate is the decay k of v(t) = v0 exp(-k t)
+		FRICTION_LINEAR         // rate is the speed lost per unit of time
+	};
+
+	const double NEVER_STOPS = 1e30;
+
+	// distance a unit velocity covers in tau under exponential decay k, and back
+	double exponentialTravel(double k, double tau);
+	double exponentialTimeForTravel(double k, double u);
+
+	class CTrajectory {
+	public:
+		CTrajectory(void);
+
+		// the ball as it is now, on a table with its time scale and friction
+		CTrajectory(const CBall& ball, const TableDesc& table);
+		CTrajectory(const Vec3& center, float vx, float vz, float timeScale,
+			FrictionModel model, float rate);
+
+		// t is time from now, in the same units the scenes step in
+		Vec3   positionAt(double t) const;
+		void   velocityAt(double t, float& vx, float& vz) const;
+
+		// when the faster axis drops to STOP_SPEED, the rest test ballUpdate uses.
+		// NEVER_STOPS without friction
+		double getStopTime(void) const { return m_stopTime; }
+		Vec3   getRestPosition(void) const { return positionAt(m_stopTime); }
+
+		// time at which the ball has moved distance along its path, NEVER_STOPS if it stops short
+		double timeForDistance(double distance) const;
+
+	private:
+		void   init(const Vec3& center, float vx, float vz, float timeScale, FrictionModel model, float rate);
+		double travel(double t) const;   // path length covered by time t, per unit of start speed
+
+		Vec3			m_start;
+		double			m_vx, m_vz;      // start velocity
+		double			m_speed;
+		double			m_timeScale;
+		FrictionModel	m_model;
+		double			m_rate;
+		double			m_stopTime;
+	};
+}
+
+#endif // __trajectoryH__
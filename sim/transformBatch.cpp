@@ -0,0 +1,81 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: transformBatch.cpp
+//
+// Desc: Dirty tracked world matrices.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "transformBatch.h"
+#include <string.h>
+
+sim::CTransformBatch::CTransformBatch(void)
+{
+	m_world = mat4Identity();
+	m_hasWorld = false;
+}
+
+int sim::CTransformBatch::add(const Vec3& p)
+{
+	int slot = (int)m_positions.size();
+	m_positions.push_back(p);
+	m_transforms.push_back(mat4Identity());
+	if ((int)m_dirty.size() * 64 <= slot)
+		m_dirty.push_back(0);
+	markDirty(slot);
+	return slot;
+}
+
+void sim::CTransformBatch::clear(void)
+{
+	m_positions.clear();
+	m_transforms.clear();
+	m_dirty.clear();
+	m_hasWorld = false;
+}
+
+void sim::CTransformBatch::setPosition(int slot, const Vec3& p)
+{
+	Vec3& old = m_positions[slot];
+	if (old.x == p.x && old.y == p.y && old.z == p.z)
+		return;
+	old = p;
+	markDirty(slot);
+}
+
+sim::Vec3 sim::CTransformBatch::getPosition(int slot) const
+{
+	return m_positions[slot];
+}
+
+int sim::CTransformBatch::update(const Mat4& world)
+{
+	// a new world, say after a drag of the mouse, moves every object
+	if (!m_hasWorld || memcmp(&world, &m_world, sizeof(Mat4)) != 0) {
+		m_world = world;
+		m_hasWorld = true;
+		for (int i = 0; i < getCount(); i++)
+			markDirty(i);
+	}
+
+	int built = 0;
+	for (int w = 0; w < (int)m_dirty.size(); w++) {
+		uint64_t bits = m_dirty[w];
+		while (bits) {
+			int slot = w * 64 + countTrailingZeros64(bits);
+			bits &= bits - 1;
+			mat4TranslationTimes(m_transforms[slot], m_positions[slot], m_world);
+			built++;
+		}
+		m_dirty[w] = 0;
+	}
+	return built;
+}
+
+int sim::CTransformBatch::getDirtyCount(void) const
+{
+	int count = 0;
+	for (int w = 0; w < (int)m_dirty.size(); w++)
+		count += popCount64(m_dirty[w]);
+	return count;
+}
@@ -0,0 +1,52 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: transformBatch.h
+//
+// Desc: World matrices of the drawn objects, built lazily. Objects only store a position, which
+//       marks them dirty when it changes. Once per frame, right before drawing, update() builds
+//       translation * world for the dirty ones in a single pass, or for all of them when the
+//       world matrix itself has moved. Draw calls then set one finished matrix each.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __transformBatchH__
+#define __transformBatchH__
+
+#include "simMath.h"
+#include <vector>
+#include <stdint.h>
+
+namespace sim
+{
+	class CTransformBatch {
+	public:
+		CTransformBatch(void);
+
+		// new slot at p, dirty until the next update
+		int  add(const Vec3& p);
+		void clear(void);
+
+		// marks the slot dirty only when p differs from what it holds
+		void setPosition(int slot, const Vec3& p);
+		Vec3 getPosition(int slot) const;
+
+		// rebuilds the dirty slots, all of them when world is not the one of the last update.
+		// returns how many were rebuilt
+		int  update(const Mat4& world);
+
+		const Mat4& getTransform(int slot) const { return m_transforms[slot]; }
+		int  getCount(void) const { return (int)m_positions.size(); }
+		int  getDirtyCount(void) const;
+
+	private:
+		void markDirty(int slot) { m_dirty[slot >> 6] |= (uint64_t)1 << (slot & 63); }
+
+		std::vector<Vec3>		m_positions;
+		std::vector<Mat4>		m_transforms;
+		std::vector<uint64_t>	m_dirty;       // bit per slot
+		Mat4					m_world;       // world of the last update
+		bool					m_hasWorld;
+	};
+}
+
+#endif // __transformBatchH__
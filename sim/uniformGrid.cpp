@@ -0,0 +1,229 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: uniformGrid.cpp
+//
+// Desc: Uniform grid broadphase.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "uniformGrid.h"
+#include "overlapKernel.h"
+#include "simdSupport.h"
+#include <cmath>
+
+// parked coordinate of removed items, no overlap test can ever reach it
+static const float FAR_AWAY = 1e18f;
+
+sim::CUniformGrid::CUniformGrid(void)
+{
+	clear();
+}
+
+void sim::CUniformGrid::clear(void)
+{
+	m_minX = m_minZ = 0;
+	m_cellSize = m_invCellSize = 1;
+	m_cols = m_rows = 0;
+	m_cellStart.clear();
+	m_cellCount.clear();
+	m_items.clear();
+	m_slotX.clear();
+	m_slotZ.clear();
+	m_itemCell.clear();
+}
+
+void sim::CUniformGrid::cellCoord(float x, float z, int& cx, int& cz) const
+{
+	cx = (int)floorf((x - m_minX) * m_invCellSize);
+	cz = (int)floorf((z - m_minZ) * m_invCellSize);
+	if (cx < 0) cx = 0; else if (cx >= m_cols) cx = m_cols - 1;
+	if (cz < 0) cz = 0; else if (cz >= m_rows) cz = m_rows - 1;
+}
+
+int sim::CUniformGrid::cellOf(float x, float z) const
+{
+	int cx, cz;
+	cellCoord(x, z, cx, cz);
+	return cz * m_cols + cx;
+}
+
+void sim::CUniformGrid::build(const std::vector<float>& x, const std::vector<float>& z, float cellSize)
+{
+	clear();
+	int n = (int)x.size();
+	if (n == 0)
+		return;
+
+	float minX = x[0], maxX = x[0], minZ = z[0], maxZ = z[0];
+	for (int i = 1; i < n; i++) {
+		if (x[i] < minX) minX = x[i];
+		if (x[i] > maxX) maxX = x[i];
+		if (z[i] < minZ) minZ = z[i];
+		if (z[i] > maxZ) maxZ = z[i];
+	}
+
+	// cells counted in double so a sparse extent cannot overflow, and grown until they fit
+	double limit = (double)n * GRID_CELLS_PER_ITEM;
+	if (limit < GRID_MAX_CELLS / 64) limit = GRID_MAX_CELLS / 64;
+	if (limit > GRID_MAX_CELLS) limit = GRID_MAX_CELLS;
+	double spanX = (double)maxX - minX, spanZ = (double)maxZ - minZ;
+	for (;;) {
+		double cols = floor(spanX / cellSize) + 1, rows = floor(spanZ / cellSize) + 1;
+		if (cols * rows <= limit)
+			break;
+		float grown = (float)(cellSize * sqrt(cols * rows / limit)) * 1.01f;
+		cellSize = grown > cellSize ? grown : 2 * cellSize;
+	}
+
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / cellSize;
+	m_minX = minX;
+	m_minZ = minZ;
+	m_cols = (int)((maxX - minX) * m_invCellSize) + 1;
+	m_rows = (int)((maxZ - minZ) * m_invCellSize) + 1;
+
+	// counting sort of the items by cell
+	int cells = m_cols * m_rows;
+	m_cellStart.assign(cells + 1, 0);
+	m_cellCount.assign(cells, 0);
+	m_itemCell.resize(n);
+	for (int i = 0; i < n; i++) {
+		m_itemCell[i] = cellOf(x[i], z[i]);
+		m_cellCount[m_itemCell[i]]++;
+	}
+	for (int c = 0; c < cells; c++)
+		m_cellStart[c + 1] = m_cellStart[c] + m_cellCount[c];
+
+	std::vector<int> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+	m_items.resize(n);
+	m_slotX.resize(n);
+	m_slotZ.resize(n);
+	for (int i = 0; i < n; i++) {
+		int s = fill[m_itemCell[i]]++;
+		m_items[s] = i;
+		m_slotX[s] = x[i];
+		m_slotZ[s] = z[i];
+	}
+}
+
+void sim::CUniformGrid::remove(int item)
+{
+	int c = m_itemCell[item];
+	if (c < 0)
+		return;
+	int first = m_cellStart[c];
+	int last = first + m_cellCount[c] - 1;
+	for (int s = first; s <= last; s++) {
+		if (m_items[s] == item) {
+			m_items[s] = m_items[last];
+			m_slotX[s] = m_slotX[last];
+			m_slotZ[s] = m_slotZ[last];
+			m_items[last] = item;
+			m_slotX[last] = m_slotZ[last] = FAR_AWAY;
+			m_cellCount[c]--;
+			break;
+		}
+	}
+	m_itemCell[item] = -1;
+}
+
+void sim::CUniformGrid::querySweep(float x0, float z0, float x1, float z1, float radius, std::vector<int>& out) const
+{
+	out.clear();
+	if (m_cols == 0)
+		return;
+
+	float boxMinX = (x0 < x1 ? x0 : x1) - radius, boxMaxX = (x0 > x1 ? x0 : x1) + radius;
+	float boxMinZ = (z0 < z1 ? z0 : z1) - radius, boxMaxZ = (z0 > z1 ? z0 : z1) + radius;
+
+	// a box outside the field would clamp onto the border cells, reject it early
+	if (boxMaxX < m_minX || boxMinX > m_minX + m_cols * m_cellSize ||
+		boxMaxZ < m_minZ || boxMinZ > m_minZ + m_rows * m_cellSize)
+		return;
+
+	// every item center that can touch the swept ball lies in the cells covering the grown box
+	int cx0, cz0, cx1, cz1;
+	cellCoord(boxMinX, boxMinZ, cx0, cz0);
+	cellCoord(boxMaxX, boxMaxZ, cx1, cz1);
+
+	for (int cz = cz0; cz <= cz1; cz++) {
+		for (int cx = cx0; cx <= cx1; cx++) {
+			int c = cz * m_cols + cx;
+			int first = m_cellStart[c];
+			int last = first + m_cellCount[c];
+			for (int s = first; s < last; s++)
+				out.push_back(m_items[s]);
+		}
+	}
+}
+
+void sim::CUniformGrid::queryOverlap(float x, float z, float radius, std::vector<int>& out) const
+{
+	out.clear();
+	if (m_cols == 0)
+		return;
+	if (x + radius < m_minX || x - radius > m_minX + m_cols * m_cellSize ||
+		z + radius < m_minZ || z - radius > m_minZ + m_rows * m_cellSize)
+		return;
+
+	int cx0, cz0, cx1, cz1;
+	cellCoord(x - radius, z - radius, cx0, cz0);
+	cellCoord(x + radius, z + radius, cx1, cz1);
+
+	// cells of one row are neighbours in slot order, so each row is a single batch
+	for (int cz = cz0; cz <= cz1; cz++) {
+		int first = m_cellStart[cz * m_cols + cx0];
+		int count = m_cellStart[cz * m_cols + cx1 + 1] - first;
+		if (count == 0)
+			continue;
+
+		int words = overlapMaskWords(count);
+		if ((int)m_mask.size() < words)
+			m_mask.resize(words);
+		if (overlapBatch(x, z, radius, &m_slotX[first], &m_slotZ[first], count, &m_mask[0]) == 0)
+			continue;
+		for (int w = 0; w < words; w++) {
+			for (uint64_t bits = m_mask[w]; bits; bits &= bits - 1)
+				out.push_back(m_items[first + w * 64 + countTrailingZeros64(bits)]);
+		}
+	}
+}
+
+bool sim::CUniformGrid::findOverlap(float radius, int& a, int& b) const
+{
+	float r2 = radius * radius;
+	static const int NEXT[4][2] = { { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+	for (int cz = 0; cz < m_rows; cz++) {
+		for (int cx = 0; cx < m_cols; cx++) {
+			int c = cz * m_cols + cx;
+			int first = m_cellStart[c];
+			int last = first + m_cellCount[c];
+			for (int s = first; s < last; s++) {
+				float x = m_slotX[s], z = m_slotZ[s];
+				for (int t = s + 1; t < last; t++) {
+					float dx = m_slotX[t] - x, dz = m_slotZ[t] - z;
+					if (dx * dx + dz * dz < r2) {
+						a = m_items[s];
+						b = m_items[t];
+						return true;
+					}
+				}
+				for (int k = 0; k < 4; k++) {
+					int nx = cx + NEXT[k][0], nz = cz + NEXT[k][1];
+					if (nx < 0 || nx >= m_cols || nz >= m_rows)
+						continue;
+					int n = nz * m_cols + nx;
+					for (int t = m_cellStart[n]; t < m_cellStart[n] + m_cellCount[n]; t++) {
+						float dx = m_slotX[t] - x, dz = m_slotZ[t] - z;
+						if (dx * dx + dz * dz < r2) {
+							a = m_items[s];
+							b = m_items[t];
+							return true;
+						}
+					}
+				}
+			}
+		}
+	}
+	return false;
+}
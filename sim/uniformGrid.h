@@ -0,0 +1,69 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: uniformGrid.h
+//
+// Desc: Uniform grid over static bodies (lego bricks, sleeping billiard balls). Items are stored cell by cell in one flat
+//       array, so a query only touches the cells a moving ball overlaps or sweeps through.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __uniformGridH__
+#define __uniformGridH__
+
+#include <vector>
+#include <stdint.h>
+
+namespace sim
+{
+	// a build over a sparse or huge extent uses larger cells rather than more of them than this,
+	// or than GRID_CELLS_PER_ITEM for each item when that is more
+	const int GRID_MAX_CELLS      = 1 << 22;
+	const int GRID_CELLS_PER_ITEM = 4;
+
+	class CUniformGrid {
+	public:
+		CUniformGrid(void);
+
+		// x[i], z[i] is the center of item i. cellSize should be at least one item diameter, it is
+		// only ever made larger, see GRID_MAX_CELLS
+		void build(const std::vector<float>& x, const std::vector<float>& z, float cellSize);
+		void clear(void);
+
+		// take an item out of its cell, later queries will not report it again
+		void remove(int item);
+
+		// items whose cell intersects the segment (x0,z0)-(x1,z1) grown by radius.
+		// out is cleared first and keeps its capacity, so steady state queries do not allocate
+		void querySweep(float x0, float z0, float x1, float z1, float radius, std::vector<int>& out) const;
+
+		// items closer than radius to (x, z), tested in batches straight from the packed cell storage
+		void queryOverlap(float x, float z, float radius, std::vector<int>& out) const;
+
+		// some pair of items closer than radius, which must not exceed the cell size. each cell is
+		// paired with itself and the four neighbours after it, walking the packed storage in order
+		bool findOverlap(float radius, int& a, int& b) const;
+
+		int   getCellCount(void) const { return m_cols * m_rows; }
+		float getCellSize(void) const { return m_cellSize; }
+
+	private:
+		int  cellOf(float x, float z) const;
+		void cellCoord(float x, float z, int& cx, int& cz) const;
+
+		float m_minX, m_minZ;
+		float m_cellSize;
+		float m_invCellSize;
+		int   m_cols, m_rows;
+
+		std::vector<int> m_cellStart;   // first slot of each cell in m_items, one extra at the end
+		std::vector<int> m_cellCount;   // live items in each cell, they sit at the front of the slot range
+		std::vector<int> m_items;
+		std::vector<float> m_slotX;     // item centers in slot order, removed items are parked far away
+		std::vector<float> m_slotZ;
+		std::vector<int> m_itemCell;
+
+		mutable std::vector<uint64_t> m_mask;
+	};
+}
+
+#endif // __uniformGridH__
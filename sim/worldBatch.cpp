@@ -0,0 +1,44 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: worldBatch.cpp
+//
+// Desc: Batch of independent tables.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "worldBatch.h"
+
+sim::CLegoScene& sim::CWorldBatch::addLego(void)
+{
+	m_lego.push_back(CLegoScene());
+	return m_lego.back();
+}
+
+sim::CBilliardScene& sim::CWorldBatch::addBilliard(void)
+{
+	m_billiard.push_back(CBilliardScene());
+	return m_billiard.back();
+}
+
+void sim::CWorldBatch::clear(void)
+{
+	m_lego.clear();
+	m_billiard.clear();
+}
+
+void sim::CWorldBatch::advance(CThreadPool& pool, float timeDelta, int steps)
+{
+	int lego = (int)m_lego.size();
+	pool.parallelFor(getWorldCount(), WORLD_GRAIN, [&](int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			if (i < lego) {
+				for (int s = 0; s < steps; s++)
+					m_lego[i].step(timeDelta);
+			}
+			else {
+				for (int s = 0; s < steps; s++)
+					m_billiard[i - lego].step(timeDelta);
+			}
+		}
+	});
+}
@@ -0,0 +1,47 @@
+//////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// File: worldBatch.h
+//
+// Desc: Many independent tables stepped together. Every scene is a complete world with no state
+//       shared with the others, so the batch only hands them out to the threads of a pool.
+//
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef __worldBatchH__
+#define __worldBatchH__
+
+#include "simScene.h"
+#include "threadPool.h"
+#include <vector>
+
+namespace sim
+{
+	const int WORLD_GRAIN = 8;   // worlds per chunk handed to a thread
+
+	class CWorldBatch {
+	public:
+		CWorldBatch(void) {}
+
+		// returned scenes are set up by the caller, references stay valid until the next add
+		CLegoScene&     addLego(void);
+		CBilliardScene& addBilliard(void);
+		void            clear(void);
+
+		int getWorldCount(void) const { return (int)(m_lego.size() + m_billiard.size()); }
+		int getLegoCount(void) const { return (int)m_lego.size(); }
+		int getBilliardCount(void) const { return (int)m_billiard.size(); }
+
+		CLegoScene&     getLego(int i) { return m_lego[i]; }
+		CBilliardScene& getBilliard(int i) { return m_billiard[i]; }
+
+		// every world takes steps steps of timeDelta. a world runs all of its steps on one
+		// thread before the next world is started, so its state stays in that core's cache
+		void advance(CThreadPool& pool, float timeDelta, int steps);
+
+	private:
+		std::vector<CLegoScene>		m_lego;
+		std::vector<CBilliardScene>	m_billiard;
+	};
+}
+
+#endif // __worldBatchH__